@@ -0,0 +1,761 @@
+// RAFT 主机端内核微基准
+//
+// 用法: bench_raft [--json out.json] [--filter name] [--min-time 0.5]
+//                  [--threads N] [--label release-tag]
+//
+// 每个用例先预热一次，再重复运行直到累计时间超过 --min-time (至少 3 次)，
+// 报告 min / median / mean 耗时，以及按 median 计算的 GB/s 与 GFLOP/s。
+// bytes 为必需的内存流量 (每个输入读一次、每个输出写一次)，flops 按内核的
+// 乘加次数计 (一次 FMA 记 2)。--json 写出的结果可跨版本对比回归。
+
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/prettywriter.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "blob.hpp"
+#include "common.hpp"
+#include "cpu_functional.hpp"
+#include "cpu_gemm.hpp"
+#include "cpu_quant.hpp"
+#include "npy.hpp"
+#include "npy_sequence.hpp"
+#include "npy_sink.hpp"
+#include "raft.hpp"
+#include "tensor_view.hpp"
+#include "thread_pool.hpp"
+
+using namespace ::ferrari;
+
+namespace
+{
+
+struct Options
+{
+    std::string json_path;
+    std::string filter;
+    std::string label;
+    double      min_time    = 0.5;
+    int         num_threads = 0;
+};
+
+struct Result
+{
+    std::string name;
+    std::string shape;
+    int         iterations;
+    double      min_ms;
+    double      median_ms;
+    double      mean_ms;
+    double      bytes;
+    double      flops;
+};
+
+class Bench
+{
+public:
+    explicit Bench(const Options& opt) : opt_(opt) {}
+
+    // fn 执行一次被测内核；bytes / flops 为单次运行的流量与运算量
+    void run(const std::string&           name,
+             const std::string&           shape,
+             double                       bytes,
+             double                       flops,
+             const std::function<void()>& fn)
+    {
+        if (!opt_.filter.empty() && name.find(opt_.filter) == std::string::npos)
+        {
+            return;
+        }
+        fn();  // 预热：首次分配、缺页、线程池创建
+
+        std::vector<double> times;
+        double              total = 0.0;
+        while ((total < opt_.min_time || times.size() < 3) && times.size() < 10000)
+        {
+            const auto t0 = std::chrono::steady_clock::now();
+            fn();
+            const auto   t1 = std::chrono::steady_clock::now();
+            const double s  = std::chrono::duration<double>(t1 - t0).count();
+            times.push_back(s);
+            total += s;
+        }
+        std::sort(times.begin(), times.end());
+
+        Result r;
+        r.name       = name;
+        r.shape      = shape;
+        r.iterations = static_cast<int>(times.size());
+        r.min_ms     = times.front() * 1e3;
+        r.median_ms  = times[times.size() / 2] * 1e3;
+        r.mean_ms    = total / times.size() * 1e3;
+        r.bytes      = bytes;
+        r.flops      = flops;
+        results_.push_back(r);
+
+        std::printf("%-28s %-22s %8d %11.3f %11.3f %9.2f %10.2f\n",
+                    r.name.c_str(),
+                    r.shape.c_str(),
+                    r.iterations,
+                    r.min_ms,
+                    r.median_ms,
+                    gb_per_s(r),
+                    gflop_per_s(r));
+        std::fflush(stdout);
+    }
+
+    static double gb_per_s(const Result& r) { return r.bytes / (r.median_ms * 1e-3) / 1e9; }
+    static double gflop_per_s(const Result& r) { return r.flops / (r.median_ms * 1e-3) / 1e9; }
+
+    int write_json(const std::string& path) const
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            std::cerr << "Cannot open " << path << " for writing" << std::endl;
+            return -1;
+        }
+        rapidjson::OStreamWrapper                          stream(out);
+        rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(stream);
+
+        char               date[32];
+        const std::time_t  now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        writer.StartObject();
+        writer.Key("context");
+        writer.StartObject();
+        writer.Key("date");
+        writer.String(date);
+        writer.Key("label");
+        writer.String(opt_.label.c_str());
+        writer.Key("num_threads");
+        writer.Int(Caffe::num_threads());
+        writer.Key("cpu_only");
+#ifdef CPU_ONLY
+        writer.Bool(true);
+#else
+        writer.Bool(false);
+#endif
+        writer.Key("isa");
+        writer.String(isa());
+        writer.Key("min_time_s");
+        writer.Double(opt_.min_time);
+        writer.EndObject();
+
+        writer.Key("benchmarks");
+        writer.StartArray();
+        for (const Result& r : results_)
+        {
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(r.name.c_str());
+            writer.Key("shape");
+            writer.String(r.shape.c_str());
+            writer.Key("iterations");
+            writer.Int(r.iterations);
+            writer.Key("min_ms");
+            writer.Double(r.min_ms);
+            writer.Key("median_ms");
+            writer.Double(r.median_ms);
+            writer.Key("mean_ms");
+            writer.Double(r.mean_ms);
+            writer.Key("bytes");
+            writer.Double(r.bytes);
+            writer.Key("flops");
+            writer.Double(r.flops);
+            writer.Key("gb_per_s");
+            writer.Double(gb_per_s(r));
+            writer.Key("gflop_per_s");
+            writer.Double(gflop_per_s(r));
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+        out << std::endl;
+        return out ? 0 : -1;
+    }
+
+    static const char* isa()
+    {
+#if defined(__AVX512F__)
+        return "avx512";
+#elif defined(__AVX2__)
+        return "avx2";
+#else
+        return "scalar";
+#endif
+    }
+
+private:
+    Options             opt_;
+    std::vector<Result> results_;
+};
+
+std::string shape_str(const std::vector<int>& shape)
+{
+    std::string s;
+    for (size_t i = 0; i < shape.size(); ++i)
+    {
+        s += (i ? "x" : "") + std::to_string(shape[i]);
+    }
+    return s;
+}
+
+void fill(Blob<float>* blob, float scale, float freq)
+{
+    float* p = blob->mutable_cpu_data();
+    for (int i = 0; i < blob->count(); ++i)
+    {
+        p[i] = scale * std::sin(freq * i);
+    }
+}
+
+// coords[b, 0/1, y, x] = 像素坐标加小扰动，与 RAFT 迭代中的流场相近
+void fill_coords(Blob<float>* coords)
+{
+    const int B = coords->shape(0), H = coords->shape(2), W = coords->shape(3);
+    float*    p = coords->mutable_cpu_data();
+    for (int b = 0; b < B; ++b)
+    {
+        for (int y = 0; y < H; ++y)
+        {
+            for (int x = 0; x < W; ++x)
+            {
+                const int i = y * W + x;
+
+                p[(b * 2 + 0) * H * W + i] = x + 3.0f * std::sin(0.11f * i);
+                p[(b * 2 + 1) * H * W + i] = y + 2.0f * std::cos(0.07f * i);
+            }
+        }
+    }
+}
+
+// grid_sample: 每个输出读 4 个邻点，双线性插值计 8 flops
+void bench_grid_sample(Bench* bench, int B, int C, int H, int W)
+{
+    auto input  = std::make_shared<Blob<float>>(B, C, H, W);
+    auto grid   = std::make_shared<Blob<float>>(B, H, W, 2);
+    auto output = std::make_shared<Blob<float>>(B, C, H, W);
+    fill(input.get(), 1.0f, 0.01f);
+    fill(grid.get(), 1.1f, 0.37f);
+
+    const double n = static_cast<double>(output->count());
+    bench->run("grid_sample",
+               shape_str(input->shape()),
+               4.0 * (input->count() + grid->count() + output->count()),
+               8.0 * n,
+               [&]() { grid_sample_cpu(input, grid, output); });
+}
+
+// 布局转换: 每个 batch 转置 [C, H*W]，读写各一次
+void bench_layout(Bench* bench, int B, int C, int H, int W)
+{
+    Blob<float> nchw(B, C, H, W);
+    Blob<float> nhwc;
+    Blob<float> back;
+    fill(&nchw, 1.0f, 0.01f);
+
+    const double bytes = 8.0 * nchw.count();
+    bench->run("layout_nchw_to_nhwc",
+               shape_str(nchw.shape()),
+               bytes,
+               0.0,
+               [&]() { convert_layout_cpu(nchw, LAYOUT_NHWC, &nhwc); });
+    bench->run("layout_nhwc_to_nchw",
+               shape_str(nchw.shape()),
+               bytes,
+               0.0,
+               [&]() { convert_layout_cpu(nhwc, LAYOUT_NCHW, &back); });
+}
+
+// 全对相关体: corr[b] = fmap1[b]^T fmap2[b] / sqrt(D)，随后建金字塔并查询
+void bench_all_pairs(Bench* bench, int B, int D, int H, int W, int levels, int radius)
+{
+    const int  HW    = H * W;
+    const auto shape = shape_str({B, D, H, W});
+    auto       fmap1 = std::make_shared<Blob<float>>(B, D, H, W);
+    auto       fmap2 = std::make_shared<Blob<float>>(B, D, H, W);
+    fill(fmap1.get(), 1.0f, 0.013f);
+    fill(fmap2.get(), 1.0f, 0.017f);
+    const float alpha = 1.0f / std::sqrt(static_cast<float>(D));
+
+    std::vector<std::shared_ptr<Blob<float>>> pyramid;
+    int64_t                                   pyramid_count = 0;
+    for (int i = 0; i < levels; ++i)
+    {
+        const int h = static_cast<int>(H / std::pow(2, i));
+        const int w = static_cast<int>(W / std::pow(2, i));
+        pyramid.push_back(std::make_shared<Blob<float>>(std::vector<int>({B * HW, 1, h, w})));
+        pyramid_count += pyramid.back()->count();
+    }
+    const double volume = static_cast<double>(B) * HW * HW;
+    const double fmaps  = 2.0 * B * D * HW;
+
+    bench->run("corr_gemm_fp32",
+               shape,
+               4.0 * (fmaps + volume),
+               2.0 * volume * D,
+               [&]()
+               {
+                   for (int b = 0; b < B; ++b)
+                   {
+                       caffe_cpu_sgemm(true,
+                                       false,
+                                       HW,
+                                       HW,
+                                       D,
+                                       alpha,
+                                       fmap1->cpu_data() + static_cast<int64_t>(b) * D * HW,
+                                       fmap2->cpu_data() + static_cast<int64_t>(b) * D * HW,
+                                       0.0f,
+                                       pyramid[0]->mutable_cpu_data() +
+                                           static_cast<int64_t>(b) * HW * HW);
+                   }
+               });
+
+    bench->run("corr_gemm_int8",
+               shape,
+               4.0 * (fmaps + volume),
+               2.0 * volume * D,
+               [&]()
+               {
+                   for (int b = 0; b < B; ++b)
+                   {
+                       corr_volume_int8_cpu(fmap1->cpu_data() + static_cast<int64_t>(b) * D * HW,
+                                            fmap2->cpu_data() + static_cast<int64_t>(b) * D * HW,
+                                            D,
+                                            HW,
+                                            alpha,
+                                            pyramid[0]->mutable_cpu_data() +
+                                                static_cast<int64_t>(b) * HW * HW);
+                   }
+               });
+
+    // 每层读上一层、写本层；每个输出 4 个加法 + 1 个乘法
+    const double coarse = static_cast<double>(pyramid_count - pyramid[0]->count());
+    bench->run("corr_pyramid_build",
+               shape,
+               4.0 * (pyramid_count - pyramid.back()->count() + coarse),
+               4.0 * coarse,
+               [&]() { build_corr_pyramid_cpu(pyramid); });
+
+    // 每层每个查询像素读 (2r+2)^2 的整数网格块，双线性混合成 (2r+1)^2 个输出，
+    // 每个输出 8 flops
+    const int window = (2 * radius + 1) * (2 * radius + 1);
+    auto      coords = std::make_shared<Blob<float>>(B, 2, H, W);
+    auto      output = std::make_shared<Blob<float>>(B, levels * window, H, W);
+    fill_coords(coords.get());
+    const double patch = static_cast<double>(B) * HW * levels * (2 * radius + 2) * (2 * radius + 2);
+    bench->run("corr_lookup",
+               shape,
+               4.0 * (coords->count() + patch + output->count()),
+               8.0 * output->count(),
+               [&]()
+               {
+                   corr_lookup_cpu(
+                       pyramid, coords->cpu_data(), B, H, W, radius, output->mutable_cpu_data());
+               });
+}
+
+// 按需相关: 不建全对体，查询时对 fmap2 金字塔窗口做 D 维点积
+void bench_on_demand(Bench* bench, int B, int D, int H, int W, int levels, int radius)
+{
+    const auto shape = shape_str({B, D, H, W});
+    auto       fmap1 = std::make_shared<Blob<float>>(B, D, H, W);
+    auto       fmap2 = std::make_shared<Blob<float>>(B, D, H, W);
+    fill(fmap1.get(), 1.0f, 0.013f);
+    fill(fmap2.get(), 1.0f, 0.017f);
+
+    // 准备阶段: fmap1 / fmap2 转置为 [B, H, W, D]，fmap2 再逐层 2x2 平均池化
+    const double n      = static_cast<double>(fmap1->count());
+    double       pooled = 0.0, pool_in = 0.0;
+    for (int i = 1; i < levels; ++i)
+    {
+        pool_in += static_cast<double>(B) * D * (H >> (i - 1)) * (W >> (i - 1));
+        pooled += static_cast<double>(B) * D * (H >> i) * (W >> i);
+    }
+    CorrBlock corr(B, D, H, W, levels, radius, CorrBlock::ON_DEMAND);
+    bench->run("corr_on_demand_prepare",
+               shape,
+               4.0 * (4.0 * n + pool_in + pooled),
+               4.0 * pooled,
+               [&]() { corr.computeCorr(fmap1, fmap2); });
+
+    // 每层每个查询像素计算 (2r+2)^2 个 D 维点积，再混合成 (2r+1)^2 个输出
+    const int window = (2 * radius + 1) * (2 * radius + 1);
+    auto      coords = std::make_shared<Blob<float>>(B, 2, H, W);
+    auto      output = std::make_shared<Blob<float>>(B, levels * window, H, W);
+    fill_coords(coords.get());
+    const double dots =
+        static_cast<double>(B) * H * W * levels * (2 * radius + 2) * (2 * radius + 2);
+    bench->run("corr_on_demand_lookup",
+               shape,
+               4.0 * (2.0 * n + pooled + coords->count() + output->count()),
+               2.0 * D * dots + 8.0 * output->count(),
+               [&]() { corr.call(coords, output); });
+}
+
+void bench_npy(Bench* bench, const std::vector<int>& shape)
+{
+    const char*       tmp  = std::getenv("TMPDIR");
+    const std::string path = std::string(tmp ? tmp : "/tmp") + "/bench_raft_" +
+                             shape_str(shape) + ".npy";
+    Blob<float> blob(shape);
+    Blob<float> loaded;
+    fill(&blob, 1.0f, 0.01f);
+    const double   bytes = 4.0 * blob.count();
+    volatile float sink  = 0.0f;
+
+    bench->run("npy_save", shape_str(shape), bytes, 0.0, [&]() { blob.SaveToNPY(path); });
+    bench->run("npy_load", shape_str(shape), bytes, 0.0, [&]() { loaded.LoadFromNPY(path); });
+    // 映射加载只在访问时缺页，这里两种方式都读一遍数据
+    bench->run("npy_load_read",
+               shape_str(shape),
+               bytes,
+               0.0,
+               [&]()
+               {
+                   loaded.LoadFromNPY(path);
+                   const float* p = loaded.cpu_data();
+                   sink           = std::accumulate(p, p + loaded.count(), 0.0f);
+               });
+    bench->run("npy_mmap_read",
+               shape_str(shape),
+               bytes,
+               0.0,
+               [&]()
+               {
+                   loaded.LoadFromNPY(path, true);
+                   const float* p = loaded.cpu_data();
+                   sink           = std::accumulate(p, p + loaded.count(), 0.0f);
+               });
+    std::remove(path.c_str());
+
+    // 逐帧追加：npy_save 每帧重新解析并改写文件头，NpySink 在调用线程只拷贝快照
+    const std::string         stream = path + ".stream";
+    const std::vector<size_t> frame(shape.begin(), shape.end());
+    bench->run("npy_append",
+               shape_str(shape),
+               bytes,
+               0.0,
+               [&]() { cnpy::npy_save(stream, blob.cpu_data(), frame, "a"); });
+    std::remove(stream.c_str());
+    {
+        NpySink writer(1, 16);
+        bench->run("npy_sink_append",
+                   shape_str(shape),
+                   bytes,
+                   0.0,
+                   [&]() { writer.Append(blob, stream); });
+        writer.Flush();
+    }
+    std::remove(stream.c_str());
+}
+
+// 原始 uint8 帧：先加载 float32 再归一化，对比加载 uint8 时转换并归一化的单遍路径
+void bench_npy_convert(Bench* bench, const std::vector<int>& shape)
+{
+    const char*          tmp  = std::getenv("TMPDIR");
+    const std::string    base = std::string(tmp ? tmp : "/tmp") + "/bench_raft_frame";
+    const std::string    f32  = base + "_f32.npy";
+    const std::string    u8   = base + "_u8.npy";
+    std::vector<size_t>  sh(shape.begin(), shape.end());
+    Blob<float>          blob(shape);
+    std::vector<uint8_t> pixels(blob.count());
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i]                  = static_cast<uint8_t>(i * 31);
+        blob.mutable_cpu_data()[i] = pixels[i];
+    }
+    blob.SaveToNPY(f32);
+    cnpy::npy_save(u8, pixels.data(), sh);
+    const double bytes = pixels.size();
+
+    bench->run("npy_load_f32_normalize",
+               shape_str(shape),
+               4.0 * bytes,
+               2.0 * bytes,
+               [&]()
+               {
+                   blob.LoadFromNPY(f32);
+                   float* p = blob.mutable_cpu_data();
+                   for (int64_t i = 0; i < blob.count(); ++i)
+                   {
+                       p[i] = 2.0f * (p[i] / 255.0f) - 1.0f;
+                   }
+               });
+    bench->run("npy_load_u8_normalize",
+               shape_str(shape),
+               bytes,
+               2.0 * bytes,
+               [&]() { blob.LoadFromNPY(u8, 2.0f / 255.0f, -1.0f); });
+    std::remove(f32.c_str());
+    std::remove(u8.c_str());
+}
+
+// 逐帧处理 frames 个 npy：同步加载与 NpySequenceReader 预取（窗口 4）对比，
+// 每帧都做一遍求和模拟计算
+void bench_npy_sequence(Bench* bench, int frames, const std::vector<int>& shape)
+{
+    const char*              tmp = std::getenv("TMPDIR");
+    std::vector<std::string> paths;
+    Blob<float>              blob(shape);
+    fill(&blob, 1.0f, 0.01f);
+    for (int n = 0; n < frames; ++n)
+    {
+        paths.push_back(std::string(tmp ? tmp : "/tmp") + "/bench_raft_seq" + std::to_string(n) +
+                        ".npy");
+        blob.SaveToNPY(paths.back());
+    }
+    const std::string label = std::to_string(frames) + "x" + shape_str(shape);
+    const double      bytes = 4.0 * frames * blob.count();
+    volatile float    sink  = 0.0f;
+
+    bench->run("npy_sequence_sync",
+               label,
+               bytes,
+               0.0,
+               [&]()
+               {
+                   for (int n = 0; n < frames; ++n)
+                   {
+                       blob.LoadFromNPY(paths[n]);
+                       const float* p = blob.cpu_data();
+                       sink           = std::accumulate(p, p + blob.count(), 0.0f);
+                   }
+               });
+    bench->run("npy_sequence_prefetch",
+               label,
+               bytes,
+               0.0,
+               [&]()
+               {
+                   NpySequenceReader<float> reader(paths, 4);
+                   SharedBlob<float>        frame;
+                   for (int n = 0; n < frames; ++n)
+                   {
+                       reader.Next(&frame);
+                       const float* p = frame->cpu_data();
+                       sink           = std::accumulate(p, p + frame->count(), 0.0f);
+                   }
+               });
+    for (int n = 0; n < frames; ++n)
+    {
+        std::remove(paths[n].c_str());
+    }
+}
+
+// members 个同形状数组组成的 npz，全部加载或只取最后一个
+void bench_npz(Bench* bench, int members, const std::vector<int>& shape)
+{
+    const char*       tmp  = std::getenv("TMPDIR");
+    const std::string path = std::string(tmp ? tmp : "/tmp") + "/bench_raft_" +
+                             shape_str(shape) + ".npz";
+    Blob<float> blob(shape);
+    fill(&blob, 1.0f, 0.01f);
+    const std::vector<size_t> npy_shape(shape.begin(), shape.end());
+
+    auto save = [&](int level)
+    {
+        cnpy::NpzWriter writer(path, "w", level);
+        for (int i = 0; i < members; ++i)
+        {
+            writer.add("array" + std::to_string(i), blob.cpu_data(), npy_shape);
+        }
+        writer.close();
+    };
+    const std::string label = std::to_string(members) + "x" + shape_str(shape);
+    const double      bytes = 4.0 * blob.count();
+
+    bench->run("npz_save_deflate1", label, members * bytes, 0.0, [&]() { save(1); });
+    bench->run("npz_save", label, members * bytes, 0.0, [&]() { save(0); });
+    Blob<float> loaded;
+    bench->run("npz_load_all", label, members * bytes, 0.0, [&]() { cnpy::npz_load(path); });
+    bench->run("npz_load_last",
+               label,
+               bytes,
+               0.0,
+               [&]() { loaded.LoadFromNPZ(path, "array" + std::to_string(members - 1)); });
+    std::remove(path.c_str());
+}
+
+// 按 NCHW 顺序逐元素累加 at(n, c, h, w)
+template <typename Accessor>
+float sum_nchw(int N, int C, int H, int W, const Accessor& at)
+{
+    float sum = 0.0f;
+    for (int n = 0; n < N; ++n)
+    {
+        for (int c = 0; c < C; ++c)
+        {
+            for (int h = 0; h < H; ++h)
+            {
+                for (int w = 0; w < W; ++w)
+                {
+                    sum += at(n, c, h, w);
+                }
+            }
+        }
+    }
+    return sum;
+}
+
+void bench_blob(Bench* bench, const std::vector<int>& shape)
+{
+    Blob<float> src(shape);
+    Blob<float> dst(shape);
+    fill(&src, 1.0f, 0.01f);
+
+    // 形状交替变化但容量不变，只测 Reshape 的元数据开销
+    std::vector<int> flat = {1, static_cast<int>(src.count())};
+    bench->run("blob_reshape",
+               shape_str(shape),
+               0.0,
+               0.0,
+               [&]()
+               {
+                   for (int i = 0; i < 1000; ++i)
+                   {
+                       dst.Reshape(flat);
+                       dst.Reshape(shape);
+                   }
+               });
+    bench->run("blob_copy",
+               shape_str(shape),
+               8.0 * src.count(),
+               0.0,
+               [&]() { dst.CopyFrom(src); });
+
+    // 逐元素遍历: data_at 每次都做边界 CHECK 与 SyncedMemory 状态检查，TensorView 只做地址计算
+    const int      N    = src.num();
+    const int      C    = src.channels();
+    const int      H    = src.height();
+    const int      W    = src.width();
+    volatile float sink = 0.0f;
+    bench->run("blob_data_at_sum",
+               shape_str(shape),
+               4.0 * src.count(),
+               src.count(),
+               [&]()
+               {
+                   auto at = [&](int n, int c, int h, int w) { return src.data_at(n, c, h, w); };
+                   sink    = sum_nchw(N, C, H, W, at);
+               });
+    bench->run("tensor_view_sum",
+               shape_str(shape),
+               4.0 * src.count(),
+               src.count(),
+               [&]()
+               {
+                   const auto view = tensor_view<4>(src);
+                   auto       at   = [&](int n, int c, int h, int w) { return view(n, c, h, w); };
+                   sink            = sum_nchw(N, C, H, W, at);
+               });
+    (void)sink;
+}
+
+int parse_options(int argc, char** argv, Options* opt)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return -1;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--json")
+        {
+            opt->json_path = value;
+        }
+        else if (arg == "--filter")
+        {
+            opt->filter = value;
+        }
+        else if (arg == "--label")
+        {
+            opt->label = value;
+        }
+        else if (arg == "--min-time")
+        {
+            opt->min_time = std::atof(value.c_str());
+        }
+        else if (arg == "--threads")
+        {
+            opt->num_threads = std::atoi(value.c_str());
+        }
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if (parse_options(argc, argv, &opt) != 0)
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [--json out.json] [--filter name] [--min-time seconds]"
+                     " [--threads N] [--label tag]"
+                  << std::endl;
+        return 1;
+    }
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_num_threads(opt.num_threads);
+
+    std::printf("threads: %d  isa: %s\n", Caffe::num_threads(), Bench::isa());
+    std::printf("%-28s %-22s %8s %11s %11s %9s %10s\n",
+                "name",
+                "shape",
+                "iters",
+                "min_ms",
+                "median_ms",
+                "GB/s",
+                "GFLOP/s");
+
+    Bench bench(opt);
+
+    // 生产形状: 11 对 1/8 分辨率特征 (240x432 输入)，以及 1080p 的 1/8 分辨率
+    const int levels = 4, radius = 4;
+    bench_grid_sample(&bench, 11, 256, 30, 54);
+    bench_grid_sample(&bench, 1, 256, 135, 240);
+    bench_layout(&bench, 11, 256, 30, 54);
+    bench_layout(&bench, 1, 256, 135, 240);
+    bench_all_pairs(&bench, 11, 256, 30, 54, levels, radius);
+    // 1080p 的全对相关体为 (135*240)^2*4 字节 ≈ 4.2 GB，只测按需模式
+    bench_on_demand(&bench, 11, 256, 30, 54, levels, radius);
+    bench_on_demand(&bench, 1, 256, 135, 240, levels, radius);
+    bench_npy(&bench, {11, 256, 30, 54});
+    bench_npy(&bench, {1, 256, 135, 240});
+    bench_npy(&bench, {2, 8, 8});
+    bench_npy_convert(&bench, {1, 3, 1080, 1920});
+    bench_npy_sequence(&bench, 16, {1, 2, 436, 1024});
+    bench_npz(&bench, 32, {1, 256, 30, 54});
+    bench_blob(&bench, {11, 256, 30, 54});
+    bench_blob(&bench, {1, 256, 135, 240});
+
+    if (!opt.json_path.empty() && bench.write_json(opt.json_path) != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -7,10 +7,17 @@
 #include <vector>
 
 #include "common.hpp"
+#include "half.hpp"
 #include "syncedmem.hpp"
 
 const int kMaxBlobAxes = 32;
 
+namespace cnpy
+{
+struct NpyArray;
+class NpzReader;
+}
+
 namespace ferrari
 {
 
@@ -38,6 +45,19 @@ struct BlobShape
     void setDims(const std::vector<int64_t>& dims) { dims_ = dims; }
 };
 
+/**
+ * @brief Memory order of the axes of a 4-D Blob.
+ *
+ * shape() is always given in storage order, so an NHWC blob has shape
+ * [N, H, W, C]; the tag records which order that is, for kernels that accept
+ * either or prefer one (see convert_layout).
+ */
+enum BlobLayout
+{
+    LAYOUT_NCHW,
+    LAYOUT_NHWC
+};
+
 /**
  * @brief A wrapper around SyncedMemory holders serving as the basic
  *        computational unit through which Layer%s, Net%s, and Solver%s
@@ -49,7 +69,7 @@ template <typename Dtype>
 class Blob
 {
 public:
-    Blob() : data_(), count_(0), capacity_(0) {}
+    Blob() : data_(), count_(0), capacity_(0), layout_(LAYOUT_NCHW) {}
 
     /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
     explicit Blob(const int num, const int channels, const int height, const int width);
@@ -94,8 +114,13 @@ public:
      *        Dies on out of range index.
      */
     inline int shape(int index) const { return shape_[CanonicalAxisIndex(index)]; }
-    inline int num_axes() const { return shape_.size(); }
-    inline int count() const { return count_; }
+    inline int     num_axes() const { return shape_.size(); }
+    inline int64_t count() const { return count_; }
+
+    /// @brief Axis order of the data; LAYOUT_NCHW unless set otherwise.
+    inline BlobLayout layout() const { return layout_; }
+    /// @brief Only retags the blob; use convert_layout to move the data.
+    inline void set_layout(BlobLayout layout) { layout_ = layout; }
 
     /**
      * @brief Compute the volume of a slice; i.e., the product of dimensions
@@ -105,14 +130,14 @@ public:
      *
      * @param end_axis The first axis to exclude from the slice.
      */
-    inline int count(int start_axis, int end_axis) const
+    inline int64_t count(int start_axis, int end_axis) const
     {
         CHECK_LE(start_axis, end_axis);
         CHECK_GE(start_axis, 0);
         CHECK_GE(end_axis, 0);
         CHECK_LE(start_axis, num_axes());
         CHECK_LE(end_axis, num_axes());
-        int count = 1;
+        int64_t count = 1;
         for (int i = start_axis; i < end_axis; ++i)
         {
             count *= shape(i);
@@ -125,7 +150,7 @@ public:
      *
      * @param start_axis The first axis to include in the slice.
      */
-    inline int count(int start_axis) const { return count(start_axis, num_axes()); }
+    inline int64_t count(int start_axis) const { return count(start_axis, num_axes()); }
 
     /**
      * @brief Returns the 'canonical' version of a (usually) user-specified axis,
@@ -174,7 +199,12 @@ public:
         return shape(index);
     }
 
-    inline int offset(const int n, const int c = 0, const int h = 0, const int w = 0) const
+    /**
+     * @brief Element offset of an index. Offsets are 64-bit, so they stay
+     *        exact for blobs of more than INT_MAX elements (e.g. the
+     *        all-pairs correlation volume of a large batch).
+     */
+    inline int64_t offset(const int n, const int c = 0, const int h = 0, const int w = 0) const
     {
         CHECK_GE(n, 0);
         CHECK_LE(n, num());
@@ -184,13 +214,13 @@ public:
         CHECK_LE(h, height());
         CHECK_GE(width(), 0);
         CHECK_LE(w, width());
-        return ((n * channels() + c) * height() + h) * width() + w;
+        return ((static_cast<int64_t>(n) * channels() + c) * height() + h) * width() + w;
     }
 
-    inline int offset(const vector<int>& indices) const
+    inline int64_t offset(const vector<int>& indices) const
     {
         CHECK_LE(indices.size(), num_axes());
-        int offset = 0;
+        int64_t offset = 0;
         for (int i = 0; i < num_axes(); ++i)
         {
             offset *= shape(i);
@@ -213,10 +243,60 @@ public:
      */
     void CopyFrom(const Blob<Dtype>& source, bool reshape = false);
 
-    void LoadFromNPY(const std::string& filename);
+    /**
+     * @brief Reshapes to the array stored in an npy file and loads it.
+     *
+     * With map_file the data is not read: the file is mapped READ_ONLY (see
+     * MapFromFile) and the payload becomes the blob's host buffer, so loading
+     * costs only the page faults of what is later touched. Mapping needs the
+     * payload in C order, in this machine's byte order and on a
+     * HostAllocator::kAlignment boundary, as SaveToNPY and numpy write it;
+     * other files are read as without map_file, which converts Fortran order
+     * and byte order. Files of another numeric type are converted to Dtype as
+     * by LoadFromNPY(filename, 1, 0).
+     */
+    void LoadFromNPY(const std::string& filename, bool map_file = false);
+    /**
+     * @brief Reshapes to the array stored in an npy file and loads each
+     *        element x as Dtype(scale * x + shift), whatever its stored type
+     *        (f2, f4, f8, u1, u2, u4, u8, i1, i2, i4, i8 or bool).
+     *
+     * The file is mapped and converted in one threaded, vectorized pass, so
+     * raw uint8 frames are read and normalized together, e.g. scale 2 / 255
+     * and shift -1 for RAFT's 2 * (x / 255) - 1.
+     */
+    void LoadFromNPY(const std::string& filename, float scale, float shift);
+    /**
+     * @brief Reshapes to array and loads it, converting Fortran order and other
+     *        element types as LoadFromNPY does. Each element x becomes
+     *        Dtype(scale * x + shift). Throws std::runtime_error for element
+     *        types that are not real numbers (complex, strings, ...).
+     */
+    void CopyFromNPY(const cnpy::NpyArray& array, float scale = 1.0f, float shift = 0.0f);
 
     void SaveToNPY(const std::string& filename);
 
+    /**
+     * @brief Reshapes to member varname of an npz archive and loads it,
+     *        inflating straight into the host buffer. Members of another
+     *        element type are converted as by CopyFromNPY. One reader may
+     *        load different members into different blobs concurrently.
+     */
+    void LoadFromNPZ(const cnpy::NpzReader& reader, const std::string& varname);
+    void LoadFromNPZ(const std::string& filename, const std::string& varname);
+
+    /**
+     * @brief Reshapes to shape and backs the data with the raw elements stored
+     *        in filename at byte offset, mapped rather than read (see
+     *        SyncedMemory::MapFile). Returns 0 on success, -1 on error.
+     */
+    int MapFromFile(const std::string&    filename,
+                    size_t                offset,
+                    const vector<int>&    shape,
+                    SyncedMemory::MapMode mode = SyncedMemory::READ_ONLY);
+
+    /// @brief Checked access to one element; loops over many elements should
+    ///        take a tensor_view() once instead (see tensor_view.hpp).
     inline Dtype data_at(const int n, const int c, const int h, const int w) const
     {
         return cpu_data()[offset(n, c, h, w)];
@@ -252,8 +332,9 @@ protected:
     std::shared_ptr<SyncedMemory> data_;
     std::shared_ptr<SyncedMemory> shape_data_;
     vector<int>                   shape_;
-    int                           count_;
-    int                           capacity_;
+    int64_t                       count_;
+    int64_t                       capacity_;
+    BlobLayout                    layout_;
 
     DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
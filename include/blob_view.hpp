@@ -0,0 +1,109 @@
+#ifndef CAFFE_BLOB_VIEW_HPP_
+#define CAFFE_BLOB_VIEW_HPP_
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "blob.hpp"
+#include "common.hpp"
+#include "syncedmem.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief A strided window onto the memory of a Blob, without a copy.
+ *
+ * A view shares the SyncedMemory of the Blob it was taken from and carries an
+ * element offset into it, its own shape and a stride (in elements) per axis.
+ * Slice() narrows one axis and Select() picks one index of an axis and drops
+ * it, so a batch element, a range of channels or a spatial tile can be handed
+ * to per-pair / per-level / per-tile code as a sub-tensor. Slicing the leading
+ * axis keeps a view contiguous; slicing any other axis makes it strided, and
+ * such views are read and written element by element (data_at, CopyTo,
+ * CopyFrom) or by kernels that take the strides.
+ *
+ * The view keeps the memory alive, but not the Blob's shape: if the Blob is
+ * later reshaped into a new allocation, the view still points at the old one.
+ * cpu_data() and friends sync the whole SyncedMemory, exactly as the Blob's
+ * own accessors do.
+ */
+template <typename Dtype>
+class BlobView
+{
+public:
+    BlobView() : offset_(0), count_(0) {}
+    /// @brief View of the whole of blob, with row-major strides.
+    explicit BlobView(const Blob<Dtype>& blob);
+    BlobView(const std::shared_ptr<SyncedMemory>& data,
+             int64_t                              offset,
+             const vector<int>&                   shape,
+             const vector<int64_t>&               strides);
+
+    /// @brief Elements [begin, end) of axis, keeping the axis.
+    BlobView Slice(int axis, int begin, int end) const;
+    /// @brief Element index of axis, with the axis removed.
+    BlobView Select(int axis, int index) const;
+
+    inline const vector<int>&     shape() const { return shape_; }
+    inline const vector<int64_t>& strides() const { return strides_; }
+    inline int                    num_axes() const { return shape_.size(); }
+    inline int64_t                count() const { return count_; }
+
+    inline int     shape(int index) const { return shape_[CanonicalAxisIndex(index)]; }
+    inline int64_t stride(int index) const { return strides_[CanonicalAxisIndex(index)]; }
+
+    /// @brief Offset of the first element in the shared memory, in elements.
+    inline int64_t storage_offset() const { return offset_; }
+    /// @brief True when the elements are densely packed in row-major order.
+    bool is_contiguous() const;
+
+    inline int CanonicalAxisIndex(int axis_index) const
+    {
+        CHECK_GE(axis_index, -num_axes()) << "axis " << axis_index << " out of range";
+        CHECK_LT(axis_index, num_axes()) << "axis " << axis_index << " out of range";
+        return axis_index < 0 ? axis_index + num_axes() : axis_index;
+    }
+
+    /// @brief Offset of an index relative to the first element of the view.
+    int64_t offset(const vector<int>& indices) const;
+
+    inline Dtype data_at(const vector<int>& index) const { return cpu_data()[offset(index)]; }
+
+    inline const std::shared_ptr<SyncedMemory>& data() const
+    {
+        CHECK(data_);
+        return data_;
+    }
+
+    // Pointers to the first element of the view.
+    const Dtype* cpu_data() const;
+    const Dtype* gpu_data() const;
+    Dtype*       mutable_cpu_data() const;
+    Dtype*       mutable_gpu_data() const;
+
+    /**
+     * @brief Copies the viewed elements into dst, reshaped to shape(), in
+     *        row-major order. Contiguous views are copied with caffe_copy in
+     *        the current Caffe mode; strided views are gathered on the host.
+     */
+    void CopyTo(Blob<Dtype>* dst) const;
+    /**
+     * @brief Writes the count() elements of src, in row-major order, into the
+     *        viewed elements. Same mode rules as CopyTo.
+     */
+    void CopyFrom(const Blob<Dtype>& src) const;
+
+private:
+    std::shared_ptr<SyncedMemory> data_;
+    vector<int>                   shape_;
+    vector<int64_t>               strides_;
+    int64_t                       offset_;
+    int64_t                       count_;
+};  // class BlobView
+
+}  // namespace ferrari
+
+#endif  // CAFFE_BLOB_VIEW_HPP_
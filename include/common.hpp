@@ -7,6 +7,7 @@
 #include <iostream>  // NOLINT(readability/streams)
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -50,6 +51,8 @@ using std::string;
 using std::stringstream;
 using std::vector;
 
+class ThreadPool;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe
@@ -65,8 +68,10 @@ public:
         GPU
     };
 
+#ifndef CPU_ONLY
     inline static cublasHandle_t cublas_handle() { return Get().cublas_handle_; }
     inline static cudnnHandle_t  cudnn_handle() { return Get().cudnn_handle_; }
+#endif
 
     // Returns the mode: running on CPU or GPU.
     inline static Brew mode() { return Get().mode_; }
@@ -89,12 +94,32 @@ public:
     // return the ordinal of the first available device.
     static int FindDevice(const int start_id = 0);
 
+    // Returns the host thread pool shared by the CPU kernels. It is created on
+    // first use with num_threads() threads.
+    static ThreadPool& thread_pool();
+    // Number of host threads the pool runs with, the calling thread included.
+    static int num_threads();
+    // Sets the number of host threads; 0 uses every core the process may run
+    // on. Like set_mode, call it before any CPU kernel runs: the current pool
+    // is torn down and rebuilt on next use.
+    static void set_num_threads(const int num_threads);
+    // Binds each pool worker to its own core (Linux only). Also rebuilds the
+    // pool on next use.
+    static void set_thread_affinity(const bool pin_threads);
+
 protected:
+#ifndef CPU_ONLY
     cublasHandle_t cublas_handle_;
     cudnnHandle_t  cudnn_handle_;
+#endif
 
     Brew mode_;
 
+    std::shared_ptr<ThreadPool> thread_pool_;
+    std::mutex                  thread_pool_mutex_;
+    int                         num_threads_;
+    bool                        pin_threads_;
+
 private:
     // The private constructor to avoid duplicate instantiation.
     Caffe();
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "blob.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief Host implementation of grid_sample.
+ *
+ * Same semantics as the CUDA kernel: bilinear interpolation with
+ * align_corners=True and zero padding. input is [N, C, H_in, W_in], grid is
+ * [N, H_out, W_out, 2] holding normalized (x, y) in [-1, 1], and output is
+ * [N, C, H_out, W_out]. Rows of N x H_out are spread over the host threads.
+ */
+int grid_sample_cpu(const std::shared_ptr<Blob<float>>& input,
+                    const std::shared_ptr<Blob<float>>& grid,
+                    std::shared_ptr<Blob<float>>&       output);
+
+/**
+ * @brief Fills levels 1.. of a correlation pyramid from level 0.
+ *
+ * Every level is a 2x2 average pool (stride 2, no padding) of the previous
+ * one, as in the cuDNN builder; level i is [N, 1, H_i, W_i]. Each query plane
+ * is pooled through all levels before moving on, so level 0 is streamed once
+ * and the coarser levels are computed from planes that are still in cache.
+ * Query planes are spread over the host threads. Dtype is float, float16 or
+ * bfloat16; 16-bit pyramids are pooled in float and rounded once per level.
+ */
+template <typename Dtype>
+int build_corr_pyramid_cpu(const std::vector<std::shared_ptr<Blob<Dtype>>>& pyramid);
+
+/**
+ * @brief Fused multi-level correlation lookup on the host.
+ *
+ * coords is [batch, 2, ht, wd] holding the (x, y) pixel position of every
+ * query, and pyramid[i] is [batch * ht * wd, 1, H_i, W_i]. For level i the
+ * (2r+1)^2 window centred on coords / 2^i is sampled bilinearly with zero
+ * padding and written straight to output, which is
+ * [batch, levels * (2r+1)^2, ht, wd]. Window channel a * (2r+1) + b holds the
+ * offset (b - r, a - r), the same order that create_delta + broadcast_add +
+ * grid_sample produce, but no normalized grid is ever stored. Rows of
+ * batch x ht are spread over the host threads. A float16 / bfloat16 pyramid
+ * is widened patch by patch and blended in float.
+ */
+template <typename Dtype>
+int corr_lookup_cpu(const std::vector<std::shared_ptr<Blob<Dtype>>>& pyramid,
+                    const float*                                     coords,
+                    int                                              batch,
+                    int                                              ht,
+                    int                                              wd,
+                    int                                              radius,
+                    float*                                           output);
+
+/**
+ * @brief Builds the pooled feature pyramid used by the on-demand lookup.
+ *
+ * fmap is [B, D, H, W], or [B, H, W, D] when tagged LAYOUT_NHWC. pyramid[0]
+ * receives it in NHWC order, [B, H, W, D], so every pixel's feature vector is
+ * contiguous (transpose_cpu for an NCHW fmap, a copy otherwise), and
+ * pyramid[i] is the 2x2 average pool of pyramid[i - 1], [B, H_i, W_i, D].
+ * Every level is tagged LAYOUT_NHWC.
+ */
+int build_feature_pyramid_cpu(const std::shared_ptr<Blob<float>>&              fmap,
+                              const std::vector<std::shared_ptr<Blob<float>>>& pyramid);
+
+/**
+ * @brief Correlation lookup that never materializes the all-pairs volume.
+ *
+ * fmap1 is [batch, ht, wd, D] and fmap2_pyramid[i] is [batch, H_i, W_i, D],
+ * both as produced by build_feature_pyramid_cpu. Correlation is linear in
+ * fmap2, so pooling fmap2 gives the same levels as pooling the volume: each
+ * window tap is a dot product over D scaled by 1/sqrt(D), computed only for
+ * the pixels under the window. coords and output are laid out as in
+ * corr_lookup_cpu and the result matches it up to rounding.
+ */
+int corr_lookup_on_demand_cpu(const std::shared_ptr<Blob<float>>&              fmap1,
+                              const std::vector<std::shared_ptr<Blob<float>>>& fmap2_pyramid,
+                              const float*                                     coords,
+                              int                                              radius,
+                              float*                                           output);
+
+/**
+ * @brief Batched transpose on the host: dst[b] (cols x rows) = src[b]^T for
+ *        every src[b] (rows x cols), both densely packed row-major.
+ *
+ * Planes are walked in 64 x 64 cache blocks; inside a block float data moves
+ * through 16 x 16 (AVX-512) or 8 x 8 (AVX2) register transposes and the
+ * remaining edges element by element. Strips of 64 source rows are spread
+ * over the host threads. src and dst must not overlap.
+ */
+template <typename Dtype>
+void transpose_cpu(int64_t batch, int rows, int cols, const Dtype* src, Dtype* dst);
+
+/**
+ * @brief Host implementation of convert_layout: writes src into dst in the
+ *        given layout (NCHW <-> NHWC, i.e. a per-batch [C, H*W] transpose),
+ *        reshaping and tagging dst. A src already in that layout is copied.
+ */
+template <typename Dtype>
+int convert_layout_cpu(const Blob<Dtype>& src, BlobLayout layout, Blob<Dtype>* dst);
+
+}  // namespace ferrari
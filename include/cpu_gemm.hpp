@@ -0,0 +1,59 @@
+#ifndef CAFFE_CPU_GEMM_HPP_
+#define CAFFE_CPU_GEMM_HPP_
+
+#include "half.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief Single-precision C = alpha * op(A) * op(B) + beta * C on the host.
+ *
+ * All matrices are row-major and densely packed: op(A) is M x K, op(B) is
+ * K x N and C is M x N. When trans_a is set A is stored as K x M, when trans_b
+ * is set B is stored as N x K. Panels of A and B are packed into contiguous
+ * MR / NR strips, a register-blocked FMA microkernel computes each MR x NR
+ * block of C and alpha is applied when the block is stored. Output tiles are
+ * spread over the host threads. With beta == 0 C is never read.
+ */
+void caffe_cpu_sgemm(const bool   trans_a,
+                     const bool   trans_b,
+                     const int    M,
+                     const int    N,
+                     const int    K,
+                     const float  alpha,
+                     const float* A,
+                     const float* B,
+                     const float  beta,
+                     float*       C);
+
+/**
+ * @brief Same product with C stored in a 16-bit type. Each output tile is
+ *        accumulated in float across the whole K extent and converted once
+ *        when it is written back, so only the final result is rounded.
+ */
+void caffe_cpu_sgemm(const bool   trans_a,
+                     const bool   trans_b,
+                     const int    M,
+                     const int    N,
+                     const int    K,
+                     const float  alpha,
+                     const float* A,
+                     const float* B,
+                     const float  beta,
+                     float16*     C);
+
+void caffe_cpu_sgemm(const bool   trans_a,
+                     const bool   trans_b,
+                     const int    M,
+                     const int    N,
+                     const int    K,
+                     const float  alpha,
+                     const float* A,
+                     const float* B,
+                     const float  beta,
+                     bfloat16*    C);
+
+}  // namespace ferrari
+
+#endif  // CAFFE_CPU_GEMM_HPP_
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "half.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief Error of the int8 correlation against the fp32 one, over a set of
+ *        sampled query pixels (every target pixel of each sampled row).
+ */
+struct CorrQuantReport
+{
+    int64_t samples;       // number of compared correlation values
+    float   max_abs_err;   // max |int8 - fp32|
+    float   mean_abs_err;  // mean |int8 - fp32|
+    float   rms_err;       // sqrt(mean (int8 - fp32)^2)
+    float   ref_rms;       // sqrt(mean fp32^2), the scale the errors compare to
+};
+
+/**
+ * @brief All-pairs correlation of one batch element with int8 arithmetic.
+ *
+ * fmap1 and fmap2 are [dim, hw] (one batch element of a [B, D, H, W] map) and
+ * corr is hw x hw row-major with corr[i][j] ~= alpha * <fmap1[:, i], fmap2[:, j]>,
+ * the same volume caffe_cpu_sgemm(true, false, ...) produces. Every pixel's
+ * feature vector is quantized to int8 with its own symmetric scale
+ * (max |f| / 127). The dot products run on AVX-512 VNNI / AVX-VNNI dpbusd
+ * when available (fmap1 is offset to uint8 and the offset is removed with a
+ * per-column correction), with a scalar fallback. The int32 sums are
+ * dequantized by alpha * scale1[i] * scale2[j] when they are stored, and
+ * converted to Dtype (float, float16 or bfloat16) on the way out.
+ */
+template <typename Dtype>
+int corr_volume_int8_cpu(const float* fmap1,
+                         const float* fmap2,
+                         int          dim,
+                         int          hw,
+                         float        alpha,
+                         Dtype*       corr);
+
+/**
+ * @brief Measures corr_volume_int8_cpu against the fp32 volume.
+ *
+ * fmap1 / fmap2 are [batch, dim, hw]. For every batch element num_samples
+ * evenly spaced query rows are recomputed in fp32 and with the same int8
+ * quantization, without materializing the volume. Returns 0 on success.
+ */
+int corr_int8_error_report(const float*     fmap1,
+                           const float*     fmap2,
+                           int              batch,
+                           int              dim,
+                           int              hw,
+                           float            alpha,
+                           int              num_samples,
+                           CorrQuantReport* report);
+
+}  // namespace ferrari
@@ -1,6 +1,8 @@
 #pragma once
 
+#ifndef CPU_ONLY
 #include <cuda_runtime.h>
+#endif
 
 #include "blob.hpp"
 
@@ -15,6 +17,7 @@ void create_delta(std::shared_ptr<Blob<float>>& delta, int r);
 
 void create_coords_grid(std::shared_ptr<Blob<float>>& coords);
 
+#ifndef CPU_ONLY
 __global__ void compute_grid(const float* coords,
                              int          len,
                              const float* delta,
@@ -23,6 +26,7 @@ __global__ void compute_grid(const float* coords,
                              int          W,
                              int          H,
                              float*       output);
+#endif
 
 void broadcast_add(const std::shared_ptr<Blob<float>>& coords,
                    const std::shared_ptr<Blob<float>>& delta,
@@ -31,7 +35,11 @@ void broadcast_add(const std::shared_ptr<Blob<float>>& coords,
                    int                                 H,
                    std::shared_ptr<Blob<float>>&       output);
 
-void convert_row2colomn_major(const std::shared_ptr<Blob<float>>& input,
-                              std::shared_ptr<Blob<float>>&       output);
+// Writes input into output in the given layout (NCHW <-> NHWC); output is
+// reshaped and tagged. Runs on the device in GPU mode (tiled shared-memory
+// transpose, asynchronous on the default stream) and on the host otherwise.
+int convert_layout(const std::shared_ptr<Blob<float>>& input,
+                   BlobLayout                          layout,
+                   std::shared_ptr<Blob<float>>&       output);
 
 }  // namespace ferrari
\ No newline at end of file
@@ -1,6 +1,15 @@
 #ifndef CAFFE_UTIL_DEVICE_ALTERNATE_H_
 #define CAFFE_UTIL_DEVICE_ALTERNATE_H_
 
+#ifdef CPU_ONLY  // CPU-only Caffe.
+
+#include "simple_log.hpp"
+
+// Stub out GPU calls as unavailable.
+#define NO_GPU LOG(FATAL) << "Cannot use GPU in CPU-only Caffe: check mode."
+
+#else  // Normal GPU + CPU Caffe.
+
 #include <cublas_v2.h>
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -56,4 +65,6 @@ inline int CAFFE_GET_BLOCKS(const int N)
 
 }  // namespace ferrari
 
+#endif  // CPU_ONLY
+
 #endif  // CAFFE_UTIL_DEVICE_ALTERNATE_H_
\ No newline at end of file
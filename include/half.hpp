@@ -0,0 +1,166 @@
+#ifndef CAFFE_HALF_HPP_
+#define CAFFE_HALF_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace ferrari
+{
+
+// Bit-level conversions with round-to-nearest-even. The software fp16 paths
+// follow F. Giesen's branch-light float <-> half routines.
+inline uint16_t float_to_half_bits(float f)
+{
+#if defined(__F16C__)
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint16_t h;
+    if (x >= 0x47800000u)  // >= 65536: Inf, or NaN kept quiet
+    {
+        h = (x > 0x7f800000u) ? 0x7e00 : 0x7c00;
+    }
+    else if (x < 0x38800000u)  // below 2^-14: subnormal half or zero
+    {
+        float v;
+        memcpy(&v, &x, sizeof(v));
+        v += 0.5f;  // shifts the subnormal mantissa into the low bits
+        memcpy(&x, &v, sizeof(x));
+        h = static_cast<uint16_t>(x - 0x3f000000u);
+    }
+    else
+    {
+        const uint32_t mant_odd = (x >> 13) & 1;
+        x += 0xc8000fffu + mant_odd;  // rebias exponent by -112 and round
+        h = static_cast<uint16_t>(x >> 13);
+    }
+    return h | static_cast<uint16_t>(sign >> 16);
+#endif
+}
+
+inline float half_bits_to_float(uint16_t h)
+{
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    const uint32_t shifted_exp = 0x7c00u << 13;
+
+    uint32_t x   = (h & 0x7fffu) << 13;
+    uint32_t exp = x & shifted_exp;
+    x += (127 - 15) << 23;
+    if (exp == shifted_exp)  // Inf / NaN
+    {
+        x += (128 - 16) << 23;
+    }
+    else if (exp == 0)  // zero / subnormal: renormalize in float
+    {
+        x += 1 << 23;
+        float v, magic;
+        uint32_t magic_bits = 113u << 23;
+        memcpy(&v, &x, sizeof(v));
+        memcpy(&magic, &magic_bits, sizeof(magic));
+        v -= magic;
+        memcpy(&x, &v, sizeof(x));
+    }
+    x |= static_cast<uint32_t>(h & 0x8000u) << 16;
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+#endif
+}
+
+inline uint16_t float_to_bfloat16_bits(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffffu) > 0x7f800000u)  // NaN: truncate and keep it quiet
+    {
+        return static_cast<uint16_t>((x >> 16) | 0x40);
+    }
+    x += 0x7fffu + ((x >> 16) & 1);
+    return static_cast<uint16_t>(x >> 16);
+}
+
+inline float bfloat16_bits_to_float(uint16_t h)
+{
+    uint32_t x = static_cast<uint32_t>(h) << 16;
+    float    f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief IEEE 754 binary16 storage type. Arithmetic is done in float; the
+ *        type only converts on the way in and out.
+ */
+struct float16
+{
+    uint16_t bits;
+
+    float16() = default;
+    explicit float16(float f) : bits(float_to_half_bits(f)) {}
+    operator float() const { return half_bits_to_float(bits); }
+};
+
+/**
+ * @brief bfloat16 storage type: the upper half of an IEEE float, so it keeps
+ *        the float exponent range with an 8-bit mantissa.
+ */
+struct bfloat16
+{
+    uint16_t bits;
+
+    bfloat16() = default;
+    explicit bfloat16(float f) : bits(float_to_bfloat16_bits(f)) {}
+    operator float() const { return bfloat16_bits_to_float(bits); }
+};
+
+// Bulk conversions between float and the 16-bit storage types, vectorized
+// with F16C / AVX-512F for fp16 and AVX-512-BF16 / AVX2 for bf16. Large
+// arrays are split across the host thread pool.
+void caffe_cpu_convert(const int64_t N, const float* X, float16* Y);
+void caffe_cpu_convert(const int64_t N, const float16* X, float* Y);
+void caffe_cpu_convert(const int64_t N, const float* X, bfloat16* Y);
+void caffe_cpu_convert(const int64_t N, const bfloat16* X, float* Y);
+
+inline void caffe_cpu_convert(const int64_t N, const float* X, float* Y)
+{
+    if (X != Y)
+    {
+        memcpy(Y, X, sizeof(float) * N);  // NOLINT(caffe/alt_fn)
+    }
+}
+
+// Y = alpha * X + beta, computed in float after widening X, for decoding stored
+// arrays in one pass: e.g. uint8 pixels to [-1, 1] with alpha = 2 / 255 and
+// beta = -1. With alpha 1 and beta 0 the elements are only converted.
+// Vectorized with AVX2 (F16C for fp16) and split across the host thread pool.
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const float* X, const float beta, float* Y);
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const double* X, const float beta, float* Y);
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const float16* X, const float beta, float* Y);
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const uint8_t* X, const float beta, float* Y);
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const uint16_t* X, const float beta, float* Y);
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const int8_t* X, const float beta, float* Y);
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const int16_t* X, const float beta, float* Y);
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const int32_t* X, const float beta, float* Y);
+
+}  // namespace ferrari
+
+#endif  // CAFFE_HALF_HPP_
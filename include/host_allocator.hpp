@@ -0,0 +1,126 @@
+#ifndef CAFFE_HOST_ALLOCATOR_HPP_
+#define CAFFE_HOST_ALLOCATOR_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+
+namespace ferrari
+{
+
+struct HostAllocatorStats
+{
+    uint64_t allocations;        // Allocate() calls
+    uint64_t cache_hits;         // ... served from a cache without a system call
+    uint64_t system_allocs;      // malloc / cudaMallocHost calls
+    uint64_t system_frees;       // free / munmap / cudaFreeHost calls
+    uint64_t huge_page_allocs;   // system allocations backed by 2 MB pages
+    size_t   bytes_in_use;       // size-class bytes currently handed out
+    size_t   peak_bytes_in_use;  // high-water mark of bytes_in_use
+    size_t   bytes_cached;       // size-class bytes held in the caches
+};
+
+/**
+ * @brief Caching allocator behind CaffeMallocHost / CaffeFreeHost.
+ *
+ * Requests are rounded up to a power-of-two size class. Freed blocks are kept
+ * on a free list per class (pageable and pinned memory separately) and handed
+ * out again, so a loop that allocates the same blob sizes every frame stops
+ * calling malloc / cudaMallocHost, and stops page faulting, after its first
+ * iteration. Only the requested bytes are ever touched, so the rounding costs
+ * address space rather than resident memory (except for pinned blocks, which
+ * are resident as a whole).
+ *
+ * Blocks up to kThreadCacheMaxSize go through a small per-thread cache that
+ * needs no locking; larger blocks, and small ones that overflow it, use the
+ * shared free lists under a mutex. Blocks above kMaxCachedSize bypass the
+ * cache. Nothing is returned to the system until Trim() or process exit.
+ *
+ * Pageable memory is always kAlignment (64) byte aligned for AVX-512 loads.
+ * System allocations of at least huge_page_threshold() bytes are mapped
+ * directly and backed by 2 MB pages on Linux: MAP_HUGETLB pages when the
+ * hugetlbfs pool has room, otherwise a 2 MB aligned mapping marked
+ * MADV_HUGEPAGE for transparent huge pages. Either step may fail (no pool,
+ * THP disabled, not Linux) and the allocation then falls back to the next
+ * one, down to posix_memalign.
+ */
+class HostAllocator
+{
+public:
+    static HostAllocator& Get();
+
+    // Returns at least size bytes; pinned memory comes from cudaMallocHost.
+    void* Allocate(size_t size, bool pinned);
+    // size and pinned must match the Allocate call that returned ptr.
+    void Free(void* ptr, size_t size, bool pinned);
+
+    // Releases every cached block of the shared lists and of the calling
+    // thread's cache to the system. Other threads' caches (small blocks
+    // only) are released when those threads exit.
+    void Trim();
+
+    HostAllocatorStats stats() const;
+
+    // Allocations of at least this many bytes use 2 MB pages; 0 disables
+    // huge pages. Values below kHugePageSize are raised to it.
+    void   set_huge_page_threshold(size_t bytes);
+    size_t huge_page_threshold() const { return huge_page_threshold_.load(); }
+
+    // Size class a request of size bytes is served from.
+    static size_t ClassSize(size_t size);
+
+    static const int    kMinClass                 = 6;  // 64 bytes
+    static const int    kMaxCachedClass           = 31;
+    static const size_t kMaxCachedSize            = size_t(1) << kMaxCachedClass;
+    static const int    kThreadCacheMaxClass      = 20;
+    static const size_t kThreadCacheMaxSize       = size_t(1) << kThreadCacheMaxClass;
+    static const int    kThreadCacheDepth         = 8;  // blocks per class and thread
+    static const size_t kAlignment                = 64;
+    static const size_t kHugePageSize             = size_t(2) << 20;
+    static const size_t kDefaultHugePageThreshold = size_t(4) << 20;
+
+private:
+    HostAllocator() : huge_page_threshold_(kDefaultHugePageThreshold) {}
+
+    struct ThreadCache;
+    // The calling thread's cache, or NULL once it has been destroyed at exit.
+    static ThreadCache* thread_cache();
+
+    // Class index of size, or -1 above kMaxCachedSize.
+    static int ClassIndex(size_t size);
+
+    void* SystemAlloc(size_t size, bool pinned);
+    void  SystemFree(void* ptr, size_t size, bool pinned);
+    // mmap with 2 MB pages, or NULL when no mapping could be made.
+    void* MapHugePages(size_t size);
+
+    // Shared free lists, [pinned][class].
+    std::mutex         mutex_;
+    std::vector<void*> free_[2][kMaxCachedClass + 1];
+
+    std::atomic<uint64_t> allocations_{0};
+    std::atomic<uint64_t> cache_hits_{0};
+    std::atomic<uint64_t> system_allocs_{0};
+    std::atomic<uint64_t> system_frees_{0};
+    std::atomic<uint64_t> huge_page_allocs_{0};
+    std::atomic<size_t>   bytes_in_use_{0};
+    std::atomic<size_t>   peak_bytes_in_use_{0};
+    std::atomic<size_t>   bytes_cached_{0};
+    std::atomic<size_t>   huge_page_threshold_;
+
+    // Mapped length of every block that came from MapHugePages.
+    std::mutex                        mapped_mutex_;
+    std::unordered_map<void*, size_t> mapped_;
+
+    DISABLE_COPY_AND_ASSIGN(HostAllocator);
+};
+
+}  // namespace ferrari
+
+#endif  // CAFFE_HOST_ALLOCATOR_HPP_
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include <cmath>  // for std::fabs and std::signbit
+#include <cstring>
 
 #include "common.hpp"
 #include "device_alternate.hpp"
@@ -12,10 +13,10 @@
 namespace ferrari
 {
 template <typename Dtype>
-void caffe_copy(const int N, const Dtype* X, Dtype* Y);
+void caffe_copy(const int64_t N, const Dtype* X, Dtype* Y);
 
 template <typename Dtype>
-void caffe_set(const int N, const Dtype alpha, Dtype* X);
+void caffe_set(const int64_t N, const Dtype alpha, Dtype* X);
 
 inline void caffe_memset(const size_t N, const int alpha, void* X)
 {
@@ -24,10 +25,14 @@ inline void caffe_memset(const size_t N, const int alpha, void* X)
 
 inline void caffe_gpu_memcpy(const size_t N, const void* X, void* Y)
 {
+#ifndef CPU_ONLY
     if (X != Y)
     {
         CUDA_CHECK(cudaMemcpy(Y, X, N, cudaMemcpyDefault));  // NOLINT(caffe/alt_fn)
     }
+#else
+    NO_GPU;
+#endif
 }
 inline void caffe_gpu_memset(const size_t N, const int alpha, void* X)
 {
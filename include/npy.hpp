@@ -11,6 +11,7 @@
 
 #include <cassert>
 #include <cstdio>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -24,10 +25,23 @@
 namespace cnpy
 {
 
+// What an npy header says about the array that follows it.
+struct NpyHeader
+{
+    char                byte_order;   // '<', '>' or '|' (single bytes, structured arrays)
+    char                type;         // numpy kind: 'f', 'i', 'u', 'b', 'c', 'V', 'S', 'U', ...
+    size_t              word_size;    // bytes per element
+    std::vector<size_t> shape;
+    bool                fortran_order;
+    size_t              data_offset;  // size of the preamble and header, i.e. where data starts
+
+    size_t num_vals() const;
+};
+
 struct NpyArray
 {
     NpyArray(const std::vector<size_t>& _shape, size_t _word_size, bool _fortran_order)
-        : shape(_shape), word_size(_word_size), fortran_order(_fortran_order)
+        : shape(_shape), word_size(_word_size), type('?'), fortran_order(_fortran_order)
     {
         num_vals = 1;
         for (size_t i = 0; i < shape.size(); i++)
@@ -36,18 +50,18 @@ struct NpyArray
             std::shared_ptr<std::vector<char>>(new std::vector<char>(num_vals * word_size));
     }
 
-    NpyArray() : shape(0), word_size(0), fortran_order(0), num_vals(0) {}
+    NpyArray() : shape(0), word_size(0), type('?'), fortran_order(0), num_vals(0) {}
 
     template <typename T>
     T* data()
     {
-        return reinterpret_cast<T*>(&(*data_holder)[0]);
+        return reinterpret_cast<T*>(bytes());
     }
 
     template <typename T>
     const T* data() const
     {
-        return reinterpret_cast<T*>(&(*data_holder)[0]);
+        return reinterpret_cast<T*>(bytes());
     }
 
     template <typename T>
@@ -57,11 +71,16 @@ struct NpyArray
         return std::vector<T>(p, p + num_vals);
     }
 
-    size_t num_bytes() const { return data_holder->size(); }
+    size_t num_bytes() const { return mapped_data ? num_vals * word_size : data_holder->size(); }
+    char*  bytes() const { return mapped_data ? mapped_data.get() : &(*data_holder)[0]; }
 
     std::shared_ptr<std::vector<char>> data_holder;
+    // Set instead of data_holder by npy_mmap: the payload inside a private
+    // (copy-on-write) mapping of the file, unmapped with the last copy.
+    std::shared_ptr<char> mapped_data;
     std::vector<size_t>                shape;
     size_t                             word_size;
+    char                               type;  // numpy kind, as in NpyHeader
     bool                               fortran_order;
     size_t                             num_vals;
 };
@@ -72,18 +91,134 @@ char BigEndianTest();
 char map_type(const std::type_info& t);
 template <typename T>
 std::vector<char> create_npy_header(const std::vector<size_t>& shape);
+// Version 1.0 header for elements of numpy kind type and word_size bytes. The header is padded
+// with spaces to a multiple of 64 bytes, and to at least size bytes, so that a header written
+// before the final shape is known can later be rewritten in place.
+std::vector<char> create_npy_header(char                       type,
+                                    size_t                     word_size,
+                                    const std::vector<size_t>& shape,
+                                    size_t                     size = 0);
+// Parse the preamble and header of format versions 1.0, 2.0 and 3.0 in one pass, without
+// allocating beyond the shape. Throws std::runtime_error on malformed headers.
+NpyHeader parse_npy_header(const unsigned char* buffer, size_t size);
+// Reads the header from fp and leaves fp at the start of the data.
+NpyHeader parse_npy_header(FILE* fp);
 void parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& shape, bool& fortran_order);
-void parse_npy_header(unsigned char*       buffer,
-                      size_t&              word_size,
-                      std::vector<size_t>& shape,
-                      bool&                fortran_order);
+// True when the elements are stored in the opposite byte order of this machine.
+bool needs_byteswap(const NpyHeader& header);
+// Reverses the bytes of each of num_vals elements described by header in place.
+void byteswap(char* data, size_t num_vals, const NpyHeader& header);
 void parse_zip_footer(FILE*     fp,
                       uint16_t& nrecs,
                       size_t&   global_header_size,
                       size_t&   global_header_offset);
+// Both go through NpzReader: all members are decompressed in parallel, a single one is found
+// through the central directory.
 npz_t    npz_load(std::string fname);
 NpyArray npz_load(std::string fname, std::string varname);
 NpyArray npy_load(std::string fname);
+// Like npy_load, but maps the file instead of reading it; pages are faulted
+// in on first access.
+NpyArray npy_mmap(std::string fname);
+// Reads only the header of an npy file and returns the byte offset of the data.
+size_t    npy_load_header(std::string          fname,
+                          size_t&              word_size,
+                          std::vector<size_t>& shape,
+                          bool&                fortran_order);
+NpyHeader npy_load_header(std::string fname);
+
+// One member of an npz archive, as listed in the ZIP central directory.
+struct NpzEntry
+{
+    std::string name;         // without the .npy suffix
+    uint16_t    compression;  // 0 stored, 8 deflate
+    uint32_t    crc;
+    uint64_t    compressed_size;
+    uint64_t    uncompressed_size;
+    uint64_t    header_offset;  // of the local file header
+};
+
+// Random access to the members of an npz archive. The central directory (including ZIP64
+// records) is read once on construction, so a member is found without scanning the archive.
+// Members are read with pread from their own offsets, so one reader can be shared by threads
+// loading different members. Deflated members are inflated in chunks straight into their
+// destination, without buffering the whole member.
+class NpzReader
+{
+public:
+    explicit NpzReader(const std::string& fname);
+    ~NpzReader();
+
+    const std::vector<NpzEntry>& entries() const { return entries_; }
+    // NULL when the archive has no member varname
+    const NpzEntry* find(const std::string& varname) const;
+
+    // Reads the npy header of member varname, then its data into destination(header), which
+    // must provide header.num_vals() * header.word_size bytes. The data is converted to this
+    // machine's byte order; Fortran order is left to the caller.
+    NpyHeader read(const std::string&                             varname,
+                   const std::function<char*(const NpyHeader&)>& destination) const;
+    NpyArray  load(const std::string& varname) const;
+    // Every member, decompressed in parallel on the host thread pool.
+    npz_t load_all() const;
+
+private:
+    void read_central_directory();
+
+    std::string                   fname_;
+    int                           fd_;
+    std::vector<NpzEntry>         entries_;
+    std::map<std::string, size_t> index_;
+
+    NpzReader(const NpzReader&)            = delete;
+    NpzReader& operator=(const NpzReader&) = delete;
+};
+
+// Writes the arrays of an npz archive one after another and the central directory once, on
+// close(). Mode "a" keeps the members of an existing archive: new ones overwrite its old
+// directory. Members are streamed through zlib in chunks when level is not 0, and get ZIP64
+// records when they, their offset or the directory outgrow 32 bits (or there are 65535 or
+// more of them), so archives and arrays may exceed 4 GB.
+class NpzWriter
+{
+public:
+    NpzWriter(const std::string& fname, const std::string& mode = "w", int level = 0);
+    // Closes the archive if close() was not called; errors are logged, not thrown.
+    ~NpzWriter();
+
+    template <typename T>
+    void add(const std::string& name, const T* data, const std::vector<size_t>& shape)
+    {
+        const size_t nels =
+            std::accumulate(shape.begin(), shape.end(), (size_t)1, std::multiplies<size_t>());
+        add(name, create_npy_header<T>(shape), data, nels * sizeof(T));
+    }
+    // Adds name.npy made of an npy header and nbytes of data.
+    void add(const std::string&       name,
+             const std::vector<char>& npy_header,
+             const void*              data,
+             size_t                   nbytes);
+    // Writes the central directory and closes the file.
+    void close();
+
+private:
+    void write(const void* data, size_t nbytes);
+    // Feeds data to z and writes whatever compressed output is ready.
+    void deflate_chunk(z_stream* z, const void* data, size_t nbytes, bool finish);
+    // Overwrites bytes already written at offset, then returns to the end.
+    void patch(uint64_t offset, const std::vector<char>& bytes);
+
+    std::string       fname_;
+    FILE*             fp_;
+    int               level_;
+    uint64_t          offset_;  // where the next member starts
+    uint64_t          nrecs_;
+    std::vector<char> directory_;
+    std::vector<char> out_;  // deflate output buffer
+
+    NpzWriter(const NpzWriter&)            = delete;
+    NpzWriter& operator=(const NpzWriter&) = delete;
+};
 
 template <typename T>
 std::vector<char>& operator+=(std::vector<char>& lhs, const T rhs)
@@ -162,108 +297,20 @@ void npy_save(std::string               fname,
     fclose(fp);
 }
 
+// Adds one array to zipname, a new archive with mode "w" or an existing one with mode "a".
+// level 0 stores the array; 1 to 9 (or Z_DEFAULT_COMPRESSION) deflate it. To write many
+// arrays, use one NpzWriter rather than a call per array.
 template <typename T>
 void npz_save(std::string                zipname,
               std::string                fname,
               const T*                   data,
               const std::vector<size_t>& shape,
-              std::string                mode = "w")
+              std::string                mode  = "w",
+              int                        level = 0)
 {
-    // first, append a .npy to the fname
-    fname += ".npy";
-
-    // now, on with the show
-    FILE*             fp                   = NULL;
-    uint16_t          nrecs                = 0;
-    size_t            global_header_offset = 0;
-    std::vector<char> global_header;
-
-    if (mode == "a")
-        fp = fopen(zipname.c_str(), "r+b");
-
-    if (fp)
-    {
-        // zip file exists. we need to add a new npy file to it.
-        // first read the footer. this gives us the offset and size of the global header
-        // then read and store the global header.
-        // below, we will write the the new data at the start of the global header then append the
-        // global header and footer below it
-        size_t global_header_size;
-        parse_zip_footer(fp, nrecs, global_header_size, global_header_offset);
-        fseek(fp, global_header_offset, SEEK_SET);
-        global_header.resize(global_header_size);
-        size_t res = fread(&global_header[0], sizeof(char), global_header_size, fp);
-        if (res != global_header_size)
-        {
-            throw std::runtime_error("npz_save: header read error while adding to existing zip");
-        }
-        fseek(fp, global_header_offset, SEEK_SET);
-    }
-    else
-    {
-        fp = fopen(zipname.c_str(), "wb");
-    }
-
-    std::vector<char> npy_header = create_npy_header<T>(shape);
-
-    size_t nels   = std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<size_t>());
-    size_t nbytes = nels * sizeof(T) + npy_header.size();
-
-    // get the CRC of the data to be added
-    uint32_t crc = crc32(0L, (uint8_t*)&npy_header[0], npy_header.size());
-    crc          = crc32(crc, (uint8_t*)data, nels * sizeof(T));
-
-    // build the local header
-    std::vector<char> local_header;
-    local_header += "PK";                    // first part of sig
-    local_header += (uint16_t)0x0403;        // second part of sig
-    local_header += (uint16_t)20;            // min version to extract
-    local_header += (uint16_t)0;             // general purpose bit flag
-    local_header += (uint16_t)0;             // compression method
-    local_header += (uint16_t)0;             // file last mod time
-    local_header += (uint16_t)0;             // file last mod date
-    local_header += (uint32_t)crc;           // crc
-    local_header += (uint32_t)nbytes;        // compressed size
-    local_header += (uint32_t)nbytes;        // uncompressed size
-    local_header += (uint16_t)fname.size();  // fname length
-    local_header += (uint16_t)0;             // extra field length
-    local_header += fname;
-
-    // build global header
-    global_header += "PK";              // first part of sig
-    global_header += (uint16_t)0x0201;  // second part of sig
-    global_header += (uint16_t)20;      // version made by
-    global_header.insert(global_header.end(), local_header.begin() + 4, local_header.begin() + 30);
-    global_header += (uint16_t)0;  // file comment length
-    global_header += (uint16_t)0;  // disk number where file starts
-    global_header += (uint16_t)0;  // internal file attributes
-    global_header += (uint32_t)0;  // external file attributes
-    global_header +=
-        (uint32_t)global_header_offset;  // relative offset of local file header, since it begins
-                                         // where the global header used to begin
-    global_header += fname;
-
-    // build footer
-    std::vector<char> footer;
-    footer += "PK";                            // first part of sig
-    footer += (uint16_t)0x0605;                // second part of sig
-    footer += (uint16_t)0;                     // number of this disk
-    footer += (uint16_t)0;                     // disk where footer starts
-    footer += (uint16_t)(nrecs + 1);           // number of records on this disk
-    footer += (uint16_t)(nrecs + 1);           // total number of records
-    footer += (uint32_t)global_header.size();  // nbytes of global headers
-    footer += (uint32_t)(global_header_offset + nbytes +
-                         local_header.size());  // offset of start of global headers, since global
-                                                // header now starts after newly written array
-    footer += (uint16_t)0;                      // zip file comment length
-
-    // write everything
-    fwrite(&local_header[0], sizeof(char), local_header.size(), fp);
-    fwrite(&npy_header[0], sizeof(char), npy_header.size(), fp);
-    fwrite(data, sizeof(T), nels, fp);
-    fwrite(&global_header[0], sizeof(char), global_header.size(), fp);
-    fwrite(&footer[0], sizeof(char), footer.size(), fp);
-    fclose(fp);
+    NpzWriter writer(zipname, mode, level);
+    writer.add(fname, data, shape);
+    writer.close();
 }
 
 template <typename T>
@@ -278,46 +325,18 @@ template <typename T>
 void npz_save(std::string          zipname,
               std::string          fname,
               const std::vector<T> data,
-              std::string          mode = "w")
+              std::string          mode  = "w",
+              int                  level = 0)
 {
     std::vector<size_t> shape;
     shape.push_back(data.size());
-    npz_save(zipname, fname, &data[0], shape, mode);
+    npz_save(zipname, fname, &data[0], shape, mode, level);
 }
 
 template <typename T>
 std::vector<char> create_npy_header(const std::vector<size_t>& shape)
 {
-    std::vector<char> dict;
-    dict += "{'descr': '";
-    dict += BigEndianTest();
-    dict += map_type(typeid(T));
-    dict += std::to_string(sizeof(T));
-    dict += "', 'fortran_order': False, 'shape': (";
-    dict += std::to_string(shape[0]);
-    for (size_t i = 1; i < shape.size(); i++)
-    {
-        dict += ", ";
-        dict += std::to_string(shape[i]);
-    }
-    if (shape.size() == 1)
-        dict += ",";
-    dict += "), }";
-    // pad with spaces so that preamble+dict is modulo 16 bytes. preamble is 10 bytes. dict needs to
-    // end with \n
-    int remainder = 16 - (10 + dict.size()) % 16;
-    dict.insert(dict.end(), remainder, ' ');
-    dict.back() = '\n';
-
-    std::vector<char> header;
-    header += (char)0x93;
-    header += "NUMPY";
-    header += (char)0x01;  // major version of numpy format
-    header += (char)0x00;  // minor version of numpy format
-    header += (uint16_t)dict.size();
-    header.insert(header.end(), dict.begin(), dict.end());
-
-    return header;
+    return create_npy_header(map_type(typeid(T)), sizeof(T), shape);
 }
 
 }  // namespace cnpy
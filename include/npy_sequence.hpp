@@ -0,0 +1,92 @@
+#ifndef CAFFE_NPY_SEQUENCE_HPP_
+#define CAFFE_NPY_SEQUENCE_HPP_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blob.hpp"
+#include "common.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief Reads a sequence of npy / npz frames ahead of the caller and hands
+ *        them out in order.
+ *
+ * Up to window frames are read and decoded on I/O threads while the caller
+ * computes on the current one, so a video loop only waits for the disk when
+ * it is faster than the disk. Next() returns the frames in the order of
+ * paths, whatever order their reads finish in.
+ *
+ * An npy frame whose payload already is Dtype in C order is read with pread
+ * straight into the Blob; other npy frames are read into a buffer and
+ * converted (see Blob::CopyFromNPY), as scale * x + shift. With direct_io the
+ * files are opened with O_DIRECT and read whole into a page-aligned buffer,
+ * bypassing the page cache for sequences read once; file systems without
+ * O_DIRECT are read normally. An npz frame "archive.npz" loads the first
+ * member of the archive, "archive.npz:name" the member name.
+ */
+template <typename Dtype>
+class NpySequenceReader
+{
+public:
+    NpySequenceReader(const std::vector<std::string>& paths,
+                      int                             window    = 4,
+                      bool                            direct_io = false,
+                      float                           scale     = 1.0f,
+                      float                           shift     = 0.0f);
+    // Stops issuing reads, waits for those in flight and joins the I/O threads.
+    ~NpySequenceReader();
+
+    inline size_t size() const { return paths_.size(); }
+    // Index of the frame the next call to Next() returns.
+    inline size_t position() const { return next_out_; }
+
+    /**
+     * @brief Waits for frame position() and moves it into *frame. Returns 0,
+     *        or -1 (with *frame reset) if the frame could not be read; either
+     *        way the reader moves on to the following frame.
+     */
+    int Next(SharedBlob<Dtype>* frame);
+
+private:
+    struct Slot
+    {
+        size_t            index;  // frame held by the slot, or size() when free
+        bool              ready;
+        int               status;
+        SharedBlob<Dtype> blob;
+    };
+
+    void IoLoop();
+    int  ReadFrame(const std::string& path, Blob<Dtype>* blob) const;
+    int  ReadNpy(const std::string& path, Blob<Dtype>* blob) const;
+
+    std::vector<std::string> paths_;
+    bool                     direct_io_;
+    float                    scale_;
+    float                    shift_;
+
+    // Frame i lives in slots_[i % window] from the moment it is issued until
+    // Next() takes it, which bounds the frames in flight by the window.
+    std::mutex               mutex_;
+    std::condition_variable  issue_;  // wakes the I/O threads
+    std::condition_variable  ready_;  // wakes Next()
+    std::vector<Slot>        slots_;
+    size_t                   next_issue_;
+    size_t                   next_out_;
+    bool                     stop_;
+    std::vector<std::thread> threads_;
+
+    DISABLE_COPY_AND_ASSIGN(NpySequenceReader);
+};
+
+}  // namespace ferrari
+
+#endif  // CAFFE_NPY_SEQUENCE_HPP_
@@ -0,0 +1,131 @@
+#ifndef CAFFE_NPY_SINK_HPP_
+#define CAFFE_NPY_SINK_HPP_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blob.hpp"
+#include "common.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief Writes npy files on background threads, so the caller never waits
+ *        for the disk.
+ *
+ * Save() and Append() copy the blob's host data into a snapshot and queue it;
+ * the blob may be overwritten as soon as they return. Writer threads persist
+ * the snapshots. Every file name is always handled by the same writer, so
+ * the writes to one file keep their submission order.
+ *
+ * Append() grows a single npy file per stream along its first axis, e.g. one
+ * [1, 2, H, W] flow per frame gives an [N, 2, H, W] file. The file is opened
+ * once, the data is written as it arrives, and the header (with the final N)
+ * is written only when the stream is closed, by Close() or the destructor.
+ * Until then the file holds a header with room for any N.
+ *
+ * At most max_queued snapshots wait in memory. When the queue is full, Save
+ * and Append either block until a writer catches up or, with
+ * drop_when_full, drop the snapshot and return -1.
+ */
+class NpySink
+{
+public:
+    explicit NpySink(int num_threads = 1, size_t max_queued = 16, bool drop_when_full = false);
+    // Writes everything queued, closes all append streams and joins the writers.
+    ~NpySink();
+
+    // Writes blob to filename, replacing it. Returns 0 when queued, -1 when dropped.
+    template <typename Dtype>
+    int Save(const Blob<Dtype>& blob, const std::string& filename);
+    // Appends blob to stream filename along the first axis; the other axes and
+    // the type must match the first blob of the stream. Returns 0 when queued.
+    template <typename Dtype>
+    int Append(const Blob<Dtype>& blob, const std::string& filename);
+    // Writes the final header of stream filename and closes it; a later
+    // Append starts a new file. Returns 0 when queued.
+    int Close(const std::string& filename);
+
+    // Waits until everything submitted so far has been written. Returns 0, or
+    // -1 if a write failed (or a snapshot was dropped) since the last Flush.
+    int Flush();
+
+    inline int    num_threads() const { return static_cast<int>(writers_.size()); }
+    inline size_t dropped() const { return dropped_; }
+
+private:
+    enum TaskKind
+    {
+        SAVE,
+        APPEND,
+        CLOSE
+    };
+
+    struct Snapshot;
+
+    // An open Append() file.
+    struct Stream
+    {
+        FILE*               fp;
+        char                type;
+        size_t              word_size;
+        std::vector<size_t> shape;        // shape[0] counts the rows written so far
+        size_t              header_size;  // bytes reserved for the final header
+        bool                failed;
+    };
+
+    struct Task
+    {
+        TaskKind                  kind;
+        std::string               filename;
+        char                      type;  // numpy kind and element size
+        size_t                    word_size;
+        std::vector<size_t>       shape;
+        std::shared_ptr<Snapshot> data;
+    };
+
+    struct Writer
+    {
+        std::deque<Task>              tasks;
+        std::map<std::string, Stream> streams;  // only touched by the writer thread
+        std::thread                   thread;
+    };
+
+    int  Submit(Task task, const void* data, size_t bytes);
+    int  Execute(Writer* writer, const Task& task);
+    void WriterLoop(Writer* writer);
+
+    std::vector<std::unique_ptr<Writer>> writers_;
+    size_t                               max_queued_;
+    bool                                 drop_when_full_;
+
+    // Guards the queues and counters; not_full_ wakes blocked submitters,
+    // work_ the writers, idle_ Flush.
+    std::mutex              mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable work_;
+    std::condition_variable idle_;
+    size_t                  queued_;   // snapshots waiting in memory
+    size_t                  pending_;  // tasks queued or being written
+    int                     errors_;
+    bool                    stop_;
+    // Incremented under mutex_, but read by dropped() without it.
+    std::atomic<size_t> dropped_;
+
+    DISABLE_COPY_AND_ASSIGN(NpySink);
+};
+
+}  // namespace ferrari
+
+#endif  // CAFFE_NPY_SINK_HPP_
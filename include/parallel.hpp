@@ -0,0 +1,39 @@
+#ifndef CAFFE_PARALLEL_HPP_
+#define CAFFE_PARALLEL_HPP_
+
+#include <stdint.h>
+
+#include <functional>
+
+namespace ferrari
+{
+
+/**
+ * @brief Runs fn(chunk_begin, chunk_end) over contiguous chunks of [begin, end)
+ *        on the Caffe host thread pool.
+ *
+ * Chunks are at least grain elements long, so small ranges run inline on the
+ * calling thread. Returns once every chunk has finished. Calls may be nested.
+ */
+void parallel_for(int64_t                                     begin,
+                  int64_t                                     end,
+                  int64_t                                     grain,
+                  const std::function<void(int64_t, int64_t)>& fn);
+
+/**
+ * @brief Runs fn(row_begin, row_end, col_begin, col_end) over rectangular
+ *        blocks of a 2-D range on the Caffe host thread pool.
+ *
+ * Blocks are at least row_grain x col_grain except at the range edges.
+ */
+void parallel_for_2d(int64_t                                                       row_begin,
+                     int64_t                                                       row_end,
+                     int64_t                                                       col_begin,
+                     int64_t                                                       col_end,
+                     int64_t                                                       row_grain,
+                     int64_t                                                       col_grain,
+                     const std::function<void(int64_t, int64_t, int64_t, int64_t)>& fn);
+
+}  // namespace ferrari
+
+#endif  // CAFFE_PARALLEL_HPP_
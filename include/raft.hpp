@@ -1,14 +1,21 @@
 #pragma once
 
+#ifndef CPU_ONLY
 #include <cublas_v2.h>
 #include <cudnn.h>
+#endif
 
 #include <algorithm>
 #include <cassert>
 #include <numeric>
 #include <vector>
 
+#include "blob.hpp"
+#include "cpu_quant.hpp"
+#include "workspace.hpp"
+#ifndef CPU_ONLY
 #include "trt_infer.hpp"
+#endif
 
 namespace ferrari
 {
@@ -16,17 +23,80 @@ namespace ferrari
 class CorrBlock
 {
 public:
-    CorrBlock(int batch, int dim, int ht, int wd, int num_levels = 4, int radius = 4);
+    // ALL_PAIRS 预先计算完整的 (ht*wd)^2 相关体金字塔；
+    // ON_DEMAND 只保存池化后的 fmap2 金字塔，查询时按窗口计算点积，
+    // 内存从 batch*(ht*wd)^2 降到 batch*dim*ht*wd 量级
+    enum CorrMode
+    {
+        ALL_PAIRS,
+        ON_DEMAND
+    };
+
+    // ALL_PAIRS 相关体金字塔的存储精度；FP16 / BF16 只改变存储，
+    // GEMM 与窗口插值仍以 fp32 累加，金字塔内存减半
+    enum CorrPrecision
+    {
+        FP32,
+        FP16,
+        BF16
+    };
+
+    // ALL_PAIRS 相关体的计算方式；GEMM_INT8 将 fmap1 / fmap2 按像素量化为 int8，
+    // 用 VNNI 点积计算并在写回时反量化，误差可用 quantErrorReport 评估
+    enum CorrGemm
+    {
+        GEMM_FP32,
+        GEMM_INT8
+    };
+
+    CorrBlock(int           batch,
+              int           dim,
+              int           ht,
+              int           wd,
+              int           num_levels = 4,
+              int           radius     = 4,
+              CorrMode      mode       = ALL_PAIRS,
+              CorrPrecision precision  = FP32,
+              CorrGemm      gemm       = GEMM_FP32);
     ~CorrBlock();
 
+    CorrMode      mode() const { return mode_; }
+    CorrPrecision precision() const { return precision_; }
+    CorrGemm      gemm() const { return gemm_; }
+
+    // fmap1 / fmap2 为 [batch, dim, ht, wd]；CPU 模式下也接受标记为 LAYOUT_NHWC 的
+    // [batch, ht, wd, dim]，全对 GEMM 与按需金字塔都直接读取该布局 (int8 GEMM 除外)
     int computeCorr(const std::shared_ptr<Blob<float>>& fmap1,
                     const std::shared_ptr<Blob<float>>& fmap2);
 
     int call(const float* coords, float* output);
     int call(const std::shared_ptr<Blob<float>>& coords, std::shared_ptr<Blob<float>>& output);
 
+    // 抽样比较 int8 与 fp32 相关体的误差 (CPU)，结果写入 report 并打印日志
+    int quantErrorReport(const std::shared_ptr<Blob<float>>& fmap1,
+                         const std::shared_ptr<Blob<float>>& fmap2,
+                         CorrQuantReport*                    report,
+                         int                                 num_samples = 64);
+
+    // 按一次 RAFT 步骤的阶段图 (写入 fmap -> 相关 GEMM 或特征转置 -> 金字塔 -> 查询)
+    // 计算各中间张量的生命周期，把 fmap 输入、金字塔与 delta_lvl_ 打包进同一块 arena，
+    // 生命周期不相交的张量共用内存。之后 fmap1_input() / fmap2_input() 为 arena 中的
+    // 输入 blob，调用方写入后传给 computeCorr；computeCorr 返回后它们可能已被金字塔覆盖。
+    // 仅用于 Caffe::CPU
+    int planWorkspace();
+
+    const std::shared_ptr<Blob<float>>& fmap1_input() const { return fmap1_input_; }
+    const std::shared_ptr<Blob<float>>& fmap2_input() const { return fmap2_input_; }
+    // arena 大小；未调用 planWorkspace 时为 0
+    size_t workspace_bytes() const { return workspace_ ? workspace_->bytes() : 0; }
+
 private:
+    int computeCorrCpu(const std::shared_ptr<Blob<float>>& fmap1,
+                       const std::shared_ptr<Blob<float>>& fmap2);
     int buildCorrPyramid();
+    int buildCorrPyramidCpu();
+    int prepareOnDemandCpu(const std::shared_ptr<Blob<float>>& fmap1,
+                           const std::shared_ptr<Blob<float>>& fmap2);
     int generateDelta();
 
 private:
@@ -35,6 +105,19 @@ private:
     int                                       batch_, dim_, ht_, wd_;
     std::vector<std::shared_ptr<Blob<float>>> corr_pyramid_;
     std::shared_ptr<Blob<float>>              delta_lvl_;
+
+    CorrMode                                  mode_;
+    std::shared_ptr<Blob<float>>              fmap1_;          // ON_DEMAND: [batch, ht, wd, dim]
+    std::vector<std::shared_ptr<Blob<float>>> fmap2_pyramid_;  // ON_DEMAND: [batch, h, w, dim]
+
+    CorrPrecision                                precision_;
+    std::vector<std::shared_ptr<Blob<float16>>>  corr_pyramid_fp16_;  // precision_ == FP16
+    std::vector<std::shared_ptr<Blob<bfloat16>>> corr_pyramid_bf16_;  // precision_ == BF16
+    CorrGemm                                     gemm_;
+
+    std::shared_ptr<Workspace>   workspace_;
+    std::shared_ptr<Blob<float>> fmap1_input_;  // planWorkspace 后 arena 中的 fmap1
+    std::shared_ptr<Blob<float>> fmap2_input_;  // planWorkspace 后 arena 中的 fmap2
 };
 
 }  // namespace ferrari
\ No newline at end of file
@@ -2,12 +2,10 @@
 #define CAFFE_SYNCEDMEM_HPP_
 
 #include <cstdlib>
-
-#ifdef USE_MKL
-#include "mkl.h"
-#endif
+#include <string>
 
 #include "common.hpp"
+#include "host_allocator.hpp"
 
 namespace ferrari
 {
@@ -17,46 +15,29 @@ namespace ferrari
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Both kinds of memory are served by the caching HostAllocator, so blobs that
+// are reallocated with the same sizes every frame reuse their blocks.
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda)
 {
 #ifndef CPU_ONLY
-    if (Caffe::mode() == Caffe::GPU)
-    {
-        CUDA_CHECK(cudaMallocHost(ptr, size));
-        *use_cuda = true;
-        return;
-    }
-#endif
-#ifdef USE_MKL
-    *ptr = mkl_malloc(size ? size : 1, 64);
+    *use_cuda = (Caffe::mode() == Caffe::GPU);
 #else
-    *ptr = malloc(size);
-#endif
     *use_cuda = false;
-    CHECK(*ptr) << "host allocation of size " << size << " failed";
+#endif
+    *ptr = HostAllocator::Get().Allocate(size, *use_cuda);
 }
 
-inline void CaffeFreeHost(void* ptr, bool use_cuda)
+inline void CaffeFreeHost(void* ptr, size_t size, bool use_cuda)
 {
-#ifndef CPU_ONLY
-    if (use_cuda)
-    {
-        CUDA_CHECK(cudaFreeHost(ptr));
-        return;
-    }
-#endif
-#ifdef USE_MKL
-    mkl_free(ptr);
-#else
-    free(ptr);
-#endif
+    HostAllocator::Get().Free(ptr, size, use_cuda);
 }
 
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
  *        and device (GPU).
  *
- * TODO(dox): more thorough description.
+ * The host copy is either owned (from CaffeMallocHost), borrowed through
+ * set_cpu_data, or a region of a file mapped with MapFile.
  */
 class SyncedMemory
 {
@@ -80,6 +61,31 @@ public:
     SyncedHead head() const { return head_; }
     size_t     size() const { return size_; }
 
+    // How the pages of a file mapping are shared, see MapFile.
+    enum MapMode
+    {
+        READ_ONLY,     // shared with every process mapping the file, never written
+        COPY_ON_WRITE  // private; written pages are copied by the kernel
+    };
+    /**
+     * @brief Backs the host copy with size bytes of filename, starting at byte
+     *        offset, instead of allocating it.
+     *
+     * Nothing is read up front: the kernel pages the data in on first access
+     * and can drop clean pages under memory pressure, and processes that map
+     * the same file READ_ONLY share one copy in the page cache. The memory
+     * must not hold data yet. The head becomes HEAD_AT_CPU, so gpu_data()
+     * uploads from the mapping as usual. A READ_ONLY mapping is never
+     * written: mutable_cpu_data(), or syncing back from the GPU, first moves
+     * the data to owned host memory and unmaps the file. COPY_ON_WRITE
+     * mappings are written in place and never change the file.
+     *
+     * Returns 0 on success, -1 when the file cannot be opened or mapped or is
+     * shorter than offset + size.
+     */
+    int  MapFile(const std::string& filename, size_t offset, size_t size, MapMode mode = READ_ONLY);
+    bool is_mapped() const { return map_base_ != NULL; }
+
 #ifndef CPU_ONLY
     void async_gpu_push(const cudaStream_t& stream);
 #endif
@@ -87,8 +93,13 @@ public:
 private:
     void check_device();
 
-    void       to_cpu();
-    void       to_gpu();
+    void to_cpu();
+    void to_gpu();
+    // Replaces a read-only mapping by owned host memory, copying its contents
+    // when copy is set, and unmaps the file.
+    void detach_mapping(bool copy);
+    void unmap();
+
     void*      cpu_ptr_;
     void*      gpu_ptr_;
     size_t     size_;
@@ -97,6 +108,9 @@ private:
     bool       cpu_malloc_use_cuda_;
     bool       own_gpu_data_;
     int        device_;
+    void*      map_base_;  // page-aligned start of the file mapping, or NULL
+    size_t     map_length_;
+    bool       map_read_only_;
 
     DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
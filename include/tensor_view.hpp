@@ -0,0 +1,157 @@
+#ifndef CAFFE_TENSOR_VIEW_HPP_
+#define CAFFE_TENSOR_VIEW_HPP_
+
+#include <stdint.h>
+
+#include <type_traits>
+
+#include "blob.hpp"
+#include "blob_view.hpp"
+#include "common.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief Raw strided access to host memory with the rank fixed at compile time.
+ *
+ * A TensorView is a pointer plus Rank extents and strides (in elements), taken
+ * from a Blob or BlobView once, outside the loop: tensor_view<4>(blob) syncs
+ * the blob to the host a single time, after which view(n, c, h, w) is a few
+ * multiply-adds with no SyncedMemory state checks. Indices are only
+ * bounds-checked (with DCHECK) in debug builds; with NDEBUG the accessors
+ * compile down to the address arithmetic. The view does not own its memory
+ * and is invalidated by anything that reallocates or moves the blob's data
+ * (Reshape to a larger size, a GPU write followed by a host read, ...).
+ */
+template <typename T, int Rank>
+class TensorView
+{
+    static_assert(Rank >= 1 && Rank <= kMaxBlobAxes, "TensorView rank out of range");
+
+public:
+    TensorView() : data_(NULL)
+    {
+        for (int i = 0; i < Rank; ++i)
+        {
+            shape_[i]   = 0;
+            strides_[i] = 0;
+        }
+    }
+
+    /// @brief Densely packed row-major view of data.
+    TensorView(T* data, const vector<int>& shape) : data_(data)
+    {
+        CHECK_EQ(shape.size(), Rank) << "TensorView rank does not match the shape";
+        int64_t stride = 1;
+        for (int i = Rank - 1; i >= 0; --i)
+        {
+            shape_[i]   = shape[i];
+            strides_[i] = stride;
+            stride *= shape[i];
+        }
+    }
+
+    TensorView(T* data, const vector<int>& shape, const vector<int64_t>& strides) : data_(data)
+    {
+        CHECK_EQ(shape.size(), Rank) << "TensorView rank does not match the shape";
+        CHECK_EQ(strides.size(), Rank);
+        for (int i = 0; i < Rank; ++i)
+        {
+            shape_[i]   = shape[i];
+            strides_[i] = strides[i];
+        }
+    }
+
+    // A mutable view converts to a read-only one.
+    template <typename U,
+              typename = typename std::enable_if<std::is_same<const U, T>::value &&
+                                                 !std::is_same<U, T>::value>::type>
+    TensorView(const TensorView<U, Rank>& other) : data_(other.data())
+    {
+        for (int i = 0; i < Rank; ++i)
+        {
+            shape_[i]   = other.shape(i);
+            strides_[i] = other.stride(i);
+        }
+    }
+
+    static constexpr int rank() { return Rank; }
+
+    inline T*      data() const { return data_; }
+    inline int     shape(int axis) const { return shape_[axis]; }
+    inline int64_t stride(int axis) const { return strides_[axis]; }
+    inline int64_t count() const
+    {
+        int64_t count = 1;
+        for (int i = 0; i < Rank; ++i)
+        {
+            count *= shape_[i];
+        }
+        return count;
+    }
+
+    /// @brief Element offset of an index, one index per axis.
+    template <typename... Index>
+    inline int64_t offset(Index... index) const
+    {
+        static_assert(sizeof...(Index) == Rank, "TensorView needs one index per axis");
+        const int64_t idx[Rank] = {static_cast<int64_t>(index)...};
+        int64_t       offset    = 0;
+        for (int i = 0; i < Rank; ++i)
+        {
+            DCHECK_GE(idx[i], 0) << "axis " << i;
+            DCHECK_LT(idx[i], shape_[i]) << "axis " << i;
+            offset += idx[i] * strides_[i];
+        }
+        return offset;
+    }
+
+    template <typename... Index>
+    inline T& operator()(Index... index) const
+    {
+        return data_[offset(index...)];
+    }
+
+    /// @brief Pointer to an element, e.g. the start of a row for an inner loop.
+    template <typename... Index>
+    inline T* ptr(Index... index) const
+    {
+        return data_ + offset(index...);
+    }
+
+private:
+    T*      data_;
+    int     shape_[Rank];
+    int64_t strides_[Rank];
+};
+
+/// @brief Read-only host view of blob; blob must have exactly Rank axes.
+template <int Rank, typename Dtype>
+TensorView<const Dtype, Rank> tensor_view(const Blob<Dtype>& blob)
+{
+    return TensorView<const Dtype, Rank>(blob.cpu_data(), blob.shape());
+}
+
+/// @brief Writable host view of blob; marks the host copy as the latest.
+template <int Rank, typename Dtype>
+TensorView<Dtype, Rank> mutable_tensor_view(Blob<Dtype>* blob)
+{
+    return TensorView<Dtype, Rank>(blob->mutable_cpu_data(), blob->shape());
+}
+
+template <int Rank, typename Dtype>
+TensorView<const Dtype, Rank> tensor_view(const BlobView<Dtype>& view)
+{
+    return TensorView<const Dtype, Rank>(view.cpu_data(), view.shape(), view.strides());
+}
+
+template <int Rank, typename Dtype>
+TensorView<Dtype, Rank> mutable_tensor_view(const BlobView<Dtype>& view)
+{
+    return TensorView<Dtype, Rank>(view.mutable_cpu_data(), view.shape(), view.strides());
+}
+
+}  // namespace ferrari
+
+#endif  // CAFFE_TENSOR_VIEW_HPP_
@@ -0,0 +1,110 @@
+#ifndef CAFFE_THREAD_POOL_HPP_
+#define CAFFE_THREAD_POOL_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief A work-stealing pool of host threads.
+ *
+ * A pool of num_threads runs num_threads - 1 worker threads; the thread that
+ * calls run() / parallel_for() is the remaining one and executes chunks too.
+ * Every participant owns a deque of chunks: a call splits its range into
+ * contiguous blocks of chunks, one block per deque, and each thread pops its
+ * own block front to back while idle threads steal from the back of the
+ * others. A caller that waits on its chunks keeps executing (and stealing)
+ * chunks, so parallel_for may be nested inside a chunk.
+ *
+ * The pool is normally reached through Caffe::thread_pool(); the CPU kernels
+ * go through ferrari::parallel_for (parallel.hpp).
+ */
+class ThreadPool
+{
+public:
+    // num_threads <= 0 picks the number of cores the process may run on.
+    // With pin_threads each worker is bound to one of those cores (Linux).
+    explicit ThreadPool(int num_threads = 0, bool pin_threads = false);
+    ~ThreadPool();
+
+    // Threads taking part in a parallel_for, including the calling one.
+    inline int  num_threads() const { return static_cast<int>(queues_.size()); }
+    inline bool pin_threads() const { return pin_threads_; }
+
+    // Number of cores available to the process (sched_getaffinity on Linux).
+    static int DefaultNumThreads();
+
+    // Runs fn(i) for every i in [0, num_tasks) and returns when all have
+    // finished. The first exception thrown by a task is rethrown here.
+    void run(int64_t num_tasks, const std::function<void(int64_t)>& fn);
+
+    // fn(chunk_begin, chunk_end) over chunks of [begin, end) at least grain
+    // long. Ranges of a single grain run inline on the calling thread.
+    void parallel_for(int64_t                                     begin,
+                      int64_t                                     end,
+                      int64_t                                     grain,
+                      const std::function<void(int64_t, int64_t)>& fn);
+
+    // fn(row_begin, row_end, col_begin, col_end) over rectangular blocks of
+    // [row_begin, row_end) x [col_begin, col_end), each at least
+    // row_grain x col_grain (clipped at the range edges).
+    void parallel_for_2d(
+        int64_t                                                       row_begin,
+        int64_t                                                       row_end,
+        int64_t                                                       col_begin,
+        int64_t                                                       col_end,
+        int64_t                                                       row_grain,
+        int64_t                                                       col_grain,
+        const std::function<void(int64_t, int64_t, int64_t, int64_t)>& fn);
+
+private:
+    struct Job;
+
+    struct Task
+    {
+        Job*    job;
+        int64_t index;
+    };
+
+    // One per participant, allocated separately and padded so owners and
+    // thieves of different queues do not share cache lines.
+    struct Queue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+        char             pad[64];
+    };
+
+    bool pop(int self, Task* task);
+    bool steal(int self, Task* task);
+    void execute(const Task& task);
+    void worker_loop(int self);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread>            workers_;
+    bool                                pin_threads_;
+
+    // Sleeping workers wait on cv_ until queued_ > 0 or stop_.
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    std::atomic<int64_t>    queued_;
+    bool                    stop_;
+
+    DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace ferrari
+
+#endif  // CAFFE_THREAD_POOL_HPP_
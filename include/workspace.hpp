@@ -0,0 +1,125 @@
+#ifndef CAFFE_WORKSPACE_HPP_
+#define CAFFE_WORKSPACE_HPP_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "blob.hpp"
+#include "common.hpp"
+#include "syncedmem.hpp"
+
+namespace ferrari
+{
+
+/**
+ * @brief Packs the intermediates of a pipeline step into one arena.
+ *
+ * Tensors are declared with their size, then the stages of one step are
+ * added in execution order with the tensors each stage reads and writes. A
+ * tensor is live from the first stage that touches it to the last one
+ * (persistent tensors for the whole step). Plan() assigns every tensor an
+ * offset so that tensors whose lifetimes overlap never share bytes, placing
+ * the largest tensors first at the lowest offset that fits (greedy by size);
+ * tensors whose lifetimes are disjoint reuse the same range.
+ */
+class WorkspacePlanner
+{
+public:
+    WorkspacePlanner() : planned_(false), arena_bytes_(0) {}
+
+    // Returns the id of a new tensor of bytes bytes.
+    int AddTensor(const std::string& name, size_t bytes);
+    // Keeps the tensor live over the whole step (e.g. results read later).
+    void MarkPersistent(int tensor);
+    // Appends a stage; reads and writes are tensor ids.
+    void AddStage(const std::string&      name,
+                  const std::vector<int>& reads,
+                  const std::vector<int>& writes);
+
+    // Computes lifetimes and offsets. Returns 0 on success, -1 when a
+    // tensor is never used by any stage.
+    int Plan();
+
+    inline bool   planned() const { return planned_; }
+    inline int    num_tensors() const { return static_cast<int>(tensors_.size()); }
+    inline size_t arena_bytes() const { return arena_bytes_; }
+    // Sum of all tensor sizes, i.e. the footprint without reuse.
+    size_t total_bytes() const;
+
+    size_t             offset(int tensor) const;
+    size_t             bytes(int tensor) const;
+    const std::string& name(int tensor) const;
+    // First and last stage (inclusive) the tensor is live in.
+    int first_stage(int tensor) const;
+    int last_stage(int tensor) const;
+
+    // Offsets are aligned to this many bytes.
+    static const size_t kAlignment = 64;
+
+private:
+    struct Tensor
+    {
+        std::string name;
+        size_t      bytes;
+        bool        persistent;
+        int         first;
+        int         last;
+        size_t      offset;
+    };
+
+    std::vector<Tensor>      tensors_;
+    std::vector<std::string> stages_;
+    bool                     planned_;
+    size_t                   arena_bytes_;
+};
+
+/**
+ * @brief Host arena laid out by a WorkspacePlanner; Blobs become views into it.
+ *
+ * The arena is a single SyncedMemory, so it comes from the caching host
+ * allocator (64 byte aligned, on 2 MB pages when large). A bound Blob does
+ * not own its data: it stays valid while the Workspace lives, and only for
+ * the stages in which its tensor is live. Reshaping a view beyond its planned
+ * size detaches it into its own allocation, as with any Blob.
+ */
+class Workspace
+{
+public:
+    // planner must have been planned.
+    explicit Workspace(const WorkspacePlanner& planner);
+
+    inline const WorkspacePlanner& planner() const { return planner_; }
+    inline size_t                  bytes() const { return planner_.arena_bytes(); }
+    void*                          data(int tensor);
+
+    // Reshapes blob to shape and points it at the range of tensor.
+    template <typename Dtype>
+    void Bind(int tensor, const vector<int>& shape, Blob<Dtype>* blob)
+    {
+        blob->Reshape(shape);
+        CHECK_LE(blob->count() * sizeof(Dtype), planner_.bytes(tensor))
+            << "blob does not fit workspace tensor " << planner_.name(tensor);
+        blob->set_cpu_data(static_cast<Dtype*>(data(tensor)));
+    }
+
+    template <typename Dtype>
+    std::shared_ptr<Blob<Dtype>> MakeBlob(int tensor, const vector<int>& shape)
+    {
+        std::shared_ptr<Blob<Dtype>> blob = std::make_shared<Blob<Dtype>>();
+        Bind(tensor, shape, blob.get());
+        return blob;
+    }
+
+private:
+    WorkspacePlanner              planner_;
+    std::shared_ptr<SyncedMemory> arena_;
+
+    DISABLE_COPY_AND_ASSIGN(Workspace);
+};
+
+}  // namespace ferrari
+
+#endif  // CAFFE_WORKSPACE_HPP_
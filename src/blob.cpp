@@ -1,11 +1,16 @@
 #include "blob.hpp"
 
-#include <climits>
+#include <limits>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "common.hpp"
+#include "half.hpp"
+#include "host_allocator.hpp"
 #include "math_functions.hpp"
 #include "npy.hpp"
+#include "parallel.hpp"
 #include "syncedmem.hpp"
 
 namespace ferrari
@@ -37,7 +42,8 @@ void Blob<Dtype>::Reshape(const vector<int>& shape)
         CHECK_GE(shape[i], 0);
         if (count_ != 0)
         {
-            CHECK_LE(shape[i], INT_MAX / count_) << "blob size exceeds INT_MAX";
+            CHECK_LE(shape[i], std::numeric_limits<int64_t>::max() / count_)
+                << "blob size exceeds INT64_MAX";
         }
         count_ *= shape[i];
         shape_[i]     = shape[i];
@@ -66,12 +72,14 @@ template <typename Dtype>
 void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other)
 {
     Reshape(other.shape());
+    layout_ = other.layout();
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height, const int width)
     // capacity_ must be initialized before calling Reshape
-    : capacity_(0)
+    : capacity_(0),
+      layout_(LAYOUT_NCHW)
 {
     Reshape(num, channels, height, width);
 }
@@ -79,7 +87,8 @@ Blob<Dtype>::Blob(const int num, const int channels, const int height, const int
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
     // capacity_ must be initialized before calling Reshape
-    : capacity_(0)
+    : capacity_(0),
+      layout_(LAYOUT_NCHW)
 {
     Reshape(shape);
 }
@@ -179,21 +188,224 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool reshape)
     }
 }
 
+namespace
+{
+
+// Reorders an array stored in Fortran order (first axis fastest) into row-major dst.
 template <typename Dtype>
-void Blob<Dtype>::LoadFromNPY(const std::string& filename)
+void fortran_to_c(const Dtype* src, const vector<int>& shape, Dtype* dst)
 {
-    cnpy::NpyArray   array = cnpy::npy_load(filename);
-    std::vector<int> sh(array.shape.size());
-    std::transform(array.shape.begin(),
-                   array.shape.end(),
-                   sh.begin(),
-                   [](size_t s) { return static_cast<int>(s); });
-    Reshape(sh);
-    Dtype*       ptr  = (Dtype*)data_->mutable_cpu_data();
-    const Dtype* data = array.data<Dtype>();
-    std::copy(data, data + count_, ptr);
+    const int       axes  = shape.size();
+    int64_t         count = 1;
+    vector<int64_t> strides(axes);
+    vector<int>     index(axes, 0);
+    for (int i = 0; i < axes; ++i)
+    {
+        strides[i] = count;
+        count *= shape[i];
+    }
+    int64_t offset = 0;
+    for (int64_t i = 0; i < count; ++i)
+    {
+        dst[i] = src[offset];
+        for (int a = axes - 1; a >= 0; --a)
+        {
+            offset += strides[a];
+            if (++index[a] < shape[a])
+            {
+                break;
+            }
+            offset -= strides[a] * shape[a];
+            index[a] = 0;
+        }
+    }
+}
 
-    return;
+// True when numpy elements of kind type and word_size are stored exactly as Dtype.
+template <typename Dtype>
+bool holds_npy_type(char type, size_t word_size)
+{
+    return type == cnpy::map_type(typeid(Dtype)) && word_size == sizeof(Dtype);
+}
+
+// Elements converted per host task by the generic conversion below.
+const int64_t kConvertGrain = 1 << 16;
+
+// Dtype(scale * x + shift) for sources or destinations without a vectorized
+// conversion, computed in double so that double blobs keep their precision.
+template <typename Stype, typename Dtype>
+void convert_scalar(int64_t n, const Stype* src, float scale, float shift, Dtype* dst)
+{
+    parallel_for(0,
+                 n,
+                 kConvertGrain,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     for (int64_t i = begin; i < end; ++i)
+                     {
+                         const double x = static_cast<double>(src[i]);
+                         dst[i]         = static_cast<Dtype>(scale * x + shift);
+                     }
+                 });
+}
+
+template <typename Stype, typename Dtype>
+void convert_elements(int64_t n, const Stype* src, float scale, float shift, Dtype* dst)
+{
+    convert_scalar(n, src, scale, shift, dst);
+}
+
+template <typename Stype>
+void convert_elements(int64_t n, const Stype* src, float scale, float shift, float* dst)
+{
+    caffe_cpu_convert_affine(n, scale, src, shift, dst);
+}
+
+// Converts the elements of array, of any real numpy type, to Dtype as scale * x + shift.
+// Throws std::runtime_error for kinds that are not numbers (complex, void, strings, ...).
+template <typename Dtype>
+void convert_npy(const cnpy::NpyArray& array, float scale, float shift, Dtype* dst)
+{
+    const int64_t n    = array.num_vals;
+    const char*   data = array.bytes();
+    const char    type = array.type == 'b' ? 'u' : array.type;  // bool is stored as one byte
+    // Wider elements (strings, structured arrays) must not alias a numeric case.
+    switch (array.word_size <= 8 ? type * 16 + array.word_size : 0)
+    {
+        case 'f' * 16 + 2:
+            convert_elements(n, reinterpret_cast<const float16*>(data), scale, shift, dst);
+            break;
+        case 'f' * 16 + 4:
+            convert_elements(n, reinterpret_cast<const float*>(data), scale, shift, dst);
+            break;
+        case 'f' * 16 + 8:
+            convert_elements(n, reinterpret_cast<const double*>(data), scale, shift, dst);
+            break;
+        case 'u' * 16 + 1:
+            convert_elements(n, reinterpret_cast<const uint8_t*>(data), scale, shift, dst);
+            break;
+        case 'u' * 16 + 2:
+            convert_elements(n, reinterpret_cast<const uint16_t*>(data), scale, shift, dst);
+            break;
+        case 'i' * 16 + 1:
+            convert_elements(n, reinterpret_cast<const int8_t*>(data), scale, shift, dst);
+            break;
+        case 'i' * 16 + 2:
+            convert_elements(n, reinterpret_cast<const int16_t*>(data), scale, shift, dst);
+            break;
+        case 'i' * 16 + 4:
+            convert_elements(n, reinterpret_cast<const int32_t*>(data), scale, shift, dst);
+            break;
+        case 'u' * 16 + 4:
+            convert_scalar(n, reinterpret_cast<const uint32_t*>(data), scale, shift, dst);
+            break;
+        case 'i' * 16 + 8:
+            convert_scalar(n, reinterpret_cast<const int64_t*>(data), scale, shift, dst);
+            break;
+        case 'u' * 16 + 8:
+            convert_scalar(n, reinterpret_cast<const uint64_t*>(data), scale, shift, dst);
+            break;
+        default:
+            throw std::runtime_error("cannot convert npy elements of type " +
+                                     std::string(1, array.type) +
+                                     std::to_string(array.word_size));
+    }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void Blob<Dtype>::CopyFromNPY(const cnpy::NpyArray& array, float scale, float shift)
+{
+    Reshape(vector<int>(array.shape.begin(), array.shape.end()));
+    Dtype* ptr = (Dtype*)data_->mutable_cpu_data();
+    if (holds_npy_type<Dtype>(array.type, array.word_size) && scale == 1.0f && shift == 0.0f)
+    {
+        const Dtype* data = array.data<Dtype>();
+        if (array.fortran_order)
+        {
+            fortran_to_c(data, shape_, ptr);
+            return;
+        }
+        std::copy(data, data + count_, ptr);
+        return;
+    }
+    if (!array.fortran_order)
+    {
+        convert_npy(array, scale, shift, ptr);
+        return;
+    }
+    vector<Dtype> data(count_);
+    convert_npy(array, scale, shift, data.data());
+    fortran_to_c(data.data(), shape_, ptr);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::LoadFromNPY(const std::string& filename, float scale, float shift)
+{
+    // The mapped file is read by the page faults of the conversion itself.
+    CopyFromNPY(cnpy::npy_mmap(filename), scale, shift);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::LoadFromNPY(const std::string& filename, bool map_file)
+{
+    if (map_file)
+    {
+        const cnpy::NpyHeader header = cnpy::npy_load_header(filename);
+        if (!holds_npy_type<Dtype>(header.type, header.word_size))
+        {
+            LoadFromNPY(filename, 1.0f, 0.0f);
+            return;
+        }
+        if (header.data_offset % HostAllocator::kAlignment == 0 && !header.fortran_order &&
+            !cnpy::needs_byteswap(header))
+        {
+            std::vector<int> sh(header.shape.begin(), header.shape.end());
+            CHECK_EQ(MapFromFile(filename, header.data_offset, sh), 0) << "cannot map " << filename;
+            return;
+        }
+        LOG(WARNING) << filename << ": data is unaligned, in Fortran order or byte swapped, "
+                     << "reading it instead of mapping";
+    }
+    CopyFromNPY(cnpy::npy_load(filename));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::LoadFromNPZ(const cnpy::NpzReader& reader, const std::string& varname)
+{
+    // Members stored as Dtype inflate straight into the host buffer; others
+    // inflate into an array, as NpzReader::load does, and are converted.
+    cnpy::NpyArray        converted;
+    const cnpy::NpyHeader header =
+        reader.read(varname,
+                    [this, &converted](const cnpy::NpyHeader& h)
+                    {
+                        if (!holds_npy_type<Dtype>(h.type, h.word_size))
+                        {
+                            converted      = cnpy::NpyArray(h.shape, h.word_size, h.fortran_order);
+                            converted.type = h.type;
+                            return converted.data<char>();
+                        }
+                        Reshape(vector<int>(h.shape.begin(), h.shape.end()));
+                        return reinterpret_cast<char*>(data_->mutable_cpu_data());
+                    });
+    if (converted.data_holder)
+    {
+        CopyFromNPY(converted);
+        return;
+    }
+    if (header.fortran_order)
+    {
+        const vector<Dtype> data(cpu_data(), cpu_data() + count_);
+        fortran_to_c(data.data(), shape_, mutable_cpu_data());
+    }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::LoadFromNPZ(const std::string& filename, const std::string& varname)
+{
+    LoadFromNPZ(cnpy::NpzReader(filename), varname);
 }
 
 template <typename Dtype>
@@ -209,8 +421,27 @@ void Blob<Dtype>::SaveToNPY(const std::string& filename)
 
     return;
 }
+template <typename Dtype>
+int Blob<Dtype>::MapFromFile(const std::string&    filename,
+                             size_t                offset,
+                             const vector<int>&    shape,
+                             SyncedMemory::MapMode mode)
+{
+    Reshape(shape);
+    std::shared_ptr<SyncedMemory> mem = std::make_shared<SyncedMemory>();
+    if (mem->MapFile(filename, offset, count_ * sizeof(Dtype), mode) != 0)
+    {
+        return -1;
+    }
+    data_     = mem;
+    capacity_ = count_;
+    return 0;
+}
+
 INSTANTIATE_CLASS(Blob);
 template class Blob<int>;
 template class Blob<unsigned int>;
+template class Blob<float16>;
+template class Blob<bfloat16>;
 
 }  // namespace ferrari
@@ -0,0 +1,254 @@
+#include "blob_view.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "math_functions.hpp"
+#include "parallel.hpp"
+
+namespace ferrari
+{
+namespace
+{
+
+// Elements copied per host task when a strided view is gathered or scattered.
+const int64_t kMinElementsPerTask = 16384;
+
+// Moves the elements of a strided view to or from a dense row-major buffer.
+// The last axis is copied as one run per outer index (a memcpy when it is
+// contiguous); outer indices are spread over the host threads.
+template <typename Dtype>
+void copy_strided(Dtype*                 strided,
+                  const vector<int>&     shape,
+                  const vector<int64_t>& strides,
+                  int64_t                count,
+                  Dtype*                 dense,
+                  bool                   gather)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    const int     axes         = shape.size();
+    const int64_t inner        = axes > 0 ? shape[axes - 1] : 1;
+    const int64_t inner_stride = axes > 0 ? strides[axes - 1] : 1;
+    const int64_t outer        = count / inner;
+
+    parallel_for(0,
+                 outer,
+                 std::max<int64_t>(1, kMinElementsPerTask / inner),
+                 [&](int64_t begin, int64_t end)
+                 {
+                     for (int64_t o = begin; o < end; ++o)
+                     {
+                         // Position of outer index o, last outer axis fastest.
+                         int64_t base = 0;
+                         int64_t rest = o;
+                         for (int i = axes - 2; i >= 0; --i)
+                         {
+                             base += (rest % shape[i]) * strides[i];
+                             rest /= shape[i];
+                         }
+                         Dtype* s = strided + base;
+                         Dtype* d = dense + o * inner;
+                         if (inner_stride == 1)
+                         {
+                             gather ? memcpy(d, s, sizeof(Dtype) * inner)
+                                    : memcpy(s, d, sizeof(Dtype) * inner);
+                             continue;
+                         }
+                         for (int64_t j = 0; j < inner; ++j)
+                         {
+                             if (gather)
+                             {
+                                 d[j] = s[j * inner_stride];
+                             }
+                             else
+                             {
+                                 s[j * inner_stride] = d[j];
+                             }
+                         }
+                     }
+                 });
+}
+
+}  // namespace
+
+template <typename Dtype>
+BlobView<Dtype>::BlobView(const Blob<Dtype>& blob)
+    : data_(blob.data()),
+      shape_(blob.shape()),
+      strides_(blob.num_axes()),
+      offset_(0),
+      count_(blob.count())
+{
+    int64_t stride = 1;
+    for (int i = num_axes() - 1; i >= 0; --i)
+    {
+        strides_[i] = stride;
+        stride *= shape_[i];
+    }
+}
+
+template <typename Dtype>
+BlobView<Dtype>::BlobView(const std::shared_ptr<SyncedMemory>& data,
+                          int64_t                              offset,
+                          const vector<int>&                   shape,
+                          const vector<int64_t>&               strides)
+    : data_(data),
+      shape_(shape),
+      strides_(strides),
+      offset_(offset),
+      count_(1)
+{
+    CHECK(data_);
+    CHECK_EQ(shape_.size(), strides_.size());
+    CHECK_GE(offset_, 0);
+    // The furthest element must lie inside the shared memory.
+    int64_t last = offset_;
+    for (int i = 0; i < num_axes(); ++i)
+    {
+        CHECK_GE(shape_[i], 0);
+        CHECK_GE(strides_[i], 0);
+        count_ *= shape_[i];
+        last += (shape_[i] > 0 ? shape_[i] - 1 : 0) * strides_[i];
+    }
+    CHECK(count_ == 0 || (last + 1) * static_cast<int64_t>(sizeof(Dtype)) <=
+                             static_cast<int64_t>(data_->size()))
+        << "view exceeds the memory it shares";
+}
+
+template <typename Dtype>
+BlobView<Dtype> BlobView<Dtype>::Slice(int axis, int begin, int end) const
+{
+    axis = CanonicalAxisIndex(axis);
+    CHECK_GE(begin, 0);
+    CHECK_LE(begin, end);
+    CHECK_LE(end, shape_[axis]) << "slice [" << begin << ", " << end << ") of axis " << axis;
+    vector<int> shape = shape_;
+    shape[axis]       = end - begin;
+    return BlobView(data_, offset_ + begin * strides_[axis], shape, strides_);
+}
+
+template <typename Dtype>
+BlobView<Dtype> BlobView<Dtype>::Select(int axis, int index) const
+{
+    axis = CanonicalAxisIndex(axis);
+    CHECK_GE(index, 0);
+    CHECK_LT(index, shape_[axis]);
+    vector<int>     shape   = shape_;
+    vector<int64_t> strides = strides_;
+    shape.erase(shape.begin() + axis);
+    strides.erase(strides.begin() + axis);
+    return BlobView(data_, offset_ + index * strides_[axis], shape, strides);
+}
+
+template <typename Dtype>
+bool BlobView<Dtype>::is_contiguous() const
+{
+    int64_t expected = 1;
+    for (int i = num_axes() - 1; i >= 0; --i)
+    {
+        // Axes of extent 1 never step, so their stride does not matter.
+        if (shape_[i] != 1 && strides_[i] != expected)
+        {
+            return false;
+        }
+        expected *= shape_[i];
+    }
+    return true;
+}
+
+template <typename Dtype>
+int64_t BlobView<Dtype>::offset(const vector<int>& indices) const
+{
+    CHECK_LE(indices.size(), num_axes());
+    int64_t offset = 0;
+    for (int i = 0; i < indices.size(); ++i)
+    {
+        CHECK_GE(indices[i], 0);
+        CHECK_LT(indices[i], shape_[i]);
+        offset += indices[i] * strides_[i];
+    }
+    return offset;
+}
+
+template <typename Dtype>
+const Dtype* BlobView<Dtype>::cpu_data() const
+{
+    return static_cast<const Dtype*>(data()->cpu_data()) + offset_;
+}
+
+template <typename Dtype>
+const Dtype* BlobView<Dtype>::gpu_data() const
+{
+    return static_cast<const Dtype*>(data()->gpu_data()) + offset_;
+}
+
+template <typename Dtype>
+Dtype* BlobView<Dtype>::mutable_cpu_data() const
+{
+    return static_cast<Dtype*>(data()->mutable_cpu_data()) + offset_;
+}
+
+template <typename Dtype>
+Dtype* BlobView<Dtype>::mutable_gpu_data() const
+{
+    return static_cast<Dtype*>(data()->mutable_gpu_data()) + offset_;
+}
+
+template <typename Dtype>
+void BlobView<Dtype>::CopyTo(Blob<Dtype>* dst) const
+{
+    dst->Reshape(shape_);
+    if (is_contiguous())
+    {
+        if (Caffe::mode() == Caffe::GPU)
+        {
+            caffe_copy(count_, gpu_data(), dst->mutable_gpu_data());
+        }
+        else
+        {
+            caffe_copy(count_, cpu_data(), dst->mutable_cpu_data());
+        }
+        return;
+    }
+    copy_strided(const_cast<Dtype*>(cpu_data()),
+                 shape_,
+                 strides_,
+                 count_,
+                 dst->mutable_cpu_data(),
+                 true);
+}
+
+template <typename Dtype>
+void BlobView<Dtype>::CopyFrom(const Blob<Dtype>& src) const
+{
+    CHECK_EQ(src.count(), count_) << "Trying to copy blobs of different sizes.";
+    if (is_contiguous())
+    {
+        if (Caffe::mode() == Caffe::GPU)
+        {
+            caffe_copy(count_, src.gpu_data(), mutable_gpu_data());
+        }
+        else
+        {
+            caffe_copy(count_, src.cpu_data(), mutable_cpu_data());
+        }
+        return;
+    }
+    copy_strided(mutable_cpu_data(),
+                 shape_,
+                 strides_,
+                 count_,
+                 const_cast<Dtype*>(src.cpu_data()),
+                 false);
+}
+
+INSTANTIATE_CLASS(BlobView);
+template class BlobView<int>;
+template class BlobView<unsigned int>;
+template class BlobView<float16>;
+template class BlobView<bfloat16>;
+
+}  // namespace ferrari
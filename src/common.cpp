@@ -5,9 +5,9 @@
 #include <ctime>
 
 #include "common.hpp"
-#include "cudnn.h"
 #include "device_alternate.hpp"
 #include "simple_log.hpp"
+#include "thread_pool.hpp"
 
 namespace ferrari
 {
@@ -18,7 +18,75 @@ Caffe& Caffe::Get()
     return instance;
 }
 
-Caffe::Caffe() : cublas_handle_(NULL), cudnn_handle_(NULL), mode_(Caffe::GPU)
+ThreadPool& Caffe::thread_pool()
+{
+    Caffe&                      caffe = Get();
+    std::lock_guard<std::mutex> lock(caffe.thread_pool_mutex_);
+    if (!caffe.thread_pool_)
+    {
+        caffe.thread_pool_.reset(new ThreadPool(caffe.num_threads_, caffe.pin_threads_));
+    }
+    return *caffe.thread_pool_;
+}
+
+int Caffe::num_threads()
+{
+    return thread_pool().num_threads();
+}
+
+void Caffe::set_num_threads(const int num_threads)
+{
+    CHECK_GE(num_threads, 0);
+    Caffe&                      caffe = Get();
+    std::lock_guard<std::mutex> lock(caffe.thread_pool_mutex_);
+    caffe.num_threads_ = num_threads;
+    caffe.thread_pool_.reset();
+}
+
+void Caffe::set_thread_affinity(const bool pin_threads)
+{
+    Caffe&                      caffe = Get();
+    std::lock_guard<std::mutex> lock(caffe.thread_pool_mutex_);
+    caffe.pin_threads_ = pin_threads;
+    caffe.thread_pool_.reset();
+}
+
+#ifdef CPU_ONLY  // CPU-only Caffe.
+
+Caffe::Caffe() : mode_(Caffe::CPU), num_threads_(0), pin_threads_(false) {}
+
+Caffe::~Caffe() {}
+
+void Caffe::SetDevice(const int device_id)
+{
+    NO_GPU;
+}
+
+void Caffe::DeviceQuery()
+{
+    NO_GPU;
+}
+
+bool Caffe::CheckDevice(const int device_id)
+{
+    NO_GPU;
+    return false;
+}
+
+int Caffe::FindDevice(const int start_id)
+{
+    NO_GPU;
+    return -1;
+}
+
+#else  // Normal GPU + CPU Caffe.
+
+Caffe::Caffe()
+    : cublas_handle_(NULL),
+      cudnn_handle_(NULL),
+      mode_(Caffe::GPU),
+      num_threads_(0),
+      pin_threads_(false)
 {
     // Try to create a cublas handler, and report an error if failed (but we will
     // keep the program running as one might just want to run CPU code).
@@ -172,4 +240,6 @@ const char* cublasGetErrorString(cublasStatus_t error)
     return "Unknown cublas status";
 }
 
+#endif  // CPU_ONLY
+
 }  // namespace ferrari
\ No newline at end of file
@@ -0,0 +1,1153 @@
+#include "cpu_functional.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "cuda_functional.hpp"
+#include "half.hpp"
+#include "math_functions.hpp"
+#include "parallel.hpp"
+
+namespace ferrari
+{
+namespace
+{
+
+// Minimum number of output elements handed to one host thread.
+const int64_t kMinElementsPerTask = 16384;
+
+// Samples one output pixel for every channel. plane is H_in * W_in and
+// out_stride is H_out * W_out; the arithmetic mirrors grid_sample_kernel.
+inline void grid_sample_pixel(const float* input,
+                              int64_t      plane,
+                              int          C,
+                              int          H_in,
+                              int          W_in,
+                              float        x,
+                              float        y,
+                              float*       output,
+                              int64_t      out_stride)
+{
+    float x_in = 0.5f * (x + 1.0f) * (W_in - 1);
+    float y_in = 0.5f * (y + 1.0f) * (H_in - 1);
+    float fx0  = std::floor(x_in);
+    float fy0  = std::floor(y_in);
+    float wx   = x_in - fx0;
+    float wy   = y_in - fy0;
+
+    // Compare in float so that NaN or huge coordinates never reach the int cast.
+    bool valid_x0 = (fx0 >= 0.0f && fx0 <= W_in - 1);
+    bool valid_x1 = (fx0 >= -1.0f && fx0 <= W_in - 2);
+    bool valid_y0 = (fy0 >= 0.0f && fy0 <= H_in - 1);
+    bool valid_y1 = (fy0 >= -1.0f && fy0 <= H_in - 2);
+    if (!((valid_x0 || valid_x1) && (valid_y0 || valid_y1)))
+    {
+        for (int c = 0; c < C; ++c)
+        {
+            output[c * out_stride] = 0.0f;
+        }
+        return;
+    }
+    int x0 = static_cast<int>(fx0);
+    int y0 = static_cast<int>(fy0);
+
+    for (int c = 0; c < C; ++c)
+    {
+        const float* src = input + c * plane;
+
+        float v00 = (valid_x0 && valid_y0) ? src[y0 * W_in + x0] : 0.0f;
+        float v01 = (valid_x0 && valid_y1) ? src[(y0 + 1) * W_in + x0] : 0.0f;
+        float v10 = (valid_x1 && valid_y0) ? src[y0 * W_in + x0 + 1] : 0.0f;
+        float v11 = (valid_x1 && valid_y1) ? src[(y0 + 1) * W_in + x0 + 1] : 0.0f;
+
+        float val_top          = v00 * (1 - wx) + v10 * wx;
+        float val_bottom       = v01 * (1 - wx) + v11 * wx;
+        output[c * out_stride] = val_top * (1 - wy) + val_bottom * wy;
+    }
+}
+
+#if defined(__AVX512F__)
+// Samples 16 output pixels per iteration with masked gathers. Returns the first
+// column left over for the scalar tail.
+int grid_sample_row_avx512(const float* input,
+                           int64_t      plane,
+                           int          C,
+                           int          H_in,
+                           int          W_in,
+                           const float* grid_row,
+                           int          W_out,
+                           float*       out_row,
+                           int64_t      out_stride)
+{
+    const __m512  zero    = _mm512_setzero_ps();
+    const __m512  one     = _mm512_set1_ps(1.0f);
+    const __m512  neg_one = _mm512_set1_ps(-1.0f);
+    const __m512  half    = _mm512_set1_ps(0.5f);
+    const __m512  w_last  = _mm512_set1_ps(static_cast<float>(W_in - 1));
+    const __m512  h_last  = _mm512_set1_ps(static_cast<float>(H_in - 1));
+    const __m512  w_last2 = _mm512_set1_ps(static_cast<float>(W_in - 2));
+    const __m512  h_last2 = _mm512_set1_ps(static_cast<float>(H_in - 2));
+    const __m512i stride  = _mm512_set1_epi32(W_in);
+    const __m512i one_i   = _mm512_set1_epi32(1);
+    const __m512i even =
+        _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i odd =
+        _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+
+    int w = 0;
+    for (; w + 16 <= W_out; w += 16)
+    {
+        // grid is interleaved (x, y); split it into one x and one y register.
+        const __m512 g0 = _mm512_loadu_ps(grid_row + 2 * w);
+        const __m512 g1 = _mm512_loadu_ps(grid_row + 2 * w + 16);
+        const __m512 x  = _mm512_permutex2var_ps(g0, even, g1);
+        const __m512 y  = _mm512_permutex2var_ps(g0, odd, g1);
+
+        const __m512 x_in = _mm512_mul_ps(_mm512_mul_ps(half, _mm512_add_ps(x, one)), w_last);
+        const __m512 y_in = _mm512_mul_ps(_mm512_mul_ps(half, _mm512_add_ps(y, one)), h_last);
+        const __m512 fx0  = _mm512_roundscale_ps(x_in, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const __m512 fy0  = _mm512_roundscale_ps(y_in, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const __m512 wx   = _mm512_sub_ps(x_in, fx0);
+        const __m512 wy   = _mm512_sub_ps(y_in, fy0);
+        const __m512 ax   = _mm512_sub_ps(one, wx);
+        const __m512 ay   = _mm512_sub_ps(one, wy);
+
+        const __mmask16 vx0 =
+            _mm512_cmp_ps_mask(fx0, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(fx0, w_last, _CMP_LE_OQ);
+        const __mmask16 vx1 = _mm512_cmp_ps_mask(fx0, neg_one, _CMP_GE_OQ) &
+                              _mm512_cmp_ps_mask(fx0, w_last2, _CMP_LE_OQ);
+        const __mmask16 vy0 =
+            _mm512_cmp_ps_mask(fy0, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(fy0, h_last, _CMP_LE_OQ);
+        const __mmask16 vy1 = _mm512_cmp_ps_mask(fy0, neg_one, _CMP_GE_OQ) &
+                              _mm512_cmp_ps_mask(fy0, h_last2, _CMP_LE_OQ);
+        const __mmask16 m00 = vx0 & vy0;
+        const __mmask16 m10 = vx1 & vy0;
+        const __mmask16 m01 = vx0 & vy1;
+        const __mmask16 m11 = vx1 & vy1;
+
+        // Lanes with out-of-range coordinates are masked off, so their indices
+        // are never dereferenced.
+        const __m512i i00 = _mm512_add_epi32(
+            _mm512_mullo_epi32(_mm512_cvttps_epi32(fy0), stride), _mm512_cvttps_epi32(fx0));
+        const __m512i i10 = _mm512_add_epi32(i00, one_i);
+        const __m512i i01 = _mm512_add_epi32(i00, stride);
+        const __m512i i11 = _mm512_add_epi32(i01, one_i);
+
+        for (int c = 0; c < C; ++c)
+        {
+            const float* src = input + c * plane;
+
+            const __m512 v00 = _mm512_mask_i32gather_ps(zero, m00, i00, src, 4);
+            const __m512 v10 = _mm512_mask_i32gather_ps(zero, m10, i10, src, 4);
+            const __m512 v01 = _mm512_mask_i32gather_ps(zero, m01, i01, src, 4);
+            const __m512 v11 = _mm512_mask_i32gather_ps(zero, m11, i11, src, 4);
+
+            const __m512 top    = _mm512_add_ps(_mm512_mul_ps(v00, ax), _mm512_mul_ps(v10, wx));
+            const __m512 bottom = _mm512_add_ps(_mm512_mul_ps(v01, ax), _mm512_mul_ps(v11, wx));
+            _mm512_storeu_ps(out_row + c * out_stride + w,
+                             _mm512_add_ps(_mm512_mul_ps(top, ay), _mm512_mul_ps(bottom, wy)));
+        }
+    }
+    return w;
+}
+#elif defined(__AVX2__)
+// Samples 8 output pixels per iteration with masked gathers. Returns the first
+// column left over for the scalar tail.
+int grid_sample_row_avx2(const float* input,
+                         int64_t      plane,
+                         int          C,
+                         int          H_in,
+                         int          W_in,
+                         const float* grid_row,
+                         int          W_out,
+                         float*       out_row,
+                         int64_t      out_stride)
+{
+    const __m256  zero    = _mm256_setzero_ps();
+    const __m256  one     = _mm256_set1_ps(1.0f);
+    const __m256  neg_one = _mm256_set1_ps(-1.0f);
+    const __m256  half    = _mm256_set1_ps(0.5f);
+    const __m256  w_last  = _mm256_set1_ps(static_cast<float>(W_in - 1));
+    const __m256  h_last  = _mm256_set1_ps(static_cast<float>(H_in - 1));
+    const __m256  w_last2 = _mm256_set1_ps(static_cast<float>(W_in - 2));
+    const __m256  h_last2 = _mm256_set1_ps(static_cast<float>(H_in - 2));
+    const __m256i stride  = _mm256_set1_epi32(W_in);
+    const __m256i one_i   = _mm256_set1_epi32(1);
+
+    int w = 0;
+    for (; w + 8 <= W_out; w += 8)
+    {
+        // grid is interleaved (x, y). shuffle_ps works per 128-bit lane and
+        // leaves the 64-bit pairs in 0, 2, 1, 3 order, which the permute fixes.
+        const __m256 g0 = _mm256_loadu_ps(grid_row + 2 * w);
+        const __m256 g1 = _mm256_loadu_ps(grid_row + 2 * w + 8);
+        const __m256 x  = _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(_mm256_shuffle_ps(g0, g1, _MM_SHUFFLE(2, 0, 2, 0))),
+            _MM_SHUFFLE(3, 1, 2, 0)));
+        const __m256 y  = _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(_mm256_shuffle_ps(g0, g1, _MM_SHUFFLE(3, 1, 3, 1))),
+            _MM_SHUFFLE(3, 1, 2, 0)));
+
+        const __m256 x_in = _mm256_mul_ps(_mm256_mul_ps(half, _mm256_add_ps(x, one)), w_last);
+        const __m256 y_in = _mm256_mul_ps(_mm256_mul_ps(half, _mm256_add_ps(y, one)), h_last);
+        const __m256 fx0  = _mm256_floor_ps(x_in);
+        const __m256 fy0  = _mm256_floor_ps(y_in);
+        const __m256 wx   = _mm256_sub_ps(x_in, fx0);
+        const __m256 wy   = _mm256_sub_ps(y_in, fy0);
+        const __m256 ax   = _mm256_sub_ps(one, wx);
+        const __m256 ay   = _mm256_sub_ps(one, wy);
+
+        const __m256 vx0 = _mm256_and_ps(_mm256_cmp_ps(fx0, zero, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(fx0, w_last, _CMP_LE_OQ));
+        const __m256 vx1 = _mm256_and_ps(_mm256_cmp_ps(fx0, neg_one, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(fx0, w_last2, _CMP_LE_OQ));
+        const __m256 vy0 = _mm256_and_ps(_mm256_cmp_ps(fy0, zero, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(fy0, h_last, _CMP_LE_OQ));
+        const __m256 vy1 = _mm256_and_ps(_mm256_cmp_ps(fy0, neg_one, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(fy0, h_last2, _CMP_LE_OQ));
+        const __m256 m00 = _mm256_and_ps(vx0, vy0);
+        const __m256 m10 = _mm256_and_ps(vx1, vy0);
+        const __m256 m01 = _mm256_and_ps(vx0, vy1);
+        const __m256 m11 = _mm256_and_ps(vx1, vy1);
+
+        // Lanes with out-of-range coordinates are masked off, so their indices
+        // are never dereferenced.
+        const __m256i i00 = _mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_cvttps_epi32(fy0), stride), _mm256_cvttps_epi32(fx0));
+        const __m256i i10 = _mm256_add_epi32(i00, one_i);
+        const __m256i i01 = _mm256_add_epi32(i00, stride);
+        const __m256i i11 = _mm256_add_epi32(i01, one_i);
+
+        for (int c = 0; c < C; ++c)
+        {
+            const float* src = input + c * plane;
+
+            const __m256 v00 = _mm256_mask_i32gather_ps(zero, src, i00, m00, 4);
+            const __m256 v10 = _mm256_mask_i32gather_ps(zero, src, i10, m10, 4);
+            const __m256 v01 = _mm256_mask_i32gather_ps(zero, src, i01, m01, 4);
+            const __m256 v11 = _mm256_mask_i32gather_ps(zero, src, i11, m11, 4);
+
+            const __m256 top    = _mm256_add_ps(_mm256_mul_ps(v00, ax), _mm256_mul_ps(v10, wx));
+            const __m256 bottom = _mm256_add_ps(_mm256_mul_ps(v01, ax), _mm256_mul_ps(v11, wx));
+            _mm256_storeu_ps(out_row + c * out_stride + w,
+                             _mm256_add_ps(_mm256_mul_ps(top, ay), _mm256_mul_ps(bottom, wy)));
+        }
+    }
+    return w;
+}
+#endif
+
+// One level of 2x2 average pooling for a single query plane. The sums are
+// grouped the same way in the SIMD and scalar paths.
+void avg_pool2x2_plane(const float* src, int H, int W, float* dst, int out_h, int out_w)
+{
+    for (int y = 0; y < out_h; ++y)
+    {
+        const float* row0 = src + 2 * y * W;
+        const float* row1 = row0 + W;
+        float*       out  = dst + y * out_w;
+
+        int x = 0;
+#if defined(__AVX2__)
+        const __m256 quarter = _mm256_set1_ps(0.25f);
+        for (; x + 8 <= out_w; x += 8)
+        {
+            const __m256 s0 =
+                _mm256_add_ps(_mm256_loadu_ps(row0 + 2 * x), _mm256_loadu_ps(row1 + 2 * x));
+            const __m256 s1 = _mm256_add_ps(_mm256_loadu_ps(row0 + 2 * x + 8),
+                                            _mm256_loadu_ps(row1 + 2 * x + 8));
+            // hadd leaves the 64-bit pairs in 0, 2, 1, 3 order.
+            const __m256 pairs = _mm256_hadd_ps(s0, s1);
+            const __m256 sum   = _mm256_castpd_ps(
+                _mm256_permute4x64_pd(_mm256_castps_pd(pairs), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_ps(out + x, _mm256_mul_ps(sum, quarter));
+        }
+#endif
+        for (; x < out_w; ++x)
+        {
+            float left  = row0[2 * x] + row1[2 * x];
+            float right = row0[2 * x + 1] + row1[2 * x + 1];
+            out[x]      = 0.25f * (left + right);
+        }
+    }
+}
+
+// Level planes seen as float. Float planes are used in place; 16-bit planes
+// are widened into per-thread scratch, pooled there and narrowed once on
+// store, so coarser levels are pooled from unrounded values.
+inline const float* widen_plane(const float* src, int64_t, float*)
+{
+    return src;
+}
+
+template <typename Dtype>
+inline const float* widen_plane(const Dtype* src, int64_t count, float* scratch)
+{
+    caffe_cpu_convert(count, src, scratch);
+    return scratch;
+}
+
+inline float* pool_target(float* dst, float*)
+{
+    return dst;
+}
+
+template <typename Dtype>
+inline float* pool_target(Dtype*, float* scratch)
+{
+    return scratch;
+}
+
+inline void narrow_plane(const float*, int64_t, float*) {}
+
+template <typename Dtype>
+inline void narrow_plane(const float* src, int64_t count, Dtype* dst)
+{
+    caffe_cpu_convert(count, src, dst);
+}
+
+// Places the (2r+2)^2 integer patch under the (2r+1)^2 window around (x, y).
+// Window offsets are whole pixels, so every tap shares the fractional weights
+// (wx, wy). Returns false when the whole window misses the H x W plane or the
+// coordinate is not finite; the window is then all zeros.
+inline bool place_window(float  x,
+                         float  y,
+                         int    H,
+                         int    W,
+                         int    radius,
+                         int*   x0,
+                         int*   y0,
+                         float* wx,
+                         float* wy)
+{
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    if (!(fx >= -radius - 1 && fx <= W - 1 + radius && fy >= -radius - 1 && fy <= H - 1 + radius))
+    {
+        return false;
+    }
+    *wx = x - fx;
+    *wy = y - fy;
+    *x0 = static_cast<int>(fx) - radius;
+    *y0 = static_cast<int>(fy) - radius;
+    return true;
+}
+
+inline void zero_window(int radius, float* output, int64_t out_stride)
+{
+    const int K = 2 * radius + 1;
+    for (int k = 0; k < K * K; ++k)
+    {
+        output[k * out_stride] = 0.0f;
+    }
+}
+
+// Blends the (2r+2)^2 patch into the (2r+1)^2 window. out_stride is the
+// distance between consecutive window channels in the output.
+inline void blend_window(const float* patch,
+                         int          radius,
+                         float        wx,
+                         float        wy,
+                         float*       output,
+                         int64_t      out_stride)
+{
+    const int K = 2 * radius + 1;
+    const int P = K + 1;
+    for (int a = 0; a < K; ++a)
+    {
+        const float* row0 = patch + a * P;
+        const float* row1 = row0 + P;
+        for (int b = 0; b < K; ++b)
+        {
+            float val_top                    = row0[b] * (1 - wx) + row0[b + 1] * wx;
+            float val_bottom                 = row1[b] * (1 - wx) + row1[b + 1] * wx;
+            output[(a * K + b) * out_stride] = val_top * (1 - wy) + val_bottom * wy;
+        }
+    }
+}
+
+// Bilinearly samples the window around (x, y) of one query plane of the
+// correlation volume. The patch is read once, zero outside the plane, and
+// widened to float before blending.
+template <typename Dtype>
+void lookup_window(const Dtype* plane,
+                   int          H,
+                   int          W,
+                   float        x,
+                   float        y,
+                   int          radius,
+                   float*       patch,
+                   float*       output,
+                   int64_t      out_stride)
+{
+    const int P = 2 * radius + 2;
+
+    int   x0, y0;
+    float wx, wy;
+    if (!place_window(x, y, H, W, radius, &x0, &y0, &wx, &wy))
+    {
+        zero_window(radius, output, out_stride);
+        return;
+    }
+
+    if (x0 >= 0 && y0 >= 0 && x0 + P <= W && y0 + P <= H)
+    {
+        for (int py = 0; py < P; ++py)
+        {
+            caffe_cpu_convert(P, plane + (y0 + py) * W + x0, patch + py * P);
+        }
+    }
+    else
+    {
+        for (int py = 0; py < P; ++py)
+        {
+            const int yy = y0 + py;
+            for (int px = 0; px < P; ++px)
+            {
+                const int  xx      = x0 + px;
+                const bool inside  = (yy >= 0 && yy < H && xx >= 0 && xx < W);
+                patch[py * P + px] = inside ? static_cast<float>(plane[yy * W + xx]) : 0.0f;
+            }
+        }
+    }
+
+    blend_window(patch, radius, wx, wy, output, out_stride);
+}
+
+inline float dot_product(const float* a, const float* b, int n)
+{
+    int   i   = 0;
+    float sum = 0.0f;
+#if defined(__AVX512F__)
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    sum = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+#elif defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128       s4  = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s4               = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+    s4               = _mm_add_ss(s4, _mm_movehdup_ps(s4));
+    sum              = _mm_cvtss_f32(s4);
+#endif
+    for (; i < n; ++i)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Same window as lookup_window, but every patch value is computed on demand
+// as the scaled dot product between the query feature f1 and the pooled
+// fmap2 feature under it. fmap2 is one [H, W, D] level of one batch element.
+void lookup_window_on_demand(const float* f1,
+                             const float* fmap2,
+                             int          H,
+                             int          W,
+                             int          D,
+                             float        scale,
+                             float        x,
+                             float        y,
+                             int          radius,
+                             float*       patch,
+                             float*       output,
+                             int64_t      out_stride)
+{
+    const int P = 2 * radius + 2;
+
+    int   x0, y0;
+    float wx, wy;
+    if (!place_window(x, y, H, W, radius, &x0, &y0, &wx, &wy))
+    {
+        zero_window(radius, output, out_stride);
+        return;
+    }
+
+    for (int py = 0; py < P; ++py)
+    {
+        const int yy = y0 + py;
+        for (int px = 0; px < P; ++px)
+        {
+            const int xx = x0 + px;
+            if (yy >= 0 && yy < H && xx >= 0 && xx < W)
+            {
+                const float* f2    = fmap2 + (static_cast<int64_t>(yy) * W + xx) * D;
+                patch[py * P + px] = scale * dot_product(f1, f2, D);
+            }
+            else
+            {
+                patch[py * P + px] = 0.0f;
+            }
+        }
+    }
+
+    blend_window(patch, radius, wx, wy, output, out_stride);
+}
+
+
+// Edge of the square cache blocks a plane is transposed in. A 64 x 64 block
+// of floats (16 KB) and its destination stay in L1 while the register tiles
+// inside it are moved.
+const int kTransposeBlock = 64;
+
+// dst (cols x rows, leading dimension ldd) = src (rows x cols, leading
+// dimension lds) transposed, element by element.
+template <typename Dtype>
+inline void transpose_scalar(
+    const Dtype* src, int64_t lds, Dtype* dst, int64_t ldd, int rows, int cols)
+{
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            dst[j * ldd + i] = src[i * lds + j];
+        }
+    }
+}
+
+#if defined(__AVX512F__)
+// 16 x 16 tile through registers: interleave pairs of rows, then 64-bit
+// pairs, then 128-bit lanes twice.
+inline void transpose_16x16(const float* src, int64_t lds, float* dst, int64_t ldd)
+{
+    __m512 r[16], t[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        r[i] = _mm512_loadu_ps(src + i * lds);
+    }
+    for (int i = 0; i < 16; i += 2)
+    {
+        t[i]     = _mm512_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 16; i += 4)
+    {
+        r[i]     = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 1] = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[i + 2] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 3] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int i = 0; i < 16; i += 8)
+    {
+        for (int j = 0; j < 4; ++j)
+        {
+            t[i + j]     = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0x88);
+            t[i + j + 4] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0xdd);
+        }
+    }
+    for (int j = 0; j < 8; ++j)
+    {
+        r[j]     = _mm512_shuffle_f32x4(t[j], t[j + 8], 0x88);
+        r[j + 8] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0xdd);
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        _mm512_storeu_ps(dst + i * ldd, r[i]);
+    }
+}
+#endif
+
+#if defined(__AVX2__)
+// 8 x 8 tile through registers: unpack, 64-bit shuffles, 128-bit permutes.
+inline void transpose_8x8(const float* src, int64_t lds, float* dst, int64_t ldd)
+{
+    __m256 r[8], t[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        r[i] = _mm256_loadu_ps(src + i * lds);
+    }
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i]     = _mm256_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4)
+    {
+        r[i]     = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        _mm256_storeu_ps(dst + i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+        _mm256_storeu_ps(dst + (i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+    }
+}
+#endif
+
+// One cache block: full register tiles where they fit, scalar edges.
+template <typename Dtype>
+inline void transpose_block(
+    const Dtype* src, int64_t lds, Dtype* dst, int64_t ldd, int rows, int cols)
+{
+    transpose_scalar(src, lds, dst, ldd, rows, cols);
+}
+
+inline void transpose_block(
+    const float* src, int64_t lds, float* dst, int64_t ldd, int rows, int cols)
+{
+#if defined(__AVX512F__)
+    const int kTile = 16;
+#elif defined(__AVX2__)
+    const int kTile = 8;
+#else
+    const int kTile = 1;
+#endif
+    const int full_rows = rows / kTile * kTile;
+    const int full_cols = cols / kTile * kTile;
+    for (int i = 0; i < full_rows && kTile > 1; i += kTile)
+    {
+        for (int j = 0; j < full_cols; j += kTile)
+        {
+#if defined(__AVX512F__)
+            transpose_16x16(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+#elif defined(__AVX2__)
+            transpose_8x8(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+#endif
+        }
+    }
+    if (kTile == 1)
+    {
+        transpose_scalar(src, lds, dst, ldd, rows, cols);
+        return;
+    }
+    // Right edge of the full rows, then the bottom rows.
+    transpose_scalar(
+        src + full_cols, lds, dst + full_cols * ldd, ldd, full_rows, cols - full_cols);
+    transpose_scalar(src + full_rows * lds, lds, dst + full_rows, ldd, rows - full_rows, cols);
+}
+
+}  // namespace
+
+int grid_sample_cpu(const std::shared_ptr<Blob<float>>& input,
+                    const std::shared_ptr<Blob<float>>& grid,
+                    std::shared_ptr<Blob<float>>&       output)
+{
+    const int N    = input->shape(0);
+    const int C    = input->shape(1);
+    const int H_in = input->shape(2);
+    const int W_in = input->shape(3);
+
+    const int H_out = grid->shape(1);
+    const int W_out = grid->shape(2);
+    CHECK_EQ(grid->shape(0), N);
+    CHECK_EQ(grid->shape(3), 2);
+    CHECK_EQ(output->count(), static_cast<int64_t>(N) * C * H_out * W_out);
+    CHECK_EQ(input->layout(), LAYOUT_NCHW) << "grid_sample samples NCHW planes";
+
+    const int64_t plane      = static_cast<int64_t>(H_in) * W_in;
+    const int64_t out_stride = static_cast<int64_t>(H_out) * W_out;
+
+    const float* in_data   = input->cpu_data();
+    const float* grid_data = grid->cpu_data();
+    float*       out_data  = output->mutable_cpu_data();
+
+    const int64_t grain = std::max<int64_t>(1, kMinElementsPerTask / std::max(1, C * W_out));
+    parallel_for(0,
+                 static_cast<int64_t>(N) * H_out,
+                 grain,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     for (int64_t row = begin; row < end; ++row)
+                     {
+                         const int64_t n        = row / H_out;
+                         const int64_t h        = row % H_out;
+                         const float*  in_n     = in_data + n * C * plane;
+                         const float*  grid_row = grid_data + row * W_out * 2;
+                         float*        out_row  = out_data + n * C * out_stride + h * W_out;
+
+                         int w = 0;
+#if defined(__AVX512F__)
+                         w = grid_sample_row_avx512(
+                             in_n, plane, C, H_in, W_in, grid_row, W_out, out_row, out_stride);
+#elif defined(__AVX2__)
+                         w = grid_sample_row_avx2(
+                             in_n, plane, C, H_in, W_in, grid_row, W_out, out_row, out_stride);
+#endif
+                         for (; w < W_out; ++w)
+                         {
+                             grid_sample_pixel(in_n,
+                                               plane,
+                                               C,
+                                               H_in,
+                                               W_in,
+                                               grid_row[2 * w],
+                                               grid_row[2 * w + 1],
+                                               out_row + w,
+                                               out_stride);
+                         }
+                     }
+                 });
+
+    return 0;
+}
+
+template <typename Dtype>
+int build_corr_pyramid_cpu(const std::vector<std::shared_ptr<Blob<Dtype>>>& pyramid)
+{
+    const int num_levels = pyramid.size();
+    CHECK_GE(num_levels, 1);
+
+    const int N = pyramid[0]->shape(0);
+    CHECK_EQ(pyramid[0]->shape(1), 1);
+
+    const Dtype*        src0 = pyramid[0]->cpu_data();
+    std::vector<Dtype*> dst(num_levels);
+    std::vector<int>    H(num_levels), W(num_levels);
+    for (int i = 0; i < num_levels; ++i)
+    {
+        H[i] = pyramid[i]->shape(2);
+        W[i] = pyramid[i]->shape(3);
+        if (i == 0)
+        {
+            continue;
+        }
+        CHECK_EQ(pyramid[i]->shape(0), N);
+        CHECK_EQ(H[i], H[i - 1] / 2);
+        CHECK_EQ(W[i], W[i - 1] / 2);
+        dst[i] = pyramid[i]->mutable_cpu_data();
+    }
+
+    const bool in_place = std::is_same<Dtype, float>::value;
+
+    const int64_t grain = std::max<int64_t>(1, kMinElementsPerTask / std::max(1, H[0] * W[0]));
+    parallel_for(0,
+                 N,
+                 grain,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     std::vector<std::vector<float>> scratch(num_levels);
+                     for (int i = 0; !in_place && i < num_levels; ++i)
+                     {
+                         scratch[i].resize(static_cast<int64_t>(H[i]) * W[i]);
+                     }
+                     for (int64_t n = begin; n < end; ++n)
+                     {
+                         const int64_t plane0 = static_cast<int64_t>(H[0]) * W[0];
+                         const float*  prev =
+                             widen_plane(src0 + n * plane0, plane0, scratch[0].data());
+                         for (int i = 1; i < num_levels; ++i)
+                         {
+                             const int64_t out_plane = static_cast<int64_t>(H[i]) * W[i];
+                             Dtype*        dst_n     = dst[i] + n * out_plane;
+                             float*        out       = pool_target(dst_n, scratch[i].data());
+                             avg_pool2x2_plane(prev, H[i - 1], W[i - 1], out, H[i], W[i]);
+                             narrow_plane(out, out_plane, dst_n);
+                             prev = out;
+                         }
+                     }
+                 });
+
+    return 0;
+}
+
+template <typename Dtype>
+int corr_lookup_cpu(const std::vector<std::shared_ptr<Blob<Dtype>>>& pyramid,
+                    const float*                                     coords,
+                    int                                              batch,
+                    int                                              ht,
+                    int                                              wd,
+                    int                                              radius,
+                    float*                                           output)
+{
+    const int num_levels = pyramid.size();
+    const int K          = 2 * radius + 1;
+    CHECK_GE(num_levels, 1);
+    CHECK_GE(radius, 0);
+
+    const int64_t hw = static_cast<int64_t>(ht) * wd;
+
+    std::vector<const Dtype*> planes(num_levels);
+    std::vector<int>          H(num_levels), W(num_levels);
+    for (int i = 0; i < num_levels; ++i)
+    {
+        CHECK_EQ(pyramid[i]->shape(0), batch * hw);
+        planes[i] = pyramid[i]->cpu_data();
+        H[i]      = pyramid[i]->shape(2);
+        W[i]      = pyramid[i]->shape(3);
+    }
+
+    const int64_t grain =
+        std::max<int64_t>(1, kMinElementsPerTask / std::max(1, num_levels * K * K * wd));
+    parallel_for(0,
+                 static_cast<int64_t>(batch) * ht,
+                 grain,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     std::vector<float> patch((K + 1) * (K + 1));
+                     for (int64_t row = begin; row < end; ++row)
+                     {
+                         const int64_t n   = row / ht;
+                         const int64_t h   = row % ht;
+                         const float*  cx  = coords + (n * 2) * hw + h * wd;
+                         const float*  cy  = cx + hw;
+                         float*        out = output + n * num_levels * K * K * hw + h * wd;
+                         for (int w = 0; w < wd; ++w)
+                         {
+                             const int64_t query = row * wd + w;
+                             float         scale = 1.0f;
+                             for (int i = 0; i < num_levels; ++i)
+                             {
+                                 const int64_t plane = static_cast<int64_t>(H[i]) * W[i];
+                                 lookup_window(planes[i] + query * plane,
+                                               H[i],
+                                               W[i],
+                                               cx[w] * scale,
+                                               cy[w] * scale,
+                                               radius,
+                                               patch.data(),
+                                               out + i * K * K * hw + w,
+                                               hw);
+                                 scale *= 0.5f;
+                             }
+                         }
+                     }
+                 });
+
+    return 0;
+}
+
+template int build_corr_pyramid_cpu<float>(const std::vector<std::shared_ptr<Blob<float>>>&);
+template int build_corr_pyramid_cpu<float16>(const std::vector<std::shared_ptr<Blob<float16>>>&);
+template int build_corr_pyramid_cpu<bfloat16>(
+    const std::vector<std::shared_ptr<Blob<bfloat16>>>&);
+
+template int corr_lookup_cpu<float>(
+    const std::vector<std::shared_ptr<Blob<float>>>&, const float*, int, int, int, int, float*);
+template int corr_lookup_cpu<float16>(
+    const std::vector<std::shared_ptr<Blob<float16>>>&, const float*, int, int, int, int, float*);
+template int corr_lookup_cpu<bfloat16>(
+    const std::vector<std::shared_ptr<Blob<bfloat16>>>&, const float*, int, int, int, int, float*);
+
+int build_feature_pyramid_cpu(const std::shared_ptr<Blob<float>>&              fmap,
+                              const std::vector<std::shared_ptr<Blob<float>>>& pyramid)
+{
+    const int num_levels = pyramid.size();
+    CHECK_GE(num_levels, 1);
+
+    // An NHWC fmap is already [B, H, W, D] and level 0 is a plain copy.
+    const bool nhwc = fmap->layout() == LAYOUT_NHWC;
+    const int  B    = fmap->shape(0);
+    const int  D    = fmap->shape(nhwc ? 3 : 1);
+    const int  H    = fmap->shape(nhwc ? 1 : 2);
+    const int  W    = fmap->shape(nhwc ? 2 : 3);
+    CHECK_EQ(pyramid[0]->shape(0), B);
+    CHECK_EQ(pyramid[0]->shape(1), H);
+    CHECK_EQ(pyramid[0]->shape(2), W);
+    CHECK_EQ(pyramid[0]->shape(3), D);
+
+    // Level 0: per batch element transpose [D, HW] -> [HW, D].
+    if (nhwc)
+    {
+        caffe_copy(fmap->count(), fmap->cpu_data(), pyramid[0]->mutable_cpu_data());
+    }
+    else
+    {
+        transpose_cpu(B, D, H * W, fmap->cpu_data(), pyramid[0]->mutable_cpu_data());
+    }
+    pyramid[0]->set_layout(LAYOUT_NHWC);
+
+    // Coarser levels: 2x2 average pool over [H, W], contiguous along D.
+    for (int i = 1; i < num_levels; ++i)
+    {
+        const int in_h  = pyramid[i - 1]->shape(1);
+        const int in_w  = pyramid[i - 1]->shape(2);
+        const int out_h = pyramid[i]->shape(1);
+        const int out_w = pyramid[i]->shape(2);
+        CHECK_EQ(pyramid[i]->shape(0), B);
+        CHECK_EQ(out_h, in_h / 2);
+        CHECK_EQ(out_w, in_w / 2);
+        CHECK_EQ(pyramid[i]->shape(3), D);
+        pyramid[i]->set_layout(LAYOUT_NHWC);
+
+        const float* level_in  = pyramid[i - 1]->cpu_data();
+        float*       level_out = pyramid[i]->mutable_cpu_data();
+        parallel_for(0,
+                     static_cast<int64_t>(B) * out_h,
+                     1,
+                     [&](int64_t begin, int64_t end)
+                     {
+                         for (int64_t row = begin; row < end; ++row)
+                         {
+                             const int64_t b    = row / out_h;
+                             const int64_t y    = row % out_h;
+                             const float*  row0 = level_in + ((b * in_h + 2 * y) * in_w) * D;
+                             const float*  row1 = row0 + static_cast<int64_t>(in_w) * D;
+                             float*        out  = level_out + row * out_w * D;
+                             for (int x = 0; x < out_w; ++x)
+                             {
+                                 const float* p00 = row0 + 2 * x * D;
+                                 const float* p10 = row1 + 2 * x * D;
+                                 for (int d = 0; d < D; ++d)
+                                 {
+                                     float left     = p00[d] + p10[d];
+                                     float right    = p00[D + d] + p10[D + d];
+                                     out[x * D + d] = 0.25f * (left + right);
+                                 }
+                             }
+                         }
+                     });
+    }
+
+    return 0;
+}
+
+int corr_lookup_on_demand_cpu(const std::shared_ptr<Blob<float>>&              fmap1,
+                              const std::vector<std::shared_ptr<Blob<float>>>& fmap2_pyramid,
+                              const float*                                     coords,
+                              int                                              radius,
+                              float*                                           output)
+{
+    const int num_levels = fmap2_pyramid.size();
+    const int K          = 2 * radius + 1;
+    CHECK_GE(num_levels, 1);
+    CHECK_GE(radius, 0);
+
+    CHECK_EQ(fmap1->layout(), LAYOUT_NHWC) << "fmap1 must come from build_feature_pyramid_cpu";
+
+    const int     batch = fmap1->shape(0);
+    const int     ht    = fmap1->shape(1);
+    const int     wd    = fmap1->shape(2);
+    const int     D     = fmap1->shape(3);
+    const int64_t hw    = static_cast<int64_t>(ht) * wd;
+    const float   scale = 1.0f / std::sqrt(static_cast<float>(D));
+
+    std::vector<const float*> levels(num_levels);
+    std::vector<int>          H(num_levels), W(num_levels);
+    for (int i = 0; i < num_levels; ++i)
+    {
+        CHECK_EQ(fmap2_pyramid[i]->shape(0), batch);
+        CHECK_EQ(fmap2_pyramid[i]->shape(3), D);
+        CHECK_EQ(fmap2_pyramid[i]->layout(), LAYOUT_NHWC);
+        levels[i] = fmap2_pyramid[i]->cpu_data();
+        H[i]      = fmap2_pyramid[i]->shape(1);
+        W[i]      = fmap2_pyramid[i]->shape(2);
+    }
+    const float* f1_data = fmap1->cpu_data();
+
+    parallel_for(0,
+                 static_cast<int64_t>(batch) * ht,
+                 1,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     std::vector<float> patch((K + 1) * (K + 1));
+                     for (int64_t row = begin; row < end; ++row)
+                     {
+                         const int64_t n   = row / ht;
+                         const int64_t h   = row % ht;
+                         const float*  cx  = coords + (n * 2) * hw + h * wd;
+                         const float*  cy  = cx + hw;
+                         float*        out = output + n * num_levels * K * K * hw + h * wd;
+                         for (int w = 0; w < wd; ++w)
+                         {
+                             const float* f1    = f1_data + (row * wd + w) * D;
+                             float        level = 1.0f;
+                             for (int i = 0; i < num_levels; ++i)
+                             {
+                                 const int64_t plane = static_cast<int64_t>(H[i]) * W[i];
+                                 lookup_window_on_demand(f1,
+                                                         levels[i] + n * plane * D,
+                                                         H[i],
+                                                         W[i],
+                                                         D,
+                                                         scale,
+                                                         cx[w] * level,
+                                                         cy[w] * level,
+                                                         radius,
+                                                         patch.data(),
+                                                         out + i * K * K * hw + w,
+                                                         hw);
+                                 level *= 0.5f;
+                             }
+                         }
+                     }
+                 });
+
+    return 0;
+}
+
+template <typename Dtype>
+void transpose_cpu(int64_t batch, int rows, int cols, const Dtype* src, Dtype* dst)
+{
+    CHECK_NE(src, dst) << "transpose_cpu does not work in place";
+    const int64_t plane       = static_cast<int64_t>(rows) * cols;
+    const int64_t row_blocks  = (rows + kTransposeBlock - 1) / kTransposeBlock;
+    const int64_t block_elems = static_cast<int64_t>(kTransposeBlock) * std::max(cols, 1);
+
+    // One task is a strip of kTransposeBlock source rows across all columns.
+    parallel_for(0,
+                 batch * row_blocks,
+                 std::max<int64_t>(1, kMinElementsPerTask / block_elems),
+                 [&](int64_t begin, int64_t end)
+                 {
+                     for (int64_t t = begin; t < end; ++t)
+                     {
+                         const int64_t b   = t / row_blocks;
+                         const int     i0  = static_cast<int>(t % row_blocks) * kTransposeBlock;
+                         const int     nr  = std::min(kTransposeBlock, rows - i0);
+                         const Dtype*  in  = src + b * plane + static_cast<int64_t>(i0) * cols;
+                         Dtype*        out = dst + b * plane + i0;
+                         for (int j0 = 0; j0 < cols; j0 += kTransposeBlock)
+                         {
+                             const int nc = std::min(kTransposeBlock, cols - j0);
+                             transpose_block(in + j0,
+                                             cols,
+                                             out + static_cast<int64_t>(j0) * rows,
+                                             rows,
+                                             nr,
+                                             nc);
+                         }
+                     }
+                 });
+}
+
+template void transpose_cpu<float>(int64_t, int, int, const float*, float*);
+template void transpose_cpu<float16>(int64_t, int, int, const float16*, float16*);
+template void transpose_cpu<bfloat16>(int64_t, int, int, const bfloat16*, bfloat16*);
+
+template <typename Dtype>
+int convert_layout_cpu(const Blob<Dtype>& src, BlobLayout layout, Blob<Dtype>* dst)
+{
+    CHECK_EQ(src.num_axes(), 4) << "layouts are defined for 4-D blobs";
+    CHECK_NE(&src, dst);
+    if (src.layout() == layout)
+    {
+        // CopyFrom only reshapes (and takes the tag) when the shapes differ.
+        dst->CopyFrom(src, true);
+        dst->set_layout(layout);
+        return 0;
+    }
+
+    // NCHW -> NHWC transposes [C, H*W] per batch element, NHWC -> NCHW [H*W, C].
+    const int N = src.shape(0);
+    if (layout == LAYOUT_NHWC)
+    {
+        const int C = src.shape(1), H = src.shape(2), W = src.shape(3);
+        dst->Reshape(std::vector<int>({N, H, W, C}));
+        transpose_cpu<Dtype>(N, C, H * W, src.cpu_data(), dst->mutable_cpu_data());
+    }
+    else
+    {
+        const int H = src.shape(1), W = src.shape(2), C = src.shape(3);
+        dst->Reshape(std::vector<int>({N, C, H, W}));
+        transpose_cpu<Dtype>(N, H * W, C, src.cpu_data(), dst->mutable_cpu_data());
+    }
+    dst->set_layout(layout);
+    return 0;
+}
+
+template int convert_layout_cpu<float>(const Blob<float>&, BlobLayout, Blob<float>*);
+template int convert_layout_cpu<float16>(const Blob<float16>&, BlobLayout, Blob<float16>*);
+template int convert_layout_cpu<bfloat16>(const Blob<bfloat16>&, BlobLayout, Blob<bfloat16>*);
+
+#ifdef CPU_ONLY
+// CPU_ONLY builds do not compile cuda_functional.cu; the entry points of
+// cuda_functional.hpp are defined here on the host with the same semantics.
+
+int grid_sample(std::shared_ptr<Blob<float>>& input,
+                std::shared_ptr<Blob<float>>& grid,
+                std::shared_ptr<Blob<float>>& output)
+{
+    return grid_sample_cpu(input, grid, output);
+}
+
+void create_delta(std::shared_ptr<Blob<float>>& delta, int r)
+{
+    const int size = 2 * r + 1;
+    float*    d    = delta->mutable_cpu_data();
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            const int idx  = y * size + x;
+            d[idx * 2]     = -r + x * (2.0f * r / (size - 1));
+            d[idx * 2 + 1] = -r + y * (2.0f * r / (size - 1));
+        }
+    }
+}
+
+void create_coords_grid(std::shared_ptr<Blob<float>>& coords)
+{
+    const int w = coords->shape(0);
+    const int h = coords->shape(1);
+    float*    c = coords->mutable_cpu_data();
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            const int idx  = y * w + x;
+            c[idx * 2]     = x;
+            c[idx * 2 + 1] = y;
+        }
+    }
+}
+
+void broadcast_add(const std::shared_ptr<Blob<float>>& coords,
+                   const std::shared_ptr<Blob<float>>& delta,
+                   int                                 iter,
+                   int                                 W,
+                   int                                 H,
+                   std::shared_ptr<Blob<float>>&       output)
+{
+    const float   scale     = 1.0f / std::pow(2, (iter - 1));
+    const int64_t len       = coords->count() / 2;
+    const int     delta_len = delta->count() / 2;
+    const float   x_factor  = 2.0f / (W - 1);
+    const float   y_factor  = 2.0f / (H - 1);
+
+    const float* c   = coords->cpu_data();
+    const float* d   = delta->cpu_data();
+    float*       out = output->mutable_cpu_data();
+    parallel_for(0,
+                 len,
+                 std::max<int64_t>(1, kMinElementsPerTask / std::max(1, 2 * delta_len)),
+                 [&](int64_t begin, int64_t end)
+                 {
+                     for (int64_t idx = begin; idx < end; ++idx)
+                     {
+                         const float x = c[2 * idx] * scale;
+                         const float y = c[2 * idx + 1] * scale;
+                         float*      o = out + 2 * delta_len * idx;
+                         for (int i = 0; i < delta_len; ++i)
+                         {
+                             o[2 * i]     = x_factor * (x + d[2 * i]) - 1.0f;
+                             o[2 * i + 1] = y_factor * (y + d[2 * i + 1]) - 1.0f;
+                         }
+                     }
+                 });
+}
+
+int convert_layout(const std::shared_ptr<Blob<float>>& input,
+                   BlobLayout                          layout,
+                   std::shared_ptr<Blob<float>>&       output)
+{
+    return convert_layout_cpu(*input, layout, output.get());
+}
+#endif  // CPU_ONLY
+
+}  // namespace ferrari
@@ -0,0 +1,418 @@
+#include "cpu_gemm.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "parallel.hpp"
+
+namespace ferrari
+{
+namespace
+{
+
+// Register block of C computed by one microkernel call.
+#if defined(__AVX512F__)
+const int kMR = 6;
+const int kNR = 32;
+#elif defined(__AVX2__) && defined(__FMA__)
+const int kMR = 6;
+const int kNR = 16;
+#else
+const int kMR = 4;
+const int kNR = 8;
+#endif
+
+// Cache blocking: a kKC x kNR strip of packed B stays in L1 while it sweeps a
+// kMC x kKC block of packed A held in L2. kMC and kNC are multiples of kMR/kNR.
+const int kKC = 256;
+const int kMC = 96;
+const int kNC = 256;
+
+// Packs rows [i0, i0 + mc) x columns [p0, p0 + kc) of op(A) into kMR-row
+// panels stored k-major (kc x kMR). The last panel is zero-padded.
+void pack_a(const bool   trans_a,
+            const int    M,
+            const int    K,
+            const float* A,
+            const int    i0,
+            const int    mc,
+            const int    p0,
+            const int    kc,
+            float*       packed)
+{
+    for (int ir = 0; ir < mc; ir += kMR)
+    {
+        const int mr = std::min(kMR, mc - ir);
+        for (int p = 0; p < kc; ++p)
+        {
+            const int64_t k = p0 + p;
+            for (int r = 0; r < mr; ++r)
+            {
+                const int64_t i = i0 + ir + r;
+                packed[r]       = trans_a ? A[k * M + i] : A[i * K + k];
+            }
+            std::fill(packed + mr, packed + kMR, 0.0f);
+            packed += kMR;
+        }
+    }
+}
+
+// Packs rows [p0, p0 + kc) x columns [j0, j0 + kNR) of op(B) into one kNR-column
+// panel stored k-major (kc x kNR). Columns past N are zero-padded.
+void pack_b(const bool   trans_b,
+            const int    N,
+            const int    K,
+            const float* B,
+            const int    p0,
+            const int    kc,
+            const int    j0,
+            float*       packed)
+{
+    const int nr = std::min(kNR, N - j0);
+    for (int p = 0; p < kc; ++p)
+    {
+        const int64_t k = p0 + p;
+        for (int c = 0; c < nr; ++c)
+        {
+            const int64_t j = j0 + c;
+            packed[c]       = trans_b ? B[j * K + k] : B[k * N + j];
+        }
+        std::fill(packed + nr, packed + kNR, 0.0f);
+        packed += kNR;
+    }
+}
+
+// c[kMR x kNR] = alpha * a * b + beta * c over packed panels of depth kc.
+// c is not read when beta == 0.
+#if defined(__AVX512F__)
+inline void micro_kernel(const int    kc,
+                         const float* a,
+                         const float* b,
+                         const float  alpha,
+                         const float  beta,
+                         float*       c,
+                         const int64_t ldc)
+{
+    __m512 acc[kMR][2];
+#pragma GCC unroll 6
+    for (int r = 0; r < kMR; ++r)
+    {
+        acc[r][0] = _mm512_setzero_ps();
+        acc[r][1] = _mm512_setzero_ps();
+    }
+    for (int p = 0; p < kc; ++p)
+    {
+        const __m512 b0 = _mm512_loadu_ps(b);
+        const __m512 b1 = _mm512_loadu_ps(b + 16);
+#pragma GCC unroll 6
+        for (int r = 0; r < kMR; ++r)
+        {
+            const __m512 ar = _mm512_set1_ps(a[r]);
+            acc[r][0]       = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1]       = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+        }
+        a += kMR;
+        b += kNR;
+    }
+
+    const __m512 va = _mm512_set1_ps(alpha);
+    if (beta == 0.0f)
+    {
+#pragma GCC unroll 6
+        for (int r = 0; r < kMR; ++r)
+        {
+            _mm512_storeu_ps(c + r * ldc, _mm512_mul_ps(acc[r][0], va));
+            _mm512_storeu_ps(c + r * ldc + 16, _mm512_mul_ps(acc[r][1], va));
+        }
+    }
+    else
+    {
+        const __m512 vb = _mm512_set1_ps(beta);
+#pragma GCC unroll 6
+        for (int r = 0; r < kMR; ++r)
+        {
+            float* cr = c + r * ldc;
+            _mm512_storeu_ps(
+                cr, _mm512_fmadd_ps(acc[r][0], va, _mm512_mul_ps(vb, _mm512_loadu_ps(cr))));
+            _mm512_storeu_ps(
+                cr + 16,
+                _mm512_fmadd_ps(acc[r][1], va, _mm512_mul_ps(vb, _mm512_loadu_ps(cr + 16))));
+        }
+    }
+}
+#elif defined(__AVX2__) && defined(__FMA__)
+inline void micro_kernel(const int    kc,
+                         const float* a,
+                         const float* b,
+                         const float  alpha,
+                         const float  beta,
+                         float*       c,
+                         const int64_t ldc)
+{
+    __m256 acc[kMR][2];
+#pragma GCC unroll 6
+    for (int r = 0; r < kMR; ++r)
+    {
+        acc[r][0] = _mm256_setzero_ps();
+        acc[r][1] = _mm256_setzero_ps();
+    }
+    for (int p = 0; p < kc; ++p)
+    {
+        const __m256 b0 = _mm256_loadu_ps(b);
+        const __m256 b1 = _mm256_loadu_ps(b + 8);
+#pragma GCC unroll 6
+        for (int r = 0; r < kMR; ++r)
+        {
+            const __m256 ar = _mm256_broadcast_ss(a + r);
+            acc[r][0]       = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1]       = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+        }
+        a += kMR;
+        b += kNR;
+    }
+
+    const __m256 va = _mm256_set1_ps(alpha);
+    if (beta == 0.0f)
+    {
+#pragma GCC unroll 6
+        for (int r = 0; r < kMR; ++r)
+        {
+            _mm256_storeu_ps(c + r * ldc, _mm256_mul_ps(acc[r][0], va));
+            _mm256_storeu_ps(c + r * ldc + 8, _mm256_mul_ps(acc[r][1], va));
+        }
+    }
+    else
+    {
+        const __m256 vb = _mm256_set1_ps(beta);
+#pragma GCC unroll 6
+        for (int r = 0; r < kMR; ++r)
+        {
+            float* cr = c + r * ldc;
+            _mm256_storeu_ps(
+                cr, _mm256_fmadd_ps(acc[r][0], va, _mm256_mul_ps(vb, _mm256_loadu_ps(cr))));
+            _mm256_storeu_ps(
+                cr + 8, _mm256_fmadd_ps(acc[r][1], va, _mm256_mul_ps(vb, _mm256_loadu_ps(cr + 8))));
+        }
+    }
+}
+#else
+inline void micro_kernel(const int    kc,
+                         const float* a,
+                         const float* b,
+                         const float  alpha,
+                         const float  beta,
+                         float*       c,
+                         const int64_t ldc)
+{
+    float acc[kMR][kNR] = {};
+    for (int p = 0; p < kc; ++p)
+    {
+        for (int r = 0; r < kMR; ++r)
+        {
+            for (int j = 0; j < kNR; ++j)
+            {
+                acc[r][j] += a[r] * b[j];
+            }
+        }
+        a += kMR;
+        b += kNR;
+    }
+    for (int r = 0; r < kMR; ++r)
+    {
+        for (int j = 0; j < kNR; ++j)
+        {
+            c[r * ldc + j] = alpha * acc[r][j] + (beta == 0.0f ? 0.0f : beta * c[r * ldc + j]);
+        }
+    }
+}
+#endif
+
+// Shared driver. A float C is written in place; any other Ctype gets a float
+// tile per (MC, NC) block that is converted into C after the last K block.
+template <typename Ctype>
+void sgemm_driver(const bool   trans_a,
+                  const bool   trans_b,
+                  const int    M,
+                  const int    N,
+                  const int    K,
+                  const float  alpha,
+                  const float* A,
+                  const float* B,
+                  const float  beta,
+                  Ctype*       C)
+{
+    if (M <= 0 || N <= 0)
+    {
+        return;
+    }
+    if (K <= 0)
+    {
+        const int64_t count = static_cast<int64_t>(M) * N;
+        for (int64_t i = 0; i < count; ++i)
+        {
+            C[i] = static_cast<Ctype>((beta == 0.0f) ? 0.0f : beta * static_cast<float>(C[i]));
+        }
+        return;
+    }
+
+    const bool direct = std::is_same<Ctype, float>::value;
+
+    // op(B) is packed once up front and shared by every output tile. Block pc
+    // starts at pc * n_pad and holds its kNR-column panels back to back.
+    const int          n_panels = (N + kNR - 1) / kNR;
+    const int64_t      n_pad    = static_cast<int64_t>(n_panels) * kNR;
+    const int          k_blocks = (K + kKC - 1) / kKC;
+    std::vector<float> packed_b(K * n_pad);
+    parallel_for(0,
+                 static_cast<int64_t>(k_blocks) * n_panels,
+                 16,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     for (int64_t t = begin; t < end; ++t)
+                     {
+                         const int pc = static_cast<int>(t / n_panels) * kKC;
+                         const int j0 = static_cast<int>(t % n_panels) * kNR;
+                         const int kc = std::min(kKC, K - pc);
+                         pack_b(trans_b, N, K, B, pc, kc, j0, &packed_b[pc * n_pad + j0 * kc]);
+                     }
+                 });
+
+    const int m_tiles = (M + kMC - 1) / kMC;
+    const int n_tiles = (N + kNC - 1) / kNC;
+    // Each chunk is a rectangle of output tiles, so a thread reuses the op(B)
+    // panels of its columns across all of its rows.
+    parallel_for_2d(
+        0,
+        m_tiles,
+        0,
+        n_tiles,
+        1,
+        1,
+        [&](int64_t ti0, int64_t ti1, int64_t tj0, int64_t tj1)
+        {
+            const int64_t block_n = tj1 - tj0;
+
+            std::vector<float> packed_a(kMC * kKC);
+            std::vector<float> tile(direct ? 0 : kMC * kNC);
+            float              edge[kMR * kNR];
+            for (int64_t t = 0; t < (ti1 - ti0) * block_n; ++t)
+            {
+                const int i0 = static_cast<int>(ti0 + t / block_n) * kMC;
+                const int j0 = static_cast<int>(tj0 + t % block_n) * kNC;
+                const int mc = std::min(kMC, M - i0);
+                const int nc = std::min(kNC, N - j0);
+
+                Ctype* const c_tile = C + static_cast<int64_t>(i0) * N + j0;
+                float*       ct     = reinterpret_cast<float*>(c_tile);
+                int64_t      ldc    = N;
+                if (!direct)
+                {
+                    ct  = tile.data();
+                    ldc = kNC;
+                    if (beta != 0.0f)
+                    {
+                        for (int r = 0; r < mc; ++r)
+                        {
+                            caffe_cpu_convert(nc, c_tile + r * N, ct + r * ldc);
+                        }
+                    }
+                }
+
+                for (int pc = 0; pc < K; pc += kKC)
+                {
+                    const int   kc     = std::min(kKC, K - pc);
+                    const float beta_k = (pc == 0) ? beta : 1.0f;
+                    pack_a(trans_a, M, K, A, i0, mc, pc, kc, packed_a.data());
+                    for (int jr = 0; jr < nc; jr += kNR)
+                    {
+                        const int    nr = std::min(kNR, nc - jr);
+                        const float* bp = &packed_b[pc * n_pad + (j0 + jr) * kc];
+                        for (int ir = 0; ir < mc; ir += kMR)
+                        {
+                            const int    mr = std::min(kMR, mc - ir);
+                            const float* ap = &packed_a[ir * kc];
+                            float*       c  = ct + ir * ldc + jr;
+                            if (mr == kMR && nr == kNR)
+                            {
+                                micro_kernel(kc, ap, bp, alpha, beta_k, c, ldc);
+                                continue;
+                            }
+                            // Partial block at the matrix edge: compute the full
+                            // register block into scratch and copy the valid part.
+                            micro_kernel(kc, ap, bp, alpha, 0.0f, edge, kNR);
+                            for (int r = 0; r < mr; ++r)
+                            {
+                                for (int j = 0; j < nr; ++j)
+                                {
+                                    float& dst  = c[r * ldc + j];
+                                    float  prev = (beta_k == 0.0f) ? 0.0f : beta_k * dst;
+                                    dst         = edge[r * kNR + j] + prev;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                if (!direct)
+                {
+                    for (int r = 0; r < mc; ++r)
+                    {
+                        caffe_cpu_convert(nc, ct + r * ldc, c_tile + r * N);
+                    }
+                }
+            }
+        });
+}
+
+}  // namespace
+
+void caffe_cpu_sgemm(const bool   trans_a,
+                     const bool   trans_b,
+                     const int    M,
+                     const int    N,
+                     const int    K,
+                     const float  alpha,
+                     const float* A,
+                     const float* B,
+                     const float  beta,
+                     float*       C)
+{
+    sgemm_driver(trans_a, trans_b, M, N, K, alpha, A, B, beta, C);
+}
+
+void caffe_cpu_sgemm(const bool   trans_a,
+                     const bool   trans_b,
+                     const int    M,
+                     const int    N,
+                     const int    K,
+                     const float  alpha,
+                     const float* A,
+                     const float* B,
+                     const float  beta,
+                     float16*     C)
+{
+    sgemm_driver(trans_a, trans_b, M, N, K, alpha, A, B, beta, C);
+}
+
+void caffe_cpu_sgemm(const bool   trans_a,
+                     const bool   trans_b,
+                     const int    M,
+                     const int    N,
+                     const int    K,
+                     const float  alpha,
+                     const float* A,
+                     const float* B,
+                     const float  beta,
+                     bfloat16*    C)
+{
+    sgemm_driver(trans_a, trans_b, M, N, K, alpha, A, B, beta, C);
+}
+
+}  // namespace ferrari
@@ -0,0 +1,446 @@
+#include "cpu_quant.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "glog/logging.h"
+#include "parallel.hpp"
+
+namespace ferrari
+{
+namespace
+{
+
+// fmap2 is packed into panels of kQNR pixels: for every group of 4 channels a
+// panel holds 64 bytes, pixel-major with the 4 channel bytes of each pixel
+// adjacent, which is the operand layout of dpbusd. A microkernel call covers
+// kQMR query rows x kQNB panels.
+const int kQNR = 16;
+const int kQNB = 2;
+#if defined(__AVX512VNNI__)
+const int kQMR = 6;
+#elif defined(__AVXVNNI__)
+const int kQMR = 3;
+#else
+const int kQMR = 4;
+#endif
+
+// Output tiles handed to one thread: kQMC query rows x kQNC target pixels.
+const int kQMC = 96;
+const int kQNC = 256;
+
+// Offset that turns the signed fmap1 codes into the unsigned dpbusd operand.
+const int kZeroPoint = 128;
+
+// Symmetric per-pixel scales for pixels [j0, j0 + n) of a [dim, hw] map,
+// n <= kQNR. Rows are read contiguously; an all-zero pixel gets scale 0.
+void pixel_scales(const float* f, int dim, int hw, int j0, int n, float* scale, float* inv)
+{
+    float amax[kQNR] = {};
+    for (int k = 0; k < dim; ++k)
+    {
+        const float* row = f + static_cast<int64_t>(k) * hw + j0;
+        for (int jj = 0; jj < n; ++jj)
+        {
+            amax[jj] = std::max(amax[jj], std::fabs(row[jj]));
+        }
+    }
+    for (int jj = 0; jj < n; ++jj)
+    {
+        scale[jj] = amax[jj] / 127.0f;
+        inv[jj]   = amax[jj] > 0.0f ? 127.0f / amax[jj] : 0.0f;
+    }
+}
+
+inline int quantize(float v, float inv)
+{
+    long q = std::lrint(v * inv);
+    return static_cast<int>(std::min(127L, std::max(-127L, q)));
+}
+
+// fmap1 codes as uint8 rows of kp bytes, [mp, kp]. Padding channels and rows
+// hold the zero point, i.e. a zero code.
+void quantize_rows_u8(const float* f, int dim, int hw, int kp, int mp, uint8_t* q, float* scale)
+{
+    memset(q + static_cast<int64_t>(hw) * kp, kZeroPoint, static_cast<int64_t>(mp - hw) * kp);
+    std::fill(scale + hw, scale + mp, 0.0f);
+
+    const int blocks = (hw + kQNR - 1) / kQNR;
+    parallel_for(0,
+                 blocks,
+                 16,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     float inv[kQNR];
+                     for (int64_t blk = begin; blk < end; ++blk)
+                     {
+                         const int j0 = static_cast<int>(blk) * kQNR;
+                         const int n  = std::min(kQNR, hw - j0);
+                         pixel_scales(f, dim, hw, j0, n, scale + j0, inv);
+                         for (int jj = 0; jj < n; ++jj)
+                         {
+                             uint8_t* row = q + static_cast<int64_t>(j0 + jj) * kp;
+                             for (int k = 0; k < dim; ++k)
+                             {
+                                 const float v = f[static_cast<int64_t>(k) * hw + j0 + jj];
+                                 row[k] =
+                                     static_cast<uint8_t>(quantize(v, inv[jj]) + kZeroPoint);
+                             }
+                             memset(row + dim, kZeroPoint, kp - dim);
+                         }
+                     }
+                 });
+}
+
+// fmap2 codes as int8 panels (see kQNR) for np pixels, plus the per-pixel
+// correction kZeroPoint * sum_k q[k][j] that removes the fmap1 offset.
+// Padding channels and pixels are zero.
+void quantize_panels_s8(const float* f,
+                        int          dim,
+                        int          hw,
+                        int          kp,
+                        int          np,
+                        int8_t*      q,
+                        float*       scale,
+                        int32_t*     comp)
+{
+    const int64_t panel_bytes = static_cast<int64_t>(kp) * kQNR;
+    const int     panels      = np / kQNR;
+    parallel_for(0,
+                 panels,
+                 16,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     float inv[kQNR];
+                     for (int64_t p = begin; p < end; ++p)
+                     {
+                         const int j0    = static_cast<int>(p) * kQNR;
+                         const int n     = std::max(0, std::min(kQNR, hw - j0));
+                         int8_t*   panel = q + p * panel_bytes;
+                         memset(panel, 0, panel_bytes);
+                         std::fill(scale + j0, scale + j0 + kQNR, 0.0f);
+                         std::fill(comp + j0, comp + j0 + kQNR, 0);
+                         if (n == 0)
+                         {
+                             continue;
+                         }
+                         pixel_scales(f, dim, hw, j0, n, scale + j0, inv);
+                         for (int k = 0; k < dim; ++k)
+                         {
+                             const float* row  = f + static_cast<int64_t>(k) * hw + j0;
+                             int8_t*      quad = panel + (k / 4) * kQNR * 4 + (k % 4);
+                             for (int jj = 0; jj < n; ++jj)
+                             {
+                                 const int v = quantize(row[jj], inv[jj]);
+                                 quad[jj * 4] = static_cast<int8_t>(v);
+                                 comp[j0 + jj] += kZeroPoint * v;
+                             }
+                         }
+                     }
+                 });
+}
+
+// acc[r * kQNB * kQNR + c] = sum_k a[r][k] * b[k][c] over kq groups of 4
+// channels. a rows are lda bytes apart, consecutive panels b_stride apart.
+#if defined(__AVX512VNNI__)
+inline void dot_block_int8(
+    const uint8_t* a, int64_t lda, const int8_t* b, int64_t b_stride, int kq, int32_t* acc)
+{
+    __m512i sum[kQMR][kQNB];
+#pragma GCC unroll 6
+    for (int r = 0; r < kQMR; ++r)
+    {
+        sum[r][0] = _mm512_setzero_si512();
+        sum[r][1] = _mm512_setzero_si512();
+    }
+    for (int q = 0; q < kq; ++q)
+    {
+        const __m512i b0 = _mm512_loadu_si512(b + q * 64);
+        const __m512i b1 = _mm512_loadu_si512(b + b_stride + q * 64);
+#pragma GCC unroll 6
+        for (int r = 0; r < kQMR; ++r)
+        {
+            int32_t quad;
+            memcpy(&quad, a + r * lda + q * 4, sizeof(quad));
+            const __m512i ar = _mm512_set1_epi32(quad);
+            sum[r][0]        = _mm512_dpbusd_epi32(sum[r][0], ar, b0);
+            sum[r][1]        = _mm512_dpbusd_epi32(sum[r][1], ar, b1);
+        }
+    }
+#pragma GCC unroll 6
+    for (int r = 0; r < kQMR; ++r)
+    {
+        _mm512_storeu_si512(acc + r * kQNB * kQNR, sum[r][0]);
+        _mm512_storeu_si512(acc + r * kQNB * kQNR + kQNR, sum[r][1]);
+    }
+}
+#elif defined(__AVXVNNI__)
+inline void dot_block_int8(
+    const uint8_t* a, int64_t lda, const int8_t* b, int64_t b_stride, int kq, int32_t* acc)
+{
+    // A 16-pixel panel row is two ymm registers.
+    __m256i sum[kQMR][2 * kQNB];
+    for (int r = 0; r < kQMR; ++r)
+    {
+        for (int c = 0; c < 2 * kQNB; ++c)
+        {
+            sum[r][c] = _mm256_setzero_si256();
+        }
+    }
+    for (int q = 0; q < kq; ++q)
+    {
+        const int8_t* b0 = b + q * 64;
+        const int8_t* b1 = b + b_stride + q * 64;
+        const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b0));
+        const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b0 + 32));
+        const __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b1));
+        const __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b1 + 32));
+        for (int r = 0; r < kQMR; ++r)
+        {
+            int32_t quad;
+            memcpy(&quad, a + r * lda + q * 4, sizeof(quad));
+            const __m256i ar = _mm256_set1_epi32(quad);
+            sum[r][0]        = _mm256_dpbusd_avx_epi32(sum[r][0], ar, v0);
+            sum[r][1]        = _mm256_dpbusd_avx_epi32(sum[r][1], ar, v1);
+            sum[r][2]        = _mm256_dpbusd_avx_epi32(sum[r][2], ar, v2);
+            sum[r][3]        = _mm256_dpbusd_avx_epi32(sum[r][3], ar, v3);
+        }
+    }
+    for (int r = 0; r < kQMR; ++r)
+    {
+        for (int c = 0; c < 2 * kQNB; ++c)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + r * kQNB * kQNR + c * 8),
+                                sum[r][c]);
+        }
+    }
+}
+#else
+inline void dot_block_int8(
+    const uint8_t* a, int64_t lda, const int8_t* b, int64_t b_stride, int kq, int32_t* acc)
+{
+    for (int r = 0; r < kQMR; ++r)
+    {
+        const uint8_t* ar = a + r * lda;
+        for (int c = 0; c < kQNB * kQNR; ++c)
+        {
+            const int8_t* bc  = b + (c / kQNR) * b_stride + (c % kQNR) * 4;
+            int32_t       sum = 0;
+            for (int q = 0; q < kq; ++q)
+            {
+                for (int t = 0; t < 4; ++t)
+                {
+                    sum += ar[q * 4 + t] * bc[q * 64 + t];
+                }
+            }
+            acc[r * kQNB * kQNR + c] = sum;
+        }
+    }
+}
+#endif
+
+// out[c] = sa * sb[c] * (s[c] - comp[c]). The int32 sums are exact, only the
+// final scaling rounds.
+inline void dequantize_row(
+    const int32_t* s, const int32_t* comp, const float* sb, float sa, int n, float* out)
+{
+    int c = 0;
+#if defined(__AVX512F__)
+    const __m512 va = _mm512_set1_ps(sa);
+    for (; c + 16 <= n; c += 16)
+    {
+        const __m512i d = _mm512_sub_epi32(_mm512_loadu_si512(s + c), _mm512_loadu_si512(comp + c));
+        const __m512  w = _mm512_mul_ps(va, _mm512_loadu_ps(sb + c));
+        _mm512_storeu_ps(out + c, _mm512_mul_ps(w, _mm512_cvtepi32_ps(d)));
+    }
+#elif defined(__AVX2__)
+    const __m256 va = _mm256_set1_ps(sa);
+    for (; c + 8 <= n; c += 8)
+    {
+        const __m256i d =
+            _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + c)),
+                             _mm256_loadu_si256(reinterpret_cast<const __m256i*>(comp + c)));
+        const __m256 w = _mm256_mul_ps(va, _mm256_loadu_ps(sb + c));
+        _mm256_storeu_ps(out + c, _mm256_mul_ps(w, _mm256_cvtepi32_ps(d)));
+    }
+#endif
+    for (; c < n; ++c)
+    {
+        out[c] = sa * sb[c] * static_cast<float>(s[c] - comp[c]);
+    }
+}
+
+// Quantized operands of one batch element.
+struct QuantizedCorrInputs
+{
+    int                  kp, mp, np;
+    std::vector<uint8_t> a;  // fmap1 rows, [mp, kp]
+    std::vector<float>   a_scale;
+    std::vector<int8_t>  b;  // fmap2 panels, np / kQNR panels of kp * kQNR
+    std::vector<float>   b_scale;
+    std::vector<int32_t> b_comp;
+
+    void quantize(const float* fmap1, const float* fmap2, int dim, int hw)
+    {
+        kp = (dim + 3) / 4 * 4;
+        mp = (hw + kQMR - 1) / kQMR * kQMR;
+        np = (hw + kQNB * kQNR - 1) / (kQNB * kQNR) * (kQNB * kQNR);
+        a.resize(static_cast<int64_t>(mp) * kp);
+        a_scale.resize(mp);
+        b.resize(static_cast<int64_t>(np) * kp);
+        b_scale.resize(np);
+        b_comp.resize(np);
+        quantize_rows_u8(fmap1, dim, hw, kp, mp, a.data(), a_scale.data());
+        quantize_panels_s8(fmap2, dim, hw, kp, np, b.data(), b_scale.data(), b_comp.data());
+    }
+};
+
+}  // namespace
+
+template <typename Dtype>
+int corr_volume_int8_cpu(const float* fmap1,
+                         const float* fmap2,
+                         int          dim,
+                         int          hw,
+                         float        alpha,
+                         Dtype*       corr)
+{
+    CHECK_GT(dim, 0);
+    CHECK_GT(hw, 0);
+
+    QuantizedCorrInputs in;
+    in.quantize(fmap1, fmap2, dim, hw);
+
+    const int64_t panel_bytes = static_cast<int64_t>(in.kp) * kQNR;
+    const int     kq          = in.kp / 4;
+    const int     m_tiles     = (hw + kQMC - 1) / kQMC;
+    const int     n_tiles     = (hw + kQNC - 1) / kQNC;
+    parallel_for_2d(
+        0,
+        m_tiles,
+        0,
+        n_tiles,
+        1,
+        1,
+        [&](int64_t ti0, int64_t ti1, int64_t tj0, int64_t tj1)
+        {
+            const int64_t block_n = tj1 - tj0;
+
+            int32_t acc[kQMR * kQNB * kQNR];
+            float   row[kQNB * kQNR];
+            for (int64_t t = 0; t < (ti1 - ti0) * block_n; ++t)
+            {
+                const int i0 = static_cast<int>(ti0 + t / block_n) * kQMC;
+                const int j0 = static_cast<int>(tj0 + t % block_n) * kQNC;
+                const int mc = std::min(kQMC, hw - i0);
+                const int nc = std::min(kQNC, hw - j0);
+                for (int jr = 0; jr < nc; jr += kQNB * kQNR)
+                {
+                    const int     j  = j0 + jr;
+                    const int     nr = std::min(kQNB * kQNR, nc - jr);
+                    const int8_t* bp = in.b.data() + (j / kQNR) * panel_bytes;
+                    for (int ir = 0; ir < mc; ir += kQMR)
+                    {
+                        const int i  = i0 + ir;
+                        const int mr = std::min(kQMR, mc - ir);
+                        const uint8_t* ap = in.a.data() + static_cast<int64_t>(i) * in.kp;
+                        dot_block_int8(ap, in.kp, bp, panel_bytes, kq, acc);
+                        // Dequantize on store, then convert to Dtype.
+                        for (int r = 0; r < mr; ++r)
+                        {
+                            dequantize_row(acc + r * kQNB * kQNR,
+                                           &in.b_comp[j],
+                                           &in.b_scale[j],
+                                           alpha * in.a_scale[i + r],
+                                           nr,
+                                           row);
+                            caffe_cpu_convert(nr, row, corr + static_cast<int64_t>(i + r) * hw + j);
+                        }
+                    }
+                }
+            }
+        });
+
+    return 0;
+}
+
+template int corr_volume_int8_cpu<float>(const float*, const float*, int, int, float, float*);
+template int corr_volume_int8_cpu<float16>(const float*, const float*, int, int, float, float16*);
+template int corr_volume_int8_cpu<bfloat16>(const float*, const float*, int, int, float, bfloat16*);
+
+int corr_int8_error_report(const float*     fmap1,
+                           const float*     fmap2,
+                           int              batch,
+                           int              dim,
+                           int              hw,
+                           float            alpha,
+                           int              num_samples,
+                           CorrQuantReport* report)
+{
+    CHECK(report != NULL);
+    CHECK_GT(num_samples, 0);
+
+    const int stride  = std::max(1, hw / num_samples);
+    double    abs_sum = 0.0, sq_sum = 0.0, ref_sq_sum = 0.0;
+    float     max_err = 0.0f;
+    int64_t   count   = 0;
+
+    QuantizedCorrInputs in;
+    std::vector<double> ref(hw);
+    std::vector<int>    dot(hw);
+    for (int b = 0; b < batch; ++b)
+    {
+        const float* f1 = fmap1 + static_cast<int64_t>(b) * dim * hw;
+        const float* f2 = fmap2 + static_cast<int64_t>(b) * dim * hw;
+        in.quantize(f1, f2, dim, hw);
+
+        for (int i = 0; i < hw; i += stride)
+        {
+            // Same integer sums the kernel forms, on signed codes directly.
+            std::fill(ref.begin(), ref.end(), 0.0);
+            std::fill(dot.begin(), dot.end(), 0);
+            const uint8_t* qa = in.a.data() + static_cast<int64_t>(i) * in.kp;
+            for (int k = 0; k < dim; ++k)
+            {
+                const float   v  = f1[static_cast<int64_t>(k) * hw + i];
+                const int     ca = qa[k] - kZeroPoint;
+                const float*  r2 = f2 + static_cast<int64_t>(k) * hw;
+                const int8_t* q2 = in.b.data() + (k / 4) * kQNR * 4 + (k % 4);
+                for (int j = 0; j < hw; ++j)
+                {
+                    ref[j] += static_cast<double>(v) * r2[j];
+                    const int64_t panel = (j / kQNR) * static_cast<int64_t>(in.kp) * kQNR;
+                    dot[j] += ca * q2[panel + (j % kQNR) * 4];
+                }
+            }
+            for (int j = 0; j < hw; ++j)
+            {
+                const float q = alpha * in.a_scale[i] * in.b_scale[j] * static_cast<float>(dot[j]);
+                const double r   = alpha * ref[j];
+                const double err = std::fabs(q - r);
+                max_err          = std::max(max_err, static_cast<float>(err));
+                abs_sum += err;
+                sq_sum += err * err;
+                ref_sq_sum += r * r;
+                ++count;
+            }
+        }
+    }
+
+    report->samples      = count;
+    report->max_abs_err  = max_err;
+    report->mean_abs_err = count ? static_cast<float>(abs_sum / count) : 0.0f;
+    report->rms_err      = count ? static_cast<float>(std::sqrt(sq_sum / count)) : 0.0f;
+    report->ref_rms      = count ? static_cast<float>(std::sqrt(ref_sq_sum / count)) : 0.0f;
+    return 0;
+}
+
+}  // namespace ferrari
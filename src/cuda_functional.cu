@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <cmath>
 
+#include "cpu_functional.hpp"
 #include "cuda_functional.hpp"
 
 namespace ferrari
@@ -84,6 +86,11 @@ int grid_sample(std::shared_ptr<Blob<float>>& input,
                 std::shared_ptr<Blob<float>>& grid,
                 std::shared_ptr<Blob<float>>& output)
 {
+    if (Caffe::mode() == Caffe::CPU)
+    {
+        return grid_sample_cpu(input, grid, output);
+    }
+
     int N    = input->shape(0);
     int C    = input->shape(1);
     int H_in = input->shape(2);
@@ -215,42 +222,88 @@ void broadcast_add(const std::shared_ptr<Blob<float>>& coords,
         output->mutable_gpu_data());
 }
 
-__global__ void reshapeKernel(const float* input, float* output, int batch, int dim, int ht, int wd) {
-    int idx = blockIdx.x * blockDim.x + threadIdx.x;
-    int total = batch * dim * ht * wd;
+// 分块转置: 每个 block 经共享内存搬运一个 32x32 的 tile，读写均为合并访问；
+// 多出的一列避免共享内存 bank 冲突。blockIdx.z 为 batch 下标。
+// gridDim.y 上限为 65535，行方向的 tile 按 grid-stride 循环处理，H*W 很大时也能启动
+__global__ void transpose_kernel(const float* __restrict__ src,
+                                 float* __restrict__ dst,
+                                 int rows,
+                                 int cols)
+{
+    __shared__ float tile[32][33];
+
+    const long long plane = static_cast<long long>(rows) * cols;
+    src += blockIdx.z * plane;
+    dst += blockIdx.z * plane;
 
-    if (idx < total) {
-        int b = idx / (dim * ht * wd);
-        int d = (idx % (dim * ht * wd)) / (ht * wd);
-        int h = (idx % (ht * wd)) / wd;
-        int w = idx % wd;
+    const int row_tiles = (rows + 31) / 32;
+    for (int ty = blockIdx.y; ty < row_tiles; ty += gridDim.y)
+    {
+        int x = blockIdx.x * 32 + threadIdx.x;
+        int y = ty * 32 + threadIdx.y;
+        for (int k = 0; k < 32; k += 8)
+        {
+            if (x < cols && y + k < rows)
+            {
+                tile[threadIdx.y + k][threadIdx.x] = src[static_cast<long long>(y + k) * cols + x];
+            }
+        }
+        __syncthreads();
 
-        output[b * dim * ht * wd + d * ht * wd + h * wd + w] = input[idx];
+        x = ty * 32 + threadIdx.x;
+        y = blockIdx.x * 32 + threadIdx.y;
+        for (int k = 0; k < 32; k += 8)
+        {
+            if (x < rows && y + k < cols)
+            {
+                dst[static_cast<long long>(y + k) * rows + x] = tile[threadIdx.x][threadIdx.y + k];
+            }
+        }
+        // 下一轮写 tile 前等待本轮读完
+        __syncthreads();
     }
 }
 
-void convert_row2colomn_major(const std::shared_ptr<Blob<float>>& input,
-                              std::shared_ptr<Blob<float>>&       output)
+int convert_layout(const std::shared_ptr<Blob<float>>& input,
+                   BlobLayout                          layout,
+                   std::shared_ptr<Blob<float>>&       output)
 {
-    int batch = input->shape(0);
-    int dim   = input->shape(1);
-    int ht    = input->shape(2);
-    int wd    = input->shape(3);
-    // Compute the total number of elements
-    int totalElements = batch * dim * ht * wd;
-
-    // Define block and grid sizes
-    int threadsPerBlock = 256;
-    int blocksPerGrid   = (totalElements + threadsPerBlock - 1) / threadsPerBlock;
-
-    output->Reshape(batch, dim, ht, wd);
+    if (Caffe::mode() == Caffe::CPU)
+    {
+        return convert_layout_cpu(*input, layout, output.get());
+    }
+    CHECK_EQ(input->num_axes(), 4) << "layouts are defined for 4-D blobs";
+    if (input->layout() == layout)
+    {
+        // CopyFrom only reshapes (and takes the tag) when the shapes differ.
+        output->CopyFrom(*input, true);
+        output->set_layout(layout);
+        return 0;
+    }
 
-    // Launch the kernel
-    reshapeKernel<<<blocksPerGrid, threadsPerBlock>>>(
-        input->gpu_data(), output->mutable_gpu_data(), batch, dim, ht, wd);
+    // NCHW -> NHWC 对每个 batch 转置 [C, H*W]，NHWC -> NCHW 转置 [H*W, C]
+    int N = input->shape(0);
+    int rows, cols;
+    if (layout == LAYOUT_NHWC)
+    {
+        rows = input->shape(1);
+        cols = input->shape(2) * input->shape(3);
+        output->Reshape(std::vector<int>({N, input->shape(2), input->shape(3), rows}));
+    }
+    else
+    {
+        rows = input->shape(1) * input->shape(2);
+        cols = input->shape(3);
+        output->Reshape(std::vector<int>({N, cols, input->shape(1), input->shape(2)}));
+    }
+    output->set_layout(layout);
 
-    // Synchronize to ensure the kernel has finished executing
-    cudaDeviceSynchronize();
+    dim3 blockDim(32, 8);
+    dim3 gridDim((cols + 31) / 32, std::min((rows + 31) / 32, 65535), N);
+    transpose_kernel<<<gridDim, blockDim>>>(
+        input->gpu_data(), output->mutable_gpu_data(), rows, cols);
+    CUDA_POST_KERNEL_CHECK;
+    return 0;
 }
 
 }  // namespace ferrari
\ No newline at end of file
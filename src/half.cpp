@@ -0,0 +1,318 @@
+#include "half.hpp"
+
+#include "parallel.hpp"
+
+#if defined(__AVX2__) || defined(__AVX512F__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace ferrari
+{
+
+namespace
+{
+
+// Conversions are memory bound; below this many elements a single thread
+// already keeps up with the bandwidth.
+const int64_t kConvertGrain = 1 << 16;
+
+
+void convert_range(const int64_t N, const float* X, float16* Y)
+{
+    int64_t i = 0;
+#if defined(__AVX512F__)
+    for (; i + 16 <= N; i += 16)
+    {
+        const __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(X + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(Y + i), h);
+    }
+#endif
+#if defined(__F16C__)
+    for (; i + 8 <= N; i += 8)
+    {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(X + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Y + i), h);
+    }
+#endif
+    for (; i < N; ++i)
+    {
+        Y[i] = float16(X[i]);
+    }
+}
+
+void convert_range(const int64_t N, const float16* X, float* Y)
+{
+    int64_t i = 0;
+#if defined(__AVX512F__)
+    for (; i + 16 <= N; i += 16)
+    {
+        const __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(X + i));
+        _mm512_storeu_ps(Y + i, _mm512_cvtph_ps(h));
+    }
+#endif
+#if defined(__F16C__)
+    for (; i + 8 <= N; i += 8)
+    {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(X + i));
+        _mm256_storeu_ps(Y + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < N; ++i)
+    {
+        Y[i] = static_cast<float>(X[i]);
+    }
+}
+
+void convert_range(const int64_t N, const float* X, bfloat16* Y)
+{
+    int64_t i = 0;
+#if defined(__AVX512BF16__)
+    for (; i + 16 <= N; i += 16)
+    {
+        const __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(X + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(Y + i),
+                            reinterpret_cast<const __m256i&>(h));
+    }
+#endif
+#if defined(__AVX2__)
+    // Integer round-to-nearest-even on the float bits; NaNs are truncated and
+    // forced quiet, matching float_to_bfloat16_bits.
+    const __m256i one     = _mm256_set1_epi32(1);
+    const __m256i bias    = _mm256_set1_epi32(0x7fff);
+    const __m256i abs_msk = _mm256_set1_epi32(0x7fffffff);
+    const __m256i inf     = _mm256_set1_epi32(0x7f800000);
+    const __m256i quiet   = _mm256_set1_epi32(0x400000);
+    for (; i + 8 <= N; i += 8)
+    {
+        const __m256i x      = _mm256_castps_si256(_mm256_loadu_ps(X + i));
+        const __m256i lsb    = _mm256_and_si256(_mm256_srli_epi32(x, 16), one);
+        const __m256i round  = _mm256_add_epi32(x, _mm256_add_epi32(bias, lsb));
+        const __m256i is_nan = _mm256_cmpgt_epi32(_mm256_and_si256(x, abs_msk), inf);
+        const __m256i r      = _mm256_blendv_epi8(round, _mm256_or_si256(x, quiet), is_nan);
+        // Pack the high halves of the 8 lanes into 8 contiguous uint16.
+        const __m256i hi     = _mm256_srli_epi32(r, 16);
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(hi, hi), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Y + i), _mm256_castsi256_si128(packed));
+    }
+#endif
+    for (; i < N; ++i)
+    {
+        Y[i] = bfloat16(X[i]);
+    }
+}
+
+void convert_range(const int64_t N, const bfloat16* X, float* Y)
+{
+    int64_t i = 0;
+#if defined(__AVX512F__)
+    for (; i + 16 <= N; i += 16)
+    {
+        const __m512i h = _mm512_cvtepu16_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(X + i)));
+        _mm512_storeu_ps(Y + i, _mm512_castsi512_ps(_mm512_slli_epi32(h, 16)));
+    }
+#endif
+#if defined(__AVX2__)
+    for (; i + 8 <= N; i += 8)
+    {
+        const __m256i h =
+            _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(X + i)));
+        _mm256_storeu_ps(Y + i, _mm256_castsi256_ps(_mm256_slli_epi32(h, 16)));
+    }
+#endif
+    for (; i < N; ++i)
+    {
+        Y[i] = static_cast<float>(X[i]);
+    }
+}
+
+template <typename Stype, typename Dtype>
+void convert_parallel(const int64_t N, const Stype* X, Dtype* Y)
+{
+    if (N <= kConvertGrain)
+    {
+        convert_range(N, X, Y);
+        return;
+    }
+    parallel_for(0,
+                 N,
+                 kConvertGrain,
+                 [&](int64_t begin, int64_t end)
+                 { convert_range(end - begin, X + begin, Y + begin); });
+}
+
+#if defined(__AVX2__)
+// Eight elements of X widened to float.
+inline __m256 load8_ps(const float* X)
+{
+    return _mm256_loadu_ps(X);
+}
+
+inline __m256 load8_ps(const double* X)
+{
+    const __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(X));
+    const __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(X + 4));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+inline __m256 load8_ps(const float16* X)
+{
+#if defined(__F16C__)
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(X)));
+#else
+    float x[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        x[i] = static_cast<float>(X[i]);
+    }
+    return _mm256_loadu_ps(x);
+#endif
+}
+
+inline __m256 load8_ps(const uint8_t* X)
+{
+    const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(X));
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(x));
+}
+
+inline __m256 load8_ps(const int8_t* X)
+{
+    const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(X));
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(x));
+}
+
+inline __m256 load8_ps(const uint16_t* X)
+{
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(X));
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(x));
+}
+
+inline __m256 load8_ps(const int16_t* X)
+{
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(X));
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x));
+}
+
+inline __m256 load8_ps(const int32_t* X)
+{
+    return _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(X)));
+}
+#endif
+
+template <typename Stype>
+void convert_affine_range(
+    const int64_t N, const float alpha, const Stype* X, const float beta, float* Y)
+{
+    const bool affine = alpha != 1.0f || beta != 0.0f;
+    int64_t    i      = 0;
+#if defined(__AVX2__)
+    const __m256 a = _mm256_set1_ps(alpha);
+    const __m256 b = _mm256_set1_ps(beta);
+    for (; i + 8 <= N; i += 8)
+    {
+        __m256 x = load8_ps(X + i);
+        if (affine)
+        {
+#if defined(__FMA__)
+            x = _mm256_fmadd_ps(x, a, b);
+#else
+            x = _mm256_add_ps(_mm256_mul_ps(x, a), b);
+#endif
+        }
+        _mm256_storeu_ps(Y + i, x);
+    }
+#endif
+    for (; i < N; ++i)
+    {
+        const float x = static_cast<float>(X[i]);
+        Y[i]          = affine ? alpha * x + beta : x;
+    }
+}
+
+template <typename Stype>
+void convert_affine_parallel(
+    const int64_t N, const float alpha, const Stype* X, const float beta, float* Y)
+{
+    if (N <= kConvertGrain)
+    {
+        convert_affine_range(N, alpha, X, beta, Y);
+        return;
+    }
+    parallel_for(0,
+                 N,
+                 kConvertGrain,
+                 [&](int64_t begin, int64_t end)
+                 { convert_affine_range(end - begin, alpha, X + begin, beta, Y + begin); });
+}
+
+}  // namespace
+
+void caffe_cpu_convert(const int64_t N, const float* X, float16* Y)
+{
+    convert_parallel(N, X, Y);
+}
+
+void caffe_cpu_convert(const int64_t N, const float16* X, float* Y)
+{
+    convert_parallel(N, X, Y);
+}
+
+void caffe_cpu_convert(const int64_t N, const float* X, bfloat16* Y)
+{
+    convert_parallel(N, X, Y);
+}
+
+void caffe_cpu_convert(const int64_t N, const bfloat16* X, float* Y)
+{
+    convert_parallel(N, X, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const float* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const double* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const float16* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const uint8_t* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const uint16_t* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const int8_t* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const int16_t* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+void caffe_cpu_convert_affine(
+    const int64_t N, const float alpha, const int32_t* X, const float beta, float* Y)
+{
+    convert_affine_parallel(N, alpha, X, beta, Y);
+}
+
+}  // namespace ferrari
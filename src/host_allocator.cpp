@@ -0,0 +1,358 @@
+#include "host_allocator.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef USE_MKL
+#include "mkl.h"
+#endif
+
+namespace ferrari
+{
+
+struct HostAllocator::ThreadCache
+{
+    void* blocks[2][kThreadCacheMaxClass + 1][kThreadCacheDepth];
+    int   count[2][kThreadCacheMaxClass + 1];
+
+    ThreadCache();
+    ~ThreadCache();
+};
+
+namespace
+{
+
+// Blocks may be freed during static destruction, after the exiting thread's
+// cache is gone; this plain flag (no destructor) records that.
+enum ThreadCacheState
+{
+    kCacheNone,
+    kCacheAlive,
+    kCacheDestroyed
+};
+thread_local ThreadCacheState tls_cache_state = kCacheNone;
+
+void update_peak(std::atomic<size_t>* peak, size_t value)
+{
+    size_t prev = peak->load(std::memory_order_relaxed);
+    while (prev < value && !peak->compare_exchange_weak(prev, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+}  // namespace
+
+HostAllocator::ThreadCache::ThreadCache()
+{
+    for (int p = 0; p < 2; ++p)
+    {
+        for (int c = 0; c <= kThreadCacheMaxClass; ++c)
+        {
+            count[p][c] = 0;
+        }
+    }
+}
+
+HostAllocator::ThreadCache::~ThreadCache()
+{
+    // Hand the blocks to the shared lists; they stay cached for other threads.
+    HostAllocator&              alloc = HostAllocator::Get();
+    std::lock_guard<std::mutex> lock(alloc.mutex_);
+    for (int p = 0; p < 2; ++p)
+    {
+        for (int c = 0; c <= kThreadCacheMaxClass; ++c)
+        {
+            alloc.free_[p][c].insert(
+                alloc.free_[p][c].end(), blocks[p][c], blocks[p][c] + count[p][c]);
+            count[p][c] = 0;
+        }
+    }
+    tls_cache_state = kCacheDestroyed;
+}
+
+HostAllocator& HostAllocator::Get()
+{
+    // Never destroyed: blobs with static storage may free after main returns.
+    static HostAllocator* instance = new HostAllocator();
+    return *instance;
+}
+
+HostAllocator::ThreadCache* HostAllocator::thread_cache()
+{
+    if (tls_cache_state == kCacheDestroyed)
+    {
+        return NULL;
+    }
+    thread_local ThreadCache cache;
+    tls_cache_state = kCacheAlive;
+    return &cache;
+}
+
+int HostAllocator::ClassIndex(size_t size)
+{
+    if (size > kMaxCachedSize)
+    {
+        return -1;
+    }
+    int c = kMinClass;
+    while ((size_t(1) << c) < size)
+    {
+        ++c;
+    }
+    return c;
+}
+
+size_t HostAllocator::ClassSize(size_t size)
+{
+    const int c = ClassIndex(size);
+    return c < 0 ? size : size_t(1) << c;
+}
+
+void* HostAllocator::MapHugePages(size_t size)
+{
+#ifdef __linux__
+    const size_t length = (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    void*        ptr    = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages: only succeeds when the hugetlbfs pool has room.
+    ptr = mmap(NULL,
+               length,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+               -1,
+               0);
+    if (ptr != MAP_FAILED)
+    {
+        ++huge_page_allocs_;
+        std::lock_guard<std::mutex> lock(mapped_mutex_);
+        mapped_[ptr] = length;
+        return ptr;
+    }
+#endif
+    // Transparent huge pages only back 2 MB aligned ranges, so over-map by one
+    // page and unmap the unaligned head and tail.
+    const size_t padded = length + kHugePageSize;
+    ptr = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return NULL;
+    }
+    const uintptr_t base    = reinterpret_cast<uintptr_t>(ptr);
+    const uintptr_t aligned = (base + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    if (aligned > base)
+    {
+        munmap(ptr, aligned - base);
+    }
+    if (base + padded > aligned + length)
+    {
+        munmap(reinterpret_cast<void*>(aligned + length), base + padded - (aligned + length));
+    }
+    ptr = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    // Fails with EINVAL when THP is disabled; the mapping is still usable.
+    if (madvise(ptr, length, MADV_HUGEPAGE) == 0)
+    {
+        ++huge_page_allocs_;
+    }
+#endif
+    std::lock_guard<std::mutex> lock(mapped_mutex_);
+    mapped_[ptr] = length;
+    return ptr;
+#else
+    return NULL;
+#endif
+}
+
+void* HostAllocator::SystemAlloc(size_t size, bool pinned)
+{
+    void* ptr = NULL;
+#ifndef CPU_ONLY
+    if (pinned)
+    {
+        CUDA_CHECK(cudaMallocHost(&ptr, size));
+        ++system_allocs_;
+        return ptr;
+    }
+#endif
+    ++system_allocs_;
+    const size_t threshold = huge_page_threshold_.load();
+    if (threshold > 0 && size >= threshold)
+    {
+        ptr = MapHugePages(size);
+        if (ptr)
+        {
+            return ptr;
+        }
+    }
+#ifdef USE_MKL
+    ptr = mkl_malloc(size ? size : 1, kAlignment);
+#else
+    if (posix_memalign(&ptr, kAlignment, size ? size : 1) != 0)
+    {
+        ptr = NULL;
+    }
+#endif
+    CHECK(ptr) << "host allocation of size " << size << " failed";
+    return ptr;
+}
+
+void HostAllocator::SystemFree(void* ptr, size_t size, bool pinned)
+{
+    ++system_frees_;
+#ifndef CPU_ONLY
+    if (pinned)
+    {
+        CUDA_CHECK(cudaFreeHost(ptr));
+        return;
+    }
+#endif
+#ifdef __linux__
+    // Mapped blocks are at least kHugePageSize, so smaller ones skip the lookup.
+    if (size >= kHugePageSize)
+    {
+        size_t length = 0;
+        {
+            std::lock_guard<std::mutex> lock(mapped_mutex_);
+            auto                        it = mapped_.find(ptr);
+            if (it != mapped_.end())
+            {
+                length = it->second;
+                mapped_.erase(it);
+            }
+        }
+        if (length > 0)
+        {
+            munmap(ptr, length);
+            return;
+        }
+    }
+#endif
+#ifdef USE_MKL
+    mkl_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void HostAllocator::set_huge_page_threshold(size_t bytes)
+{
+    huge_page_threshold_ = (bytes > 0 && bytes < kHugePageSize) ? kHugePageSize : bytes;
+}
+
+void* HostAllocator::Allocate(size_t size, bool pinned)
+{
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    const int c = ClassIndex(size);
+    if (c < 0)
+    {
+        update_peak(&peak_bytes_in_use_, bytes_in_use_ += size);
+        return SystemAlloc(size, pinned);
+    }
+
+    const size_t bytes = size_t(1) << c;
+    void*        ptr   = NULL;
+    if (c <= kThreadCacheMaxClass)
+    {
+        ThreadCache* tc = thread_cache();
+        if (tc && tc->count[pinned][c] > 0)
+        {
+            ptr = tc->blocks[pinned][c][--tc->count[pinned][c]];
+        }
+    }
+    if (!ptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_[pinned][c].empty())
+        {
+            ptr = free_[pinned][c].back();
+            free_[pinned][c].pop_back();
+        }
+    }
+    if (ptr)
+    {
+        cache_hits_.fetch_add(1, std::memory_order_relaxed);
+        bytes_cached_ -= bytes;
+    }
+    else
+    {
+        ptr = SystemAlloc(bytes, pinned);
+    }
+    update_peak(&peak_bytes_in_use_, bytes_in_use_ += bytes);
+    return ptr;
+}
+
+void HostAllocator::Free(void* ptr, size_t size, bool pinned)
+{
+    if (!ptr)
+    {
+        return;
+    }
+    const int c = ClassIndex(size);
+    if (c < 0)
+    {
+        bytes_in_use_ -= size;
+        SystemFree(ptr, size, pinned);
+        return;
+    }
+
+    const size_t bytes = size_t(1) << c;
+    bytes_in_use_ -= bytes;
+    bytes_cached_ += bytes;
+    if (c <= kThreadCacheMaxClass)
+    {
+        ThreadCache* tc = thread_cache();
+        if (tc && tc->count[pinned][c] < kThreadCacheDepth)
+        {
+            tc->blocks[pinned][c][tc->count[pinned][c]++] = ptr;
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_[pinned][c].push_back(ptr);
+}
+
+void HostAllocator::Trim()
+{
+    ThreadCache* tc = thread_cache();
+    for (int p = 0; p < 2; ++p)
+    {
+        for (int c = kMinClass; c <= kMaxCachedClass; ++c)
+        {
+            std::vector<void*> blocks;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                blocks.swap(free_[p][c]);
+            }
+            if (tc && c <= kThreadCacheMaxClass)
+            {
+                blocks.insert(blocks.end(), tc->blocks[p][c], tc->blocks[p][c] + tc->count[p][c]);
+                tc->count[p][c] = 0;
+            }
+            for (void* ptr : blocks)
+            {
+                SystemFree(ptr, size_t(1) << c, p != 0);
+            }
+            bytes_cached_ -= blocks.size() << c;
+        }
+    }
+}
+
+HostAllocatorStats HostAllocator::stats() const
+{
+    HostAllocatorStats s;
+    s.allocations       = allocations_.load();
+    s.cache_hits        = cache_hits_.load();
+    s.system_allocs     = system_allocs_.load();
+    s.system_frees      = system_frees_.load();
+    s.huge_page_allocs  = huge_page_allocs_.load();
+    s.bytes_in_use      = bytes_in_use_.load();
+    s.peak_bytes_in_use = peak_bytes_in_use_.load();
+    s.bytes_cached      = bytes_cached_.load();
+    return s;
+}
+
+}  // namespace ferrari
@@ -1,15 +1,18 @@
 #include "math_functions.hpp"
 
 #include <limits>
+#ifndef CPU_ONLY
 #include <cuda_runtime.h>
+#endif
 #include "common.hpp"
 #include "device_alternate.hpp"
+#include "half.hpp"
 
 namespace ferrari
 {
 
 template <typename Dtype>
-void caffe_copy(const int N, const Dtype* X, Dtype* Y)
+void caffe_copy(const int64_t N, const Dtype* X, Dtype* Y)
 {
     if (X != Y)
     {
@@ -29,9 +32,13 @@ void caffe_copy(const int N, const Dtype* X, Dtype* Y)
     }
 }
 
-template void caffe_copy<int>(const int N, const int* X, int* Y);
-template void caffe_copy<unsigned int>(const int N, const unsigned int* X, unsigned int* Y);
-template void caffe_copy<float>(const int N, const float* X, float* Y);
-template void caffe_copy<double>(const int N, const double* X, double* Y);
+template void caffe_copy<int>(const int64_t N, const int* X, int* Y);
+template void caffe_copy<unsigned int>(const int64_t      N,
+                                       const unsigned int* X,
+                                       unsigned int*       Y);
+template void caffe_copy<float>(const int64_t N, const float* X, float* Y);
+template void caffe_copy<double>(const int64_t N, const double* X, double* Y);
+template void caffe_copy<float16>(const int64_t N, const float16* X, float16* Y);
+template void caffe_copy<bfloat16>(const int64_t N, const bfloat16* X, bfloat16* Y);
 
 }  // namespace ferrari
\ No newline at end of file
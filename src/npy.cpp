@@ -4,16 +4,24 @@
 
 #include "npy.hpp"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <complex>
 #include <cstdlib>
 #include <cstring>
 #include <iomanip>
-#include <regex>
+#include <numeric>
 #include <stdexcept>
 
+#include "half.hpp"
+#include "parallel.hpp"
+
 char cnpy::BigEndianTest()
 {
     int x = 1;
@@ -28,6 +36,8 @@ char cnpy::map_type(const std::type_info& t)
         return 'f';
     if (t == typeid(long double))
         return 'f';
+    if (t == typeid(ferrari::float16))
+        return 'f';
 
     if (t == typeid(int))
         return 'i';
@@ -54,6 +64,10 @@ char cnpy::map_type(const std::type_info& t)
     if (t == typeid(bool))
         return 'b';
 
+    // numpy has no bfloat16; it is stored as a raw 2-byte void field.
+    if (t == typeid(ferrari::bfloat16))
+        return 'V';
+
     if (t == typeid(std::complex<float>))
         return 'c';
     if (t == typeid(std::complex<double>))
@@ -85,51 +99,346 @@ std::vector<char>& cnpy::operator+=(std::vector<char>& lhs, const char* rhs)
     return lhs;
 }
 
-void cnpy::parse_npy_header(unsigned char*       buffer,
-                            size_t&              word_size,
-                            std::vector<size_t>& shape,
-                            bool&                fortran_order)
+namespace
+{
+
+// Single-pass recursive descent parser for the Python literal dict of an npy header, e.g.
+// {'descr': '<f4', 'fortran_order': False, 'shape': (3, 5), }
+class HeaderParser
 {
-    // std::string magic_string(buffer,6);
-    uint8_t     major_version = *reinterpret_cast<uint8_t*>(buffer + 6);
-    uint8_t     minor_version = *reinterpret_cast<uint8_t*>(buffer + 7);
-    uint16_t    header_len    = *reinterpret_cast<uint16_t*>(buffer + 8);
-    std::string header(reinterpret_cast<char*>(buffer + 9), header_len);
+public:
+    HeaderParser(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    void parse(cnpy::NpyHeader& h)
+    {
+        bool has_descr = false, has_order = false, has_shape = false;
+        expect('{');
+        while (!consume('}'))
+        {
+            const char* key;
+            size_t      len;
+            parse_string(key, len);
+            expect(':');
+            if (is(key, len, "descr"))
+            {
+                parse_descr(h);
+                has_descr = true;
+            }
+            else if (is(key, len, "fortran_order"))
+            {
+                h.fortran_order = parse_bool();
+                has_order       = true;
+            }
+            else if (is(key, len, "shape"))
+            {
+                parse_shape(h.shape);
+                has_shape = true;
+            }
+            else
+            {
+                fail("unknown key");
+            }
+            if (!consume(','))
+            {
+                expect('}');
+                break;
+            }
+        }
+        if (!has_descr || !has_order || !has_shape)
+            fail("missing 'descr', 'fortran_order' or 'shape'");
+    }
+
+private:
+    static bool is(const char* s, size_t len, const char* word)
+    {
+        return strlen(word) == len && memcmp(s, word, len) == 0;
+    }
+
+    [[noreturn]] void fail(const std::string& what)
+    {
+        throw std::runtime_error("parse_npy_header: " + what + " in header");
+    }
+
+    void skip_ws()
+    {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+            ++p_;
+    }
+
+    // skips white space, then c if it is next
+    bool consume(char c)
+    {
+        skip_ws();
+        if (p_ < end_ && *p_ == c)
+        {
+            ++p_;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c))
+            fail(std::string("expected '") + c + "'");
+    }
 
-    size_t loc1, loc2;
+    bool peek(char c)
+    {
+        skip_ws();
+        return p_ < end_ && *p_ == c;
+    }
+
+    // quoted with ' or ", without escapes (numpy never writes them)
+    void parse_string(const char*& s, size_t& len)
+    {
+        skip_ws();
+        if (p_ == end_ || (*p_ != '\'' && *p_ != '"'))
+            fail("expected a string");
+        const char quote = *p_++;
+        s                = p_;
+        while (p_ < end_ && *p_ != quote)
+            ++p_;
+        if (p_ == end_)
+            fail("unterminated string");
+        len = p_++ - s;
+    }
+
+    size_t parse_int()
+    {
+        skip_ws();
+        if (p_ == end_ || *p_ < '0' || *p_ > '9')
+            fail("expected an integer");
+        size_t v = 0;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9')
+            v = v * 10 + (*p_++ - '0');
+        // Python 2 long literals, e.g. (3L, 5L)
+        if (p_ < end_ && (*p_ == 'L' || *p_ == 'l'))
+            ++p_;
+        return v;
+    }
+
+    bool parse_bool()
+    {
+        skip_ws();
+        if (end_ - p_ >= 4 && memcmp(p_, "True", 4) == 0)
+        {
+            p_ += 4;
+            return true;
+        }
+        if (end_ - p_ >= 5 && memcmp(p_, "False", 5) == 0)
+        {
+            p_ += 5;
+            return false;
+        }
+        fail("expected True or False");
+    }
 
-    // fortran order
-    loc1          = header.find("fortran_order") + 16;
-    fortran_order = (header.substr(loc1, 4) == "True" ? true : false);
+    // (), (n,) or (n, m, ...) with an optional trailing comma
+    void parse_shape(std::vector<size_t>& shape)
+    {
+        shape.clear();
+        expect('(');
+        while (!consume(')'))
+        {
+            shape.push_back(parse_int());
+            if (!consume(','))
+            {
+                expect(')');
+                break;
+            }
+        }
+    }
+
+    // a type string such as '<f4', '|b1', '>c16', '<U10' or '<M8[ns]'
+    void parse_typestr(const char* s, size_t len, cnpy::NpyHeader& h)
+    {
+        const char* end = s + len;
+        h.byte_order    = '|';
+        if (s < end && (*s == '<' || *s == '>' || *s == '|' || *s == '='))
+            h.byte_order = *s++;
+        if (h.byte_order == '=')
+            h.byte_order = cnpy::BigEndianTest();
+        if (s == end)
+            fail("empty dtype");
+        h.type = *s++;
+        if (h.type == '?')
+        {
+            h.type      = 'b';
+            h.word_size = 1;
+        }
+        else
+        {
+            if (s == end || *s < '0' || *s > '9')
+                fail("dtype without item size");
+            size_t n = 0;
+            while (s < end && *s >= '0' && *s <= '9')
+                n = n * 10 + (*s++ - '0');
+            // datetime units, e.g. [ns], do not change the size
+            if (s < end && *s == '[')
+            {
+                s = static_cast<const char*>(memchr(s, ']', end - s));
+                if (s == NULL)
+                    fail("malformed dtype");
+                ++s;
+            }
+            if (s != end)
+                fail("malformed dtype");
+            // unicode strings count UCS4 characters
+            h.word_size = (h.type == 'U') ? 4 * n : n;
+        }
+        if (h.word_size == 1)
+            h.byte_order = '|';
+    }
+
+    // item size of a structured dtype: [('name', type[, shape]), ...], type being a type
+    // string or a nested list. Fields of more than one byte must be in native order.
+    size_t parse_fields()
+    {
+        size_t size = 0;
+        expect('[');
+        while (!consume(']'))
+        {
+            const char* s;
+            size_t      len;
+            expect('(');
+            if (peek('('))
+            {
+                // (title, name)
+                expect('(');
+                parse_string(s, len);
+                expect(',');
+                parse_string(s, len);
+                expect(')');
+            }
+            else
+            {
+                parse_string(s, len);
+            }
+            expect(',');
+            size_t field;
+            if (peek('['))
+            {
+                field = parse_fields();
+            }
+            else
+            {
+                cnpy::NpyHeader f;
+                parse_string(s, len);
+                parse_typestr(s, len, f);
+                if (f.byte_order != '|' && f.byte_order != cnpy::BigEndianTest())
+                    fail("structured dtype with foreign byte order");
+                field = f.word_size;
+            }
+            if (consume(','))
+            {
+                if (peek('('))
+                {
+                    std::vector<size_t> shape;
+                    parse_shape(shape);
+                    for (size_t d : shape)
+                        field *= d;
+                }
+                else
+                {
+                    field *= parse_int();
+                }
+                consume(',');
+            }
+            expect(')');
+            size += field;
+            if (!consume(','))
+            {
+                expect(']');
+                break;
+            }
+        }
+        return size;
+    }
 
-    // shape
-    loc1 = header.find("(");
-    loc2 = header.find(")");
+    void parse_descr(cnpy::NpyHeader& h)
+    {
+        if (peek('['))
+        {
+            h.byte_order = '|';
+            h.type       = 'V';
+            h.word_size  = parse_fields();
+            return;
+        }
+        const char* s;
+        size_t      len;
+        parse_string(s, len);
+        parse_typestr(s, len, h);
+    }
 
-    std::regex  num_regex("[0-9][0-9]*");
-    std::smatch sm;
-    shape.clear();
+    const char* p_;
+    const char* end_;
+};
 
-    std::string str_shape = header.substr(loc1 + 1, loc2 - loc1 - 1);
-    while (std::regex_search(str_shape, sm, num_regex))
+// Preamble: magic string, major and minor version, little endian header length (2 bytes in
+// version 1.0, 4 bytes since 2.0). Returns the preamble size, or 0 if size is too small.
+size_t parse_preamble(const unsigned char* buffer, size_t size, size_t& header_len)
+{
+    if (size < 10)
+        return 0;
+    if (buffer[0] != 0x93 || memcmp(buffer + 1, "NUMPY", 5) != 0)
+        throw std::runtime_error("parse_npy_header: not an npy file");
+    const uint8_t major_version = buffer[6];
+    if (major_version == 1)
     {
-        shape.push_back(std::stoi(sm[0].str()));
-        str_shape = sm.suffix().str();
+        header_len = buffer[8] | (buffer[9] << 8);
+        return 10;
     }
+    if (major_version != 2 && major_version != 3)
+        throw std::runtime_error("parse_npy_header: unsupported format version " +
+                                 std::to_string(major_version));
+    if (size < 12)
+        return 0;
+    header_len = (size_t)buffer[8] | ((size_t)buffer[9] << 8) | ((size_t)buffer[10] << 16) |
+                 ((size_t)buffer[11] << 24);
+    return 12;
+}
 
-    // endian, word size, data type
-    // byte order code | stands for not applicable.
-    // not sure when this applies except for byte array
-    loc1              = header.find("descr") + 9;
-    bool littleEndian = (header[loc1] == '<' || header[loc1] == '|' ? true : false);
-    assert(littleEndian);
+}  // namespace
 
-    // char type = header[loc1+1];
-    // assert(type == map_type(T));
+size_t cnpy::NpyHeader::num_vals() const
+{
+    return std::accumulate(shape.begin(), shape.end(), (size_t)1, std::multiplies<size_t>());
+}
+
+cnpy::NpyHeader cnpy::parse_npy_header(const unsigned char* buffer, size_t size)
+{
+    size_t header_len = 0;
+    size_t preamble   = parse_preamble(buffer, size, header_len);
+    if (preamble == 0 || preamble + header_len > size)
+        throw std::runtime_error("parse_npy_header: truncated header");
+
+    NpyHeader header;
+    header.data_offset = preamble + header_len;
+    const char* dict   = reinterpret_cast<const char*>(buffer + preamble);
+    HeaderParser(dict, dict + header_len).parse(header);
+    return header;
+}
+
+cnpy::NpyHeader cnpy::parse_npy_header(FILE* fp)
+{
+    unsigned char preamble[12];
+    size_t        header_len = 0;
+    if (fread(preamble, 1, 10, fp) != 10)
+        throw std::runtime_error("parse_npy_header: failed fread");
+    size_t size = parse_preamble(preamble, 10, header_len);
+    if (size == 0)
+    {
+        if (fread(preamble + 10, 1, 2, fp) != 2)
+            throw std::runtime_error("parse_npy_header: failed fread");
+        size = parse_preamble(preamble, 12, header_len);
+    }
 
-    std::string str_ws = header.substr(loc1 + 2);
-    loc2               = str_ws.find("'");
-    word_size          = atoi(str_ws.substr(0, loc2).c_str());
+    std::vector<unsigned char> buffer(size + header_len);
+    memcpy(&buffer[0], preamble, size);
+    if (fread(&buffer[size], 1, header_len, fp) != header_len)
+        throw std::runtime_error("parse_npy_header: failed fread");
+    return parse_npy_header(&buffer[0], buffer.size());
 }
 
 void cnpy::parse_npy_header(FILE*                fp,
@@ -137,56 +446,70 @@ void cnpy::parse_npy_header(FILE*                fp,
                             std::vector<size_t>& shape,
                             bool&                fortran_order)
 {
-    char   buffer[256];
-    size_t res = fread(buffer, sizeof(char), 11, fp);
-    if (res != 11)
-        throw std::runtime_error("parse_npy_header: failed fread");
-    std::string header = fgets(buffer, 256, fp);
-    assert(header[header.size() - 1] == '\n');
-
-    size_t loc1, loc2;
-
-    // fortran order
-    loc1 = header.find("fortran_order");
-    if (loc1 == std::string::npos)
-        throw std::runtime_error(
-            "parse_npy_header: failed to find header keyword: 'fortran_order'");
-    loc1 += 16;
-    fortran_order = (header.substr(loc1, 4) == "True" ? true : false);
+    NpyHeader header = parse_npy_header(fp);
+    word_size        = header.word_size;
+    shape            = header.shape;
+    fortran_order    = header.fortran_order;
+}
 
-    // shape
-    loc1 = header.find("(");
-    loc2 = header.find(")");
-    if (loc1 == std::string::npos || loc2 == std::string::npos)
-        throw std::runtime_error("parse_npy_header: failed to find header keyword: '(' or ')'");
+bool cnpy::needs_byteswap(const NpyHeader& header)
+{
+    return header.byte_order != '|' && header.byte_order != BigEndianTest();
+}
 
-    std::regex  num_regex("[0-9][0-9]*");
-    std::smatch sm;
-    shape.clear();
+void cnpy::byteswap(char* data, size_t num_vals, const NpyHeader& header)
+{
+    // complex numbers are two floats, unicode strings UCS4 characters
+    size_t unit = header.word_size;
+    if (header.type == 'c')
+        unit /= 2;
+    else if (header.type == 'U')
+        unit = 4;
+    if (unit <= 1)
+        return;
+    const size_t n = num_vals * header.word_size / unit;
+    for (size_t i = 0; i < n; ++i)
+        std::reverse(data + i * unit, data + (i + 1) * unit);
+}
 
-    std::string str_shape = header.substr(loc1 + 1, loc2 - loc1 - 1);
-    while (std::regex_search(str_shape, sm, num_regex))
+std::vector<char> cnpy::create_npy_header(char                       type,
+                                          size_t                     word_size,
+                                          const std::vector<size_t>& shape,
+                                          size_t                     size)
+{
+    std::vector<char> dict;
+    dict += "{'descr': '";
+    dict += BigEndianTest();
+    dict += type;
+    dict += std::to_string(word_size);
+    dict += "', 'fortran_order': False, 'shape': (";
+    for (size_t i = 0; i < shape.size(); i++)
     {
-        shape.push_back(std::stoi(sm[0].str()));
-        str_shape = sm.suffix().str();
+        if (i > 0)
+            dict += ", ";
+        dict += std::to_string(shape[i]);
     }
-
-    // endian, word size, data type
-    // byte order code | stands for not applicable.
-    // not sure when this applies except for byte array
-    loc1 = header.find("descr");
-    if (loc1 == std::string::npos)
-        throw std::runtime_error("parse_npy_header: failed to find header keyword: 'descr'");
-    loc1 += 9;
-    bool littleEndian = (header[loc1] == '<' || header[loc1] == '|' ? true : false);
-    assert(littleEndian);
-
-    // char type = header[loc1+1];
-    // assert(type == map_type(T));
-
-    std::string str_ws = header.substr(loc1 + 2);
-    loc2               = str_ws.find("'");
-    word_size          = atoi(str_ws.substr(0, loc2).c_str());
+    if (shape.size() == 1)
+        dict += ",";
+    dict += "), }";
+    // pad with spaces so that preamble+dict is modulo 64 bytes, as numpy does, so that the data
+    // can be mapped in place with the alignment of CaffeMallocHost. preamble is 10 bytes. dict
+    // needs to end with \n
+    size_t total = (10 + dict.size() + 1 + 63) / 64 * 64;
+    if (size > total)
+        total = (size + 63) / 64 * 64;
+    dict.insert(dict.end(), total - 10 - dict.size(), ' ');
+    dict.back() = '\n';
+
+    std::vector<char> header;
+    header += (char)0x93;
+    header += "NUMPY";
+    header += (char)0x01;  // major version of numpy format
+    header += (char)0x00;  // minor version of numpy format
+    header += (uint16_t)dict.size();
+    header.insert(header.end(), dict.begin(), dict.end());
+
+    return header;
 }
 
 void cnpy::parse_zip_footer(FILE*     fp,
@@ -217,182 +540,691 @@ void cnpy::parse_zip_footer(FILE*     fp,
 
 cnpy::NpyArray load_the_npy_file(FILE* fp)
 {
-    std::vector<size_t> shape;
-    size_t              word_size;
-    bool                fortran_order;
-    cnpy::parse_npy_header(fp, word_size, shape, fortran_order);
+    cnpy::NpyHeader header = cnpy::parse_npy_header(fp);
 
-    cnpy::NpyArray arr(shape, word_size, fortran_order);
-    size_t         nread = fread(arr.data<char>(), 1, arr.num_bytes(), fp);
+    cnpy::NpyArray arr(header.shape, header.word_size, header.fortran_order);
+    arr.type     = header.type;
+    size_t nread = fread(arr.data<char>(), 1, arr.num_bytes(), fp);
     if (nread != arr.num_bytes())
         throw std::runtime_error("load_the_npy_file: failed fread");
+    if (cnpy::needs_byteswap(header))
+        cnpy::byteswap(arr.data<char>(), arr.num_vals, header);
     return arr;
 }
 
-cnpy::NpyArray load_the_npz_array(FILE* fp, uint32_t compr_bytes, uint32_t uncompr_bytes)
+cnpy::npz_t cnpy::npz_load(std::string fname)
 {
-    std::vector<unsigned char> buffer_compr(compr_bytes);
-    std::vector<unsigned char> buffer_uncompr(uncompr_bytes);
-    size_t                     nread = fread(&buffer_compr[0], 1, compr_bytes, fp);
-    if (nread != compr_bytes)
-        throw std::runtime_error("load_the_npy_file: failed fread");
+    return NpzReader(fname).load_all();
+}
 
-    int      err;
-    z_stream d_stream;
+cnpy::NpyArray cnpy::npz_load(std::string fname, std::string varname)
+{
+    return NpzReader(fname).load(varname);
+}
 
-    d_stream.zalloc   = Z_NULL;
-    d_stream.zfree    = Z_NULL;
-    d_stream.opaque   = Z_NULL;
-    d_stream.avail_in = 0;
-    d_stream.next_in  = Z_NULL;
-    err               = inflateInit2(&d_stream, -MAX_WBITS);
+cnpy::NpyArray cnpy::npy_load(std::string fname)
+{
+    FILE* fp = fopen(fname.c_str(), "rb");
 
-    d_stream.avail_in  = compr_bytes;
-    d_stream.next_in   = &buffer_compr[0];
-    d_stream.avail_out = uncompr_bytes;
-    d_stream.next_out  = &buffer_uncompr[0];
+    if (!fp)
+        throw std::runtime_error("npy_load: Unable to open file " + fname);
 
-    err = inflate(&d_stream, Z_FINISH);
-    err = inflateEnd(&d_stream);
+    NpyArray arr = load_the_npy_file(fp);
+
+    fclose(fp);
+    return arr;
+}
 
-    std::vector<size_t> shape;
-    size_t              word_size;
-    bool                fortran_order;
-    cnpy::parse_npy_header(&buffer_uncompr[0], word_size, shape, fortran_order);
+size_t cnpy::npy_load_header(std::string          fname,
+                             size_t&              word_size,
+                             std::vector<size_t>& shape,
+                             bool&                fortran_order)
+{
+    FILE* fp = fopen(fname.c_str(), "rb");
 
-    cnpy::NpyArray array(shape, word_size, fortran_order);
+    if (!fp)
+        throw std::runtime_error("npy_load_header: Unable to open file " + fname);
 
-    size_t offset = uncompr_bytes - array.num_bytes();
-    memcpy(array.data<unsigned char>(), &buffer_uncompr[0] + offset, array.num_bytes());
+    parse_npy_header(fp, word_size, shape, fortran_order);
+    size_t offset = ftell(fp);
 
-    return array;
+    fclose(fp);
+    return offset;
 }
 
-cnpy::npz_t cnpy::npz_load(std::string fname)
+cnpy::NpyHeader cnpy::npy_load_header(std::string fname)
+{
+    FILE* fp = fopen(fname.c_str(), "rb");
+
+    if (!fp)
+        throw std::runtime_error("npy_load_header: Unable to open file " + fname);
+
+    NpyHeader header = parse_npy_header(fp);
+
+    fclose(fp);
+    return header;
+}
+
+cnpy::NpyArray cnpy::npy_mmap(std::string fname)
 {
     FILE* fp = fopen(fname.c_str(), "rb");
 
     if (!fp)
+        throw std::runtime_error("npy_mmap: Unable to open file " + fname);
+
+    NpyHeader header = parse_npy_header(fp);
+    NpyArray  arr;
+    arr.shape         = header.shape;
+    arr.word_size     = header.word_size;
+    arr.type          = header.type;
+    arr.fortran_order = header.fortran_order;
+    arr.num_vals      = header.num_vals();
+    size_t offset     = header.data_offset;
+    size_t length     = offset + arr.num_vals * arr.word_size;
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || (size_t)st.st_size < length)
     {
-        throw std::runtime_error("npz_load: Error! Unable to open file " + fname + "!");
+        fclose(fp);
+        throw std::runtime_error("npy_mmap: " + fname + " is shorter than its header says");
     }
+    // map from the start of the file so the mmap offset is page aligned. MAP_PRIVATE keeps
+    // writes through data() out of the file.
+    void* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+    fclose(fp);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("npy_mmap: Unable to map file " + fname);
+
+    std::shared_ptr<char> mapping((char*)base, [length](char* p) { munmap(p, length); });
+    arr.mapped_data = std::shared_ptr<char>(mapping, (char*)base + offset);
+    // swapping dirties the private pages, so foreign-endian files lose the zero-copy benefit
+    if (needs_byteswap(header))
+        byteswap(arr.mapped_data.get(), arr.num_vals, header);
+    return arr;
+}
 
-    cnpy::npz_t arrays;
+namespace
+{
 
-    while (1)
-    {
-        std::vector<char> local_header(30);
-        size_t            headerres = fread(&local_header[0], sizeof(char), 30, fp);
-        if (headerres != 30)
-            throw std::runtime_error("npz_load: failed fread");
+// compressed bytes read per pread while inflating a member
+const size_t kInflateChunk = 1 << 18;
+// bytes fed to crc32 and deflate per call while writing a member, and deflate output buffered
+const size_t kDeflateInput  = 1 << 20;
+const size_t kDeflateOutput = 1 << 18;
 
-        // if we've reached the global header, stop reading
-        if (local_header[2] != 0x03 || local_header[3] != 0x04)
-            break;
+uint16_t le16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
 
-        // read in the variable name
-        uint16_t    name_len = *(uint16_t*)&local_header[26];
-        std::string varname(name_len, ' ');
-        size_t      vname_res = fread(&varname[0], sizeof(char), name_len, fp);
-        if (vname_res != name_len)
-            throw std::runtime_error("npz_load: failed fread");
+uint32_t le32(const unsigned char* p)
+{
+    return (uint32_t)le16(p) | ((uint32_t)le16(p + 2) << 16);
+}
 
-        // erase the lagging .npy
-        varname.erase(varname.end() - 4, varname.end());
+uint64_t le64(const unsigned char* p)
+{
+    return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+void pread_full(int fd, void* dst, size_t n, uint64_t offset, const std::string& fname)
+{
+    char* p = static_cast<char*>(dst);
+    while (n > 0)
+    {
+        ssize_t res = pread(fd, p, n, offset);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            throw std::runtime_error("npz_load: failed read of " + fname);
+        p += res;
+        n -= res;
+        offset += res;
+    }
+}
 
-        // read in the extra field
-        uint16_t extra_field_len = *(uint16_t*)&local_header[28];
-        if (extra_field_len > 0)
+// The uncompressed bytes of one member, read in order. Stored members are read straight into
+// the destination; deflated ones are inflated into it from a small chunk of input.
+class MemberStream
+{
+public:
+    MemberStream(int fd, const std::string& fname, uint64_t offset, const cnpy::NpzEntry& entry)
+        : fd_(fd), fname_(fname), pos_(offset), remaining_(entry.compressed_size)
+    {
+        deflated_ = (entry.compression == 8);
+        if (entry.compression != 0 && !deflated_)
+            throw std::runtime_error("npz_load: " + entry.name + " in " + fname +
+                                     " uses an unsupported compression method");
+        if (deflated_)
         {
-            std::vector<char> buff(extra_field_len);
-            size_t            efield_res = fread(&buff[0], sizeof(char), extra_field_len, fp);
-            if (efield_res != extra_field_len)
-                throw std::runtime_error("npz_load: failed fread");
+            memset(&z_, 0, sizeof(z_));
+            if (inflateInit2(&z_, -MAX_WBITS) != Z_OK)
+                throw std::runtime_error("npz_load: inflateInit2 failed");
+            chunk_.resize(std::min<uint64_t>(kInflateChunk, remaining_));
         }
+    }
 
-        uint16_t compr_method  = *reinterpret_cast<uint16_t*>(&local_header[0] + 8);
-        uint32_t compr_bytes   = *reinterpret_cast<uint32_t*>(&local_header[0] + 18);
-        uint32_t uncompr_bytes = *reinterpret_cast<uint32_t*>(&local_header[0] + 22);
+    ~MemberStream()
+    {
+        if (deflated_)
+            inflateEnd(&z_);
+    }
 
-        if (compr_method == 0)
+    void read(void* dst, size_t n)
+    {
+        if (!deflated_)
         {
-            arrays[varname] = load_the_npy_file(fp);
+            if (n > remaining_)
+                throw std::runtime_error("npz_load: member of " + fname_ + " is truncated");
+            pread_full(fd_, dst, n, pos_, fname_);
+            pos_ += n;
+            remaining_ -= n;
+            return;
         }
-        else
+        unsigned char* out = static_cast<unsigned char*>(dst);
+        while (n > 0)
         {
-            arrays[varname] = load_the_npz_array(fp, compr_bytes, uncompr_bytes);
+            // avail_out is 32 bits wide
+            const uInt step = (uInt)std::min<size_t>(n, 1u << 30);
+            z_.next_out     = out;
+            z_.avail_out    = step;
+            while (z_.avail_out > 0)
+            {
+                if (z_.avail_in == 0)
+                {
+                    const size_t size = std::min<uint64_t>(chunk_.size(), remaining_);
+                    if (size == 0)
+                        throw std::runtime_error("npz_load: member of " + fname_ +
+                                                 " is truncated");
+                    pread_full(fd_, &chunk_[0], size, pos_, fname_);
+                    pos_ += size;
+                    remaining_ -= size;
+                    z_.next_in  = &chunk_[0];
+                    z_.avail_in = (uInt)size;
+                }
+                int err = inflate(&z_, Z_NO_FLUSH);
+                if (err == Z_STREAM_END && z_.avail_out > 0)
+                    throw std::runtime_error("npz_load: member of " + fname_ + " is truncated");
+                if (err != Z_OK && err != Z_STREAM_END)
+                    throw std::runtime_error("npz_load: corrupt deflate data in " + fname_);
+            }
+            out += step;
+            n -= step;
         }
     }
 
-    fclose(fp);
-    return arrays;
+private:
+    int                        fd_;
+    const std::string&         fname_;
+    uint64_t                   pos_;
+    uint64_t                   remaining_;  // compressed bytes not read yet
+    bool                       deflated_;
+    z_stream                   z_;
+    std::vector<unsigned char> chunk_;
+};
+
+// Locates the central directory from the end of central directory record, following the ZIP64
+// locator when the 16/32-bit fields overflowed.
+void find_central_directory(int                fd,
+                            const std::string& fname,
+                            uint64_t&          nrecs,
+                            uint64_t&          dir_size,
+                            uint64_t&          dir_offset)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        throw std::runtime_error("npz_load: Unable to stat file " + fname);
+    const uint64_t size = st.st_size;
+
+    // the end of central directory record: 22 bytes, then a comment of up to 64 KB
+    const size_t               tail_size = std::min<uint64_t>(size, 22 + 65535);
+    std::vector<unsigned char> tail(tail_size);
+    if (tail_size < 22)
+        throw std::runtime_error("npz_load: " + fname + " is not a zip file");
+    pread_full(fd, &tail[0], tail_size, size - tail_size, fname);
+    size_t eocd = tail_size - 22;
+    while (le32(&tail[eocd]) != 0x06054b50)
+    {
+        if (eocd == 0)
+            throw std::runtime_error("npz_load: " + fname + " has no zip directory");
+        --eocd;
+    }
+    const uint64_t eocd_offset = size - tail_size + eocd;
+    nrecs                      = le16(&tail[eocd + 10]);
+    dir_size                   = le32(&tail[eocd + 12]);
+    dir_offset                 = le32(&tail[eocd + 16]);
+
+    // ZIP64: the real values are in a record found through the locator before the footer
+    if ((nrecs == 0xffff || dir_size == 0xffffffff || dir_offset == 0xffffffff) &&
+        eocd_offset >= 20)
+    {
+        unsigned char locator[20];
+        pread_full(fd, locator, 20, eocd_offset - 20, fname);
+        if (le32(locator) == 0x07064b50)
+        {
+            unsigned char record[56];
+            pread_full(fd, record, 56, le64(locator + 8), fname);
+            if (le32(record) != 0x06064b50)
+                throw std::runtime_error("npz_load: bad zip64 directory in " + fname);
+            nrecs      = le64(record + 32);
+            dir_size   = le64(record + 40);
+            dir_offset = le64(record + 48);
+        }
+    }
+    if (dir_offset + dir_size > size)
+        throw std::runtime_error("npz_load: zip directory of " + fname + " is truncated");
 }
 
-cnpy::NpyArray cnpy::npz_load(std::string fname, std::string varname)
-{
-    FILE* fp = fopen(fname.c_str(), "rb");
+}  // namespace
 
-    if (!fp)
+cnpy::NpzReader::NpzReader(const std::string& fname) : fname_(fname)
+{
+    fd_ = open(fname.c_str(), O_RDONLY);
+    if (fd_ < 0)
         throw std::runtime_error("npz_load: Unable to open file " + fname);
+    try
+    {
+        read_central_directory();
+    }
+    catch (...)
+    {
+        close(fd_);
+        throw;
+    }
+}
+
+cnpy::NpzReader::~NpzReader()
+{
+    close(fd_);
+}
+
+void cnpy::NpzReader::read_central_directory()
+{
+    uint64_t nrecs, dir_size, dir_offset;
+    find_central_directory(fd_, fname_, nrecs, dir_size, dir_offset);
+
+    std::vector<unsigned char> dir(dir_size);
+    if (dir_size > 0)
+        pread_full(fd_, &dir[0], dir_size, dir_offset, fname_);
+    size_t pos = 0;
+    for (uint64_t i = 0; i < nrecs; ++i)
+    {
+        if (pos + 46 > dir.size() || le32(&dir[pos]) != 0x02014b50)
+            throw std::runtime_error("npz_load: bad zip directory entry in " + fname_);
+        const unsigned char* rec       = &dir[pos];
+        const size_t         name_len  = le16(rec + 28);
+        const size_t         extra_len = le16(rec + 30);
+        const size_t         next      = pos + 46 + name_len + extra_len + le16(rec + 32);
+        if (next > dir.size())
+            throw std::runtime_error("npz_load: bad zip directory entry in " + fname_);
+
+        NpzEntry entry;
+        entry.name              = std::string((const char*)rec + 46, name_len);
+        entry.compression       = le16(rec + 10);
+        entry.crc               = le32(rec + 16);
+        entry.compressed_size   = le32(rec + 20);
+        entry.uncompressed_size = le32(rec + 24);
+        entry.header_offset     = le32(rec + 42);
+
+        // ZIP64 extended information: the 64-bit values of the fields set to 0xffffffff
+        const unsigned char* extra = rec + 46 + name_len;
+        for (size_t e = 0; e + 4 <= extra_len;)
+        {
+            const uint16_t       id    = le16(extra + e);
+            const size_t         len   = le16(extra + e + 2);
+            const unsigned char* field = extra + e + 4;
+            const unsigned char* end   = field + std::min(len, extra_len - e - 4);
+            if (id == 0x0001)
+            {
+                if (entry.uncompressed_size == 0xffffffff && field + 8 <= end)
+                {
+                    entry.uncompressed_size = le64(field);
+                    field += 8;
+                }
+                if (entry.compressed_size == 0xffffffff && field + 8 <= end)
+                {
+                    entry.compressed_size = le64(field);
+                    field += 8;
+                }
+                if (entry.header_offset == 0xffffffff && field + 8 <= end)
+                    entry.header_offset = le64(field);
+            }
+            e += 4 + len;
+        }
 
-    while (1)
+        // erase the lagging .npy
+        if (entry.name.size() >= 4 && entry.name.compare(entry.name.size() - 4, 4, ".npy") == 0)
+            entry.name.erase(entry.name.size() - 4);
+        index_[entry.name] = entries_.size();
+        entries_.push_back(entry);
+        pos = next;
+    }
+}
+
+const cnpy::NpzEntry* cnpy::NpzReader::find(const std::string& varname) const
+{
+    std::map<std::string, size_t>::const_iterator it = index_.find(varname);
+    return it == index_.end() ? NULL : &entries_[it->second];
+}
+
+cnpy::NpyHeader cnpy::NpzReader::read(const std::string&                             varname,
+                                      const std::function<char*(const NpyHeader&)>& destination)
+    const
+{
+    const NpzEntry* entry = find(varname);
+    if (entry == NULL)
+        throw std::runtime_error("npz_load: Variable name " + varname + " not found in " +
+                                 fname_);
+
+    unsigned char local_header[30];
+    pread_full(fd_, local_header, 30, entry->header_offset, fname_);
+    if (le32(local_header) != 0x04034b50)
+        throw std::runtime_error("npz_load: bad local header for " + varname + " in " + fname_);
+    // the local name and extra field may differ from the central directory's
+    const uint64_t data_offset =
+        entry->header_offset + 30 + le16(local_header + 26) + le16(local_header + 28);
+    MemberStream in(fd_, fname_, data_offset, *entry);
+
+    std::vector<unsigned char> head(12);
+    size_t                     header_len = 0;
+    in.read(&head[0], 10);
+    size_t preamble = parse_preamble(&head[0], 10, header_len);
+    if (preamble == 0)
     {
-        std::vector<char> local_header(30);
-        size_t            header_res = fread(&local_header[0], sizeof(char), 30, fp);
-        if (header_res != 30)
-            throw std::runtime_error("npz_load: failed fread");
+        in.read(&head[10], 2);
+        preamble = parse_preamble(&head[0], 12, header_len);
+    }
+    head.resize(preamble + header_len);
+    in.read(&head[preamble], header_len);
+    NpyHeader header = parse_npy_header(&head[0], head.size());
 
-        // if we've reached the global header, stop reading
-        if (local_header[2] != 0x03 || local_header[3] != 0x04)
-            break;
+    char* data = destination(header);
+    in.read(data, header.num_vals() * header.word_size);
+    if (needs_byteswap(header))
+    {
+        byteswap(data, header.num_vals(), header);
+        header.byte_order = BigEndianTest();
+    }
+    return header;
+}
 
-        // read in the variable name
-        uint16_t    name_len = *(uint16_t*)&local_header[26];
-        std::string vname(name_len, ' ');
-        size_t      vname_res = fread(&vname[0], sizeof(char), name_len, fp);
-        if (vname_res != name_len)
-            throw std::runtime_error("npz_load: failed fread");
-        vname.erase(vname.end() - 4, vname.end());  // erase the lagging .npy
+cnpy::NpyArray cnpy::NpzReader::load(const std::string& varname) const
+{
+    NpyArray array;
+    read(varname,
+         [&array](const NpyHeader& header)
+         {
+             array      = NpyArray(header.shape, header.word_size, header.fortran_order);
+             array.type = header.type;
+             return array.data<char>();
+         });
+    return array;
+}
 
-        // read in the extra field
-        uint16_t extra_field_len = *(uint16_t*)&local_header[28];
-        fseek(fp, extra_field_len, SEEK_CUR);  // skip past the extra field
+cnpy::npz_t cnpy::NpzReader::load_all() const
+{
+    std::vector<NpyArray> arrays(entries_.size());
+    ferrari::parallel_for(0,
+                          entries_.size(),
+                          1,
+                          [&](int64_t begin, int64_t end)
+                          {
+                              for (int64_t i = begin; i < end; ++i)
+                                  arrays[i] = load(entries_[i].name);
+                          });
+
+    npz_t result;
+    for (size_t i = 0; i < entries_.size(); ++i)
+        result[entries_[i].name] = arrays[i];
+    return result;
+}
 
-        uint16_t compr_method  = *reinterpret_cast<uint16_t*>(&local_header[0] + 8);
-        uint32_t compr_bytes   = *reinterpret_cast<uint32_t*>(&local_header[0] + 18);
-        uint32_t uncompr_bytes = *reinterpret_cast<uint32_t*>(&local_header[0] + 22);
+cnpy::NpzWriter::NpzWriter(const std::string& fname, const std::string& mode, int level)
+    : fname_(fname), fp_(NULL), level_(level), offset_(0), nrecs_(0), out_(kDeflateOutput)
+{
+    if (mode == "a")
+        fp_ = fopen(fname.c_str(), "r+b");
 
-        if (vname == varname)
+    if (fp_)
+    {
+        // keep the existing members and their directory entries; new members are written
+        // where the old directory starts
+        try
         {
-            NpyArray array = (compr_method == 0)
-                                 ? load_the_npy_file(fp)
-                                 : load_the_npz_array(fp, compr_bytes, uncompr_bytes);
-            fclose(fp);
-            return array;
+            uint64_t dir_size;
+            find_central_directory(fileno(fp_), fname, nrecs_, dir_size, offset_);
+            directory_.resize(dir_size);
+            if (dir_size > 0)
+                pread_full(fileno(fp_), &directory_[0], dir_size, offset_, fname);
         }
-        else
+        catch (...)
         {
-            // skip past the data
-            uint32_t size = *(uint32_t*)&local_header[22];
-            fseek(fp, size, SEEK_CUR);
+            fclose(fp_);
+            throw;
         }
+        fseeko(fp_, offset_, SEEK_SET);
+    }
+    else
+    {
+        fp_ = fopen(fname.c_str(), "wb");
+        if (!fp_)
+            throw std::runtime_error("npz_save: Unable to open file " + fname);
     }
+}
 
-    fclose(fp);
+cnpy::NpzWriter::~NpzWriter()
+{
+    if (!fp_)
+        return;
+    try
+    {
+        close();
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << e.what();
+    }
+}
 
-    // if we get here, we haven't found the variable in the file
-    throw std::runtime_error("npz_load: Variable name " + varname + " not found in " + fname);
+void cnpy::NpzWriter::write(const void* data, size_t nbytes)
+{
+    if (nbytes > 0 && fwrite(data, 1, nbytes, fp_) != nbytes)
+        throw std::runtime_error("npz_save: failed write to " + fname_);
+    offset_ += nbytes;
 }
 
-cnpy::NpyArray cnpy::npy_load(std::string fname)
+void cnpy::NpzWriter::patch(uint64_t offset, const std::vector<char>& bytes)
 {
-    FILE* fp = fopen(fname.c_str(), "rb");
+    if (fseeko(fp_, offset, SEEK_SET) != 0 ||
+        fwrite(&bytes[0], 1, bytes.size(), fp_) != bytes.size() ||
+        fseeko(fp_, offset_, SEEK_SET) != 0)
+        throw std::runtime_error("npz_save: failed write to " + fname_);
+}
 
-    if (!fp)
-        throw std::runtime_error("npy_load: Unable to open file " + fname);
+void cnpy::NpzWriter::deflate_chunk(z_stream* z, const void* data, size_t nbytes, bool finish)
+{
+    z->next_in  = (Bytef*)data;
+    z->avail_in = (uInt)nbytes;
+    int err;
+    do
+    {
+        z->next_out  = (Bytef*)&out_[0];
+        z->avail_out = (uInt)out_.size();
+        err          = deflate(z, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (err == Z_STREAM_ERROR)
+            throw std::runtime_error("npz_save: deflate failed");
+        write(&out_[0], out_.size() - z->avail_out);
+    } while (finish ? err != Z_STREAM_END : z->avail_out == 0);
+}
 
-    NpyArray arr = load_the_npy_file(fp);
+void cnpy::NpzWriter::add(const std::string&       name,
+                          const std::vector<char>& npy_header,
+                          const void*              data,
+                          size_t                   nbytes)
+{
+    if (!fp_)
+        throw std::runtime_error("npz_save: " + fname_ + " is already closed");
+
+    const std::string fname         = name + ".npy";
+    const uint64_t    uncompressed  = npy_header.size() + nbytes;
+    const uint16_t    method        = (level_ == 0) ? 0 : 8;
+    const uint64_t    header_offset = offset_;
+    // the compressed size is only known afterwards: reserve ZIP64 fields if it may not fit
+    const bool zip64 = (method == 0 ? uncompressed : compressBound(uncompressed)) >= 0xffffffff;
+
+    // local header; crc and compressed size are patched in once the data is written
+    std::vector<char> local_header;
+    local_header += "PK";                                           // first part of sig
+    local_header += (uint16_t)0x0403;                               // second part of sig
+    local_header += (uint16_t)(zip64 ? 45 : 20);                    // min version to extract
+    local_header += (uint16_t)0;                                    // general purpose bit flag
+    local_header += (uint16_t)method;                               // compression method
+    local_header += (uint16_t)0;                                    // file last mod time
+    local_header += (uint16_t)0;                                    // file last mod date
+    local_header += (uint32_t)0;                                    // crc
+    local_header += (uint32_t)(zip64 ? 0xffffffff : 0);             // compressed size
+    local_header += (uint32_t)(zip64 ? 0xffffffff : uncompressed);  // uncompressed size
+    local_header += (uint16_t)fname.size();                         // fname length
+    local_header += (uint16_t)(zip64 ? 20 : 0);                     // extra field length
+    local_header += fname;
+    if (zip64)
+    {
+        local_header += (uint16_t)0x0001;  // ZIP64 extended information
+        local_header += (uint16_t)16;
+        local_header += (uint64_t)uncompressed;
+        local_header += (uint64_t)0;  // compressed size
+    }
+    write(&local_header[0], local_header.size());
 
-    fclose(fp);
-    return arr;
+    // stream the npy header and the data, computing the crc on the way
+    const uint64_t data_offset = offset_;
+    uint32_t       crc         = crc32(0L, (const Bytef*)&npy_header[0], npy_header.size());
+    z_stream       z;
+    if (method == 8)
+    {
+        memset(&z, 0, sizeof(z));
+        if (deflateInit2(&z, level_, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("npz_save: deflateInit2 failed");
+        deflate_chunk(&z, &npy_header[0], npy_header.size(), false);
+    }
+    else
+    {
+        write(&npy_header[0], npy_header.size());
+    }
+    const char* p = static_cast<const char*>(data);
+    for (size_t done = 0; done < nbytes;)
+    {
+        const size_t n = std::min(kDeflateInput, nbytes - done);
+        crc            = crc32(crc, (const Bytef*)p + done, (uInt)n);
+        if (method == 8)
+            deflate_chunk(&z, p + done, n, false);
+        else
+            write(p + done, n);
+        done += n;
+    }
+    if (method == 8)
+    {
+        deflate_chunk(&z, NULL, 0, true);
+        deflateEnd(&z);
+    }
+    const uint64_t compressed = offset_ - data_offset;
+
+    std::vector<char> sizes;
+    sizes += (uint32_t)crc;
+    if (!zip64)
+        sizes += (uint32_t)compressed;
+    patch(header_offset + 14, sizes);
+    if (zip64)
+    {
+        sizes.clear();
+        sizes += (uint64_t)compressed;
+        patch(header_offset + 30 + fname.size() + 12, sizes);
+    }
+
+    // central directory entry, with ZIP64 fields for everything once anything overflows
+    const bool big = zip64 || header_offset >= 0xffffffff;
+    directory_ += "PK";                                          // first part of sig
+    directory_ += (uint16_t)0x0201;                              // second part of sig
+    directory_ += (uint16_t)(big ? 45 : 20);                     // version made by
+    directory_ += (uint16_t)(big ? 45 : 20);                     // min version to extract
+    directory_ += (uint16_t)0;                                   // general purpose bit flag
+    directory_ += (uint16_t)method;                              // compression method
+    directory_ += (uint16_t)0;                                   // file last mod time
+    directory_ += (uint16_t)0;                                   // file last mod date
+    directory_ += (uint32_t)crc;                                 // crc
+    directory_ += (uint32_t)(big ? 0xffffffff : compressed);     // compressed size
+    directory_ += (uint32_t)(big ? 0xffffffff : uncompressed);   // uncompressed size
+    directory_ += (uint16_t)fname.size();                        // fname length
+    directory_ += (uint16_t)(big ? 28 : 0);                      // extra field length
+    directory_ += (uint16_t)0;                                   // file comment length
+    directory_ += (uint16_t)0;                                   // disk where the file starts
+    directory_ += (uint16_t)0;                                   // internal file attributes
+    directory_ += (uint32_t)0;                                   // external file attributes
+    directory_ += (uint32_t)(big ? 0xffffffff : header_offset);  // offset of local header
+    directory_ += fname;
+    if (big)
+    {
+        directory_ += (uint16_t)0x0001;  // ZIP64 extended information
+        directory_ += (uint16_t)24;
+        directory_ += (uint64_t)uncompressed;
+        directory_ += (uint64_t)compressed;
+        directory_ += (uint64_t)header_offset;
+    }
+    ++nrecs_;
+}
+
+void cnpy::NpzWriter::close()
+{
+    if (!fp_)
+        return;
+
+    const uint64_t dir_offset = offset_;
+    const uint64_t dir_size   = directory_.size();
+    if (dir_size > 0)
+        write(&directory_[0], dir_size);
+
+    std::vector<char> footer;
+    const bool        zip64 =
+        nrecs_ >= 0xffff || dir_size >= 0xffffffff || dir_offset >= 0xffffffff;
+    if (zip64)
+    {
+        const uint64_t record_offset = offset_;
+        footer += "PK";  // ZIP64 end of central directory record
+        footer += (uint16_t)0x0606;
+        footer += (uint64_t)44;          // size of the rest of the record
+        footer += (uint16_t)45;          // version made by
+        footer += (uint16_t)45;          // min version to extract
+        footer += (uint32_t)0;           // number of this disk
+        footer += (uint32_t)0;           // disk where the directory starts
+        footer += (uint64_t)nrecs_;      // number of records on this disk
+        footer += (uint64_t)nrecs_;      // total number of records
+        footer += (uint64_t)dir_size;    // nbytes of global headers
+        footer += (uint64_t)dir_offset;  // offset of start of global headers
+        footer += "PK";                  // ZIP64 end of central directory locator
+        footer += (uint16_t)0x0706;
+        footer += (uint32_t)0;              // disk with the ZIP64 record
+        footer += (uint64_t)record_offset;  // offset of the ZIP64 record
+        footer += (uint32_t)1;              // total number of disks
+    }
+    footer += "PK";                                         // first part of sig
+    footer += (uint16_t)0x0605;                             // second part of sig
+    footer += (uint16_t)0;                                  // number of this disk
+    footer += (uint16_t)0;                                  // disk where footer starts
+    footer += (uint16_t)(zip64 ? 0xffff : nrecs_);          // records on this disk
+    footer += (uint16_t)(zip64 ? 0xffff : nrecs_);          // total number of records
+    footer += (uint32_t)(zip64 ? 0xffffffff : dir_size);    // nbytes of global headers
+    footer += (uint32_t)(zip64 ? 0xffffffff : dir_offset);  // offset of global headers
+    footer += (uint16_t)0;                                  // zip file comment length
+    write(&footer[0], footer.size());
+
+    // an appended archive may end before the old one did
+    FILE* fp = fp_;
+    fp_      = NULL;
+    if (fflush(fp) != 0 || ftruncate(fileno(fp), offset_) != 0)
+    {
+        fclose(fp);
+        throw std::runtime_error("npz_save: failed write to " + fname_);
+    }
+    if (fclose(fp) != 0)
+        throw std::runtime_error("npz_save: failed write to " + fname_);
 }
@@ -0,0 +1,310 @@
+#include "npy_sequence.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <typeinfo>
+
+#include "npy.hpp"
+
+namespace ferrari
+{
+namespace
+{
+
+// Reads block on the disk, not the CPU, so a few threads keep a deep window busy.
+const int kMaxIoThreads = 4;
+// O_DIRECT transfers must start and end on logical block boundaries.
+const size_t kDirectAlignment = 4096;
+
+int pread_full(int fd, void* dst, size_t bytes, size_t offset, const std::string& path)
+{
+    char* p = static_cast<char*>(dst);
+    while (bytes > 0)
+    {
+        const ssize_t n = pread(fd, p, bytes, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            LOG(ERROR) << "cannot read " << path << ": "
+                       << (n < 0 ? strerror(errno) : "file is truncated");
+            return -1;
+        }
+        p += n;
+        bytes -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+bool is_npz(const std::string& path, std::string* archive, std::string* varname)
+{
+    const std::string::size_type pos = path.rfind(".npz");
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    if (pos + 4 == path.size())
+    {
+        *archive = path;
+        varname->clear();
+        return true;
+    }
+    if (path[pos + 4] != ':')
+    {
+        return false;
+    }
+    *archive = path.substr(0, pos + 4);
+    *varname = path.substr(pos + 5);
+    return true;
+}
+
+}  // namespace
+
+template <typename Dtype>
+NpySequenceReader<Dtype>::NpySequenceReader(const std::vector<std::string>& paths,
+                                            int                             window,
+                                            bool                            direct_io,
+                                            float                           scale,
+                                            float                           shift)
+    : paths_(paths),
+      direct_io_(direct_io),
+      scale_(scale),
+      shift_(shift),
+      next_issue_(0),
+      next_out_(0),
+      stop_(false)
+{
+    CHECK_GT(window, 0);
+    Slot free_slot;
+    free_slot.index  = paths_.size();
+    free_slot.ready  = false;
+    free_slot.status = 0;
+    slots_.assign(window, free_slot);
+    const int num_threads = std::min<size_t>(std::min(window, kMaxIoThreads), paths_.size());
+    for (int i = 0; i < num_threads; ++i)
+    {
+        threads_.push_back(std::thread(&NpySequenceReader::IoLoop, this));
+    }
+}
+
+template <typename Dtype>
+NpySequenceReader<Dtype>::~NpySequenceReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    issue_.notify_all();
+    for (size_t i = 0; i < threads_.size(); ++i)
+    {
+        threads_[i].join();
+    }
+}
+
+template <typename Dtype>
+int NpySequenceReader<Dtype>::Next(SharedBlob<Dtype>* frame)
+{
+    CHECK_LT(next_out_, paths_.size()) << "read past the end of the sequence";
+    std::unique_lock<std::mutex> lock(mutex_);
+    Slot& slot = slots_[next_out_ % slots_.size()];
+    ready_.wait(lock, [&]() { return slot.index == next_out_ && slot.ready; });
+    *frame           = slot.blob;
+    const int status = slot.status;
+    slot.blob.reset();
+    slot.index = paths_.size();
+    slot.ready = false;
+    ++next_out_;
+    lock.unlock();
+    issue_.notify_all();
+    return status;
+}
+
+template <typename Dtype>
+void NpySequenceReader<Dtype>::IoLoop()
+{
+    while (true)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            issue_.wait(lock,
+                        [this]()
+                        {
+                            return stop_ || next_issue_ == paths_.size() ||
+                                   next_issue_ < next_out_ + slots_.size();
+                        });
+            if (stop_ || next_issue_ == paths_.size())
+            {
+                return;
+            }
+            index                               = next_issue_++;
+            slots_[index % slots_.size()].index = index;
+        }
+        SharedBlob<Dtype> blob(new Blob<Dtype>());
+        const int         status = ReadFrame(paths_[index], blob.get());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Slot& slot  = slots_[index % slots_.size()];
+            slot.blob   = status == 0 ? blob : SharedBlob<Dtype>();
+            slot.status = status;
+            slot.ready  = true;
+        }
+        ready_.notify_all();
+    }
+}
+
+template <typename Dtype>
+int NpySequenceReader<Dtype>::ReadFrame(const std::string& path, Blob<Dtype>* blob) const
+{
+    try
+    {
+        std::string archive, varname;
+        if (!is_npz(path, &archive, &varname))
+        {
+            return ReadNpy(path, blob);
+        }
+        cnpy::NpzReader reader(archive);
+        if (varname.empty())
+        {
+            if (reader.entries().empty())
+            {
+                LOG(ERROR) << archive << " has no members";
+                return -1;
+            }
+            varname = reader.entries()[0].name;
+        }
+        blob->CopyFromNPY(reader.load(varname), scale_, shift_);
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << "cannot read " << path << ": " << e.what();
+        return -1;
+    }
+}
+
+template <typename Dtype>
+int NpySequenceReader<Dtype>::ReadNpy(const std::string& path, Blob<Dtype>* blob) const
+{
+    if (!direct_io_)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (fp == NULL)
+        {
+            LOG(ERROR) << "cannot open " << path << ": " << strerror(errno);
+            return -1;
+        }
+        std::shared_ptr<FILE> file(fp, fclose);
+        const cnpy::NpyHeader header = cnpy::parse_npy_header(fp);
+        const size_t          bytes  = header.num_vals() * header.word_size;
+        // The common case: the payload already is the blob's host buffer.
+        if (header.type == cnpy::map_type(typeid(Dtype)) && header.word_size == sizeof(Dtype) &&
+            !header.fortran_order && !cnpy::needs_byteswap(header) && scale_ == 1.0f &&
+            shift_ == 0.0f)
+        {
+            blob->Reshape(vector<int>(header.shape.begin(), header.shape.end()));
+            return pread_full(
+                fileno(fp), blob->mutable_cpu_data(), bytes, header.data_offset, path);
+        }
+        cnpy::NpyArray array(header.shape, header.word_size, header.fortran_order);
+        array.type = header.type;
+        if (pread_full(fileno(fp), array.bytes(), bytes, header.data_offset, path) != 0)
+        {
+            return -1;
+        }
+        if (cnpy::needs_byteswap(header))
+        {
+            cnpy::byteswap(array.bytes(), array.num_vals, header);
+        }
+        blob->CopyFromNPY(array, scale_, shift_);
+        return 0;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+    if (fd < 0 && errno == EINVAL)
+    {
+        // The file system does not support O_DIRECT (tmpfs, some FUSE mounts).
+        fd = open(path.c_str(), O_RDONLY);
+    }
+    if (fd < 0)
+    {
+        LOG(ERROR) << "cannot open " << path << ": " << strerror(errno);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        LOG(ERROR) << "cannot stat " << path << ": " << strerror(errno);
+        close(fd);
+        return -1;
+    }
+    const size_t size   = st.st_size;
+    const size_t length = std::max((size + kDirectAlignment - 1) / kDirectAlignment, size_t(1)) *
+                          kDirectAlignment;
+    void*        buffer = NULL;
+    if (posix_memalign(&buffer, kDirectAlignment, length) != 0)
+    {
+        LOG(ERROR) << "cannot allocate " << length << " bytes to read " << path;
+        close(fd);
+        return -1;
+    }
+    std::shared_ptr<char> data(static_cast<char*>(buffer), free);
+    // Whole aligned blocks; the read of the last one comes back short at the end of the file.
+    size_t done = 0;
+    while (done < size)
+    {
+        const ssize_t n = pread(fd, data.get() + done, length - done, done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            LOG(ERROR) << "cannot read " << path << ": "
+                       << (n < 0 ? strerror(errno) : "file is truncated");
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    close(fd);
+
+    const cnpy::NpyHeader header =
+        cnpy::parse_npy_header(reinterpret_cast<const unsigned char*>(data.get()), size);
+    cnpy::NpyArray array;
+    array.shape         = header.shape;
+    array.word_size     = header.word_size;
+    array.type          = header.type;
+    array.fortran_order = header.fortran_order;
+    array.num_vals      = header.num_vals();
+    if (header.data_offset + array.num_vals * array.word_size > size)
+    {
+        LOG(ERROR) << path << " is shorter than its header says";
+        return -1;
+    }
+    array.mapped_data = std::shared_ptr<char>(data, data.get() + header.data_offset);
+    if (cnpy::needs_byteswap(header))
+    {
+        cnpy::byteswap(array.bytes(), array.num_vals, header);
+    }
+    blob->CopyFromNPY(array, scale_, shift_);
+    return 0;
+}
+
+INSTANTIATE_CLASS(NpySequenceReader);
+template class NpySequenceReader<int>;
+template class NpySequenceReader<unsigned int>;
+template class NpySequenceReader<float16>;
+
+}  // namespace ferrari
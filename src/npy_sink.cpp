@@ -0,0 +1,303 @@
+#include "npy_sink.hpp"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <typeinfo>
+
+#include "npy.hpp"
+#include "syncedmem.hpp"
+
+namespace ferrari
+{
+
+// Host copy of a blob, owned by the queued task until it is written.
+struct NpySink::Snapshot
+{
+    explicit Snapshot(size_t bytes) : data(NULL), bytes(bytes), use_cuda(false)
+    {
+        CaffeMallocHost(&data, bytes, &use_cuda);
+    }
+    ~Snapshot() { CaffeFreeHost(data, bytes, use_cuda); }
+
+    void*  data;
+    size_t bytes;
+    bool   use_cuda;
+};
+
+NpySink::NpySink(int num_threads, size_t max_queued, bool drop_when_full)
+    : max_queued_(std::max<size_t>(max_queued, 1)),
+      drop_when_full_(drop_when_full),
+      queued_(0),
+      pending_(0),
+      errors_(0),
+      stop_(false),
+      dropped_(0)
+{
+    CHECK_GT(num_threads, 0);
+    for (int i = 0; i < num_threads; ++i)
+    {
+        writers_.emplace_back(new Writer());
+    }
+    for (size_t i = 0; i < writers_.size(); ++i)
+    {
+        writers_[i]->thread = std::thread(&NpySink::WriterLoop, this, writers_[i].get());
+    }
+}
+
+NpySink::~NpySink()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_all();
+    for (size_t i = 0; i < writers_.size(); ++i)
+    {
+        writers_[i]->thread.join();
+    }
+    if (errors_ > 0)
+    {
+        LOG(ERROR) << errors_ << " npy writes failed since the last Flush";
+    }
+}
+
+template <typename Dtype>
+int NpySink::Save(const Blob<Dtype>& blob, const std::string& filename)
+{
+    Task task;
+    task.kind      = SAVE;
+    task.filename  = filename;
+    task.type      = cnpy::map_type(typeid(Dtype));
+    task.word_size = sizeof(Dtype);
+    task.shape.assign(blob.shape().begin(), blob.shape().end());
+    return Submit(task, blob.cpu_data(), blob.count() * sizeof(Dtype));
+}
+
+template <typename Dtype>
+int NpySink::Append(const Blob<Dtype>& blob, const std::string& filename)
+{
+    CHECK_GE(blob.num_axes(), 1) << "cannot append a scalar to " << filename;
+    Task task;
+    task.kind      = APPEND;
+    task.filename  = filename;
+    task.type      = cnpy::map_type(typeid(Dtype));
+    task.word_size = sizeof(Dtype);
+    task.shape.assign(blob.shape().begin(), blob.shape().end());
+    return Submit(task, blob.cpu_data(), blob.count() * sizeof(Dtype));
+}
+
+int NpySink::Close(const std::string& filename)
+{
+    Task task;
+    task.kind      = CLOSE;
+    task.filename  = filename;
+    task.type      = 0;
+    task.word_size = 0;
+    return Submit(task, NULL, 0);
+}
+
+int NpySink::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return pending_ == 0; });
+    const int errors = errors_;
+    errors_          = 0;
+    return errors == 0 ? 0 : -1;
+}
+
+int NpySink::Submit(Task task, const void* data, size_t bytes)
+{
+    Writer* writer = writers_[std::hash<std::string>()(task.filename) % writers_.size()].get();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (task.kind != CLOSE)
+    {
+        if (queued_ >= max_queued_)
+        {
+            if (drop_when_full_)
+            {
+                ++dropped_;
+                ++errors_;
+                return -1;
+            }
+            not_full_.wait(lock, [this]() { return queued_ < max_queued_; });
+        }
+        // Reserve the slot, then copy without holding the lock.
+        ++queued_;
+        lock.unlock();
+        task.data = std::make_shared<Snapshot>(bytes);
+        if (bytes > 0)
+        {
+            memcpy(task.data->data, data, bytes);
+        }
+        lock.lock();
+    }
+    ++pending_;
+    writer->tasks.push_back(std::move(task));
+    work_.notify_all();
+    return 0;
+}
+
+int NpySink::Execute(Writer* writer, const Task& task)
+{
+    switch (task.kind)
+    {
+        case SAVE:
+        {
+            const std::vector<char> header =
+                cnpy::create_npy_header(task.type, task.word_size, task.shape);
+            FILE* fp = fopen(task.filename.c_str(), "wb");
+            if (fp == NULL)
+            {
+                LOG(ERROR) << "cannot open " << task.filename << ": " << strerror(errno);
+                return -1;
+            }
+            const bool written =
+                fwrite(&header[0], 1, header.size(), fp) == header.size() &&
+                fwrite(task.data->data, 1, task.data->bytes, fp) == task.data->bytes;
+            if (fclose(fp) != 0 || !written)
+            {
+                LOG(ERROR) << "failed to write " << task.filename;
+                return -1;
+            }
+            return 0;
+        }
+        case APPEND:
+        {
+            std::map<std::string, Stream>::iterator it = writer->streams.find(task.filename);
+            if (it == writer->streams.end())
+            {
+                Stream stream;
+                stream.type      = task.type;
+                stream.word_size = task.word_size;
+                stream.shape     = task.shape;
+                stream.shape[0]  = 0;
+                stream.failed    = false;
+                // Reserve room for the header of the longest possible stream, and write a
+                // valid header for zero rows until Close().
+                std::vector<size_t> longest = task.shape;
+                longest[0]                  = std::numeric_limits<size_t>::max();
+                stream.header_size =
+                    cnpy::create_npy_header(task.type, task.word_size, longest).size();
+                stream.fp = fopen(task.filename.c_str(), "wb");
+                if (stream.fp == NULL)
+                {
+                    LOG(ERROR) << "cannot open " << task.filename << ": " << strerror(errno);
+                    return -1;
+                }
+                const std::vector<char> header = cnpy::create_npy_header(
+                    stream.type, stream.word_size, stream.shape, stream.header_size);
+                stream.failed = fwrite(&header[0], 1, header.size(), stream.fp) != header.size();
+                it            = writer->streams.insert(std::make_pair(task.filename, stream)).first;
+            }
+            Stream& stream = it->second;
+            if (stream.type != task.type || stream.word_size != task.word_size ||
+                task.shape.size() != stream.shape.size() ||
+                !std::equal(task.shape.begin() + 1, task.shape.end(), stream.shape.begin() + 1))
+            {
+                LOG(ERROR) << "blob appended to " << task.filename
+                           << " does not match the type or trailing shape of the stream";
+                return -1;
+            }
+            if (stream.failed)
+            {
+                return -1;
+            }
+            if (fwrite(task.data->data, 1, task.data->bytes, stream.fp) != task.data->bytes)
+            {
+                LOG(ERROR) << "failed to append to " << task.filename << ": " << strerror(errno);
+                stream.failed = true;
+                return -1;
+            }
+            stream.shape[0] += task.shape[0];
+            return 0;
+        }
+        case CLOSE:
+        {
+            std::map<std::string, Stream>::iterator it = writer->streams.find(task.filename);
+            if (it == writer->streams.end())
+            {
+                return 0;
+            }
+            Stream&                 stream = it->second;
+            const std::vector<char> header = cnpy::create_npy_header(
+                stream.type, stream.word_size, stream.shape, stream.header_size);
+            CHECK_EQ(header.size(), stream.header_size);
+            bool written = !stream.failed && fseek(stream.fp, 0, SEEK_SET) == 0 &&
+                           fwrite(&header[0], 1, header.size(), stream.fp) == header.size();
+            written &= fclose(stream.fp) == 0;
+            writer->streams.erase(it);
+            if (!written)
+            {
+                LOG(ERROR) << "failed to finish " << task.filename;
+                return -1;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void NpySink::WriterLoop(Writer* writer)
+{
+    while (true)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_.wait(lock, [&]() { return stop_ || !writer->tasks.empty(); });
+            if (writer->tasks.empty())
+            {
+                break;
+            }
+            task = std::move(writer->tasks.front());
+            writer->tasks.pop_front();
+        }
+        const int  result   = Execute(writer, task);
+        const bool snapshot = task.kind != CLOSE;
+        // Release the snapshot before a blocked submitter takes its slot.
+        task.data.reset();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (snapshot)
+            {
+                --queued_;
+            }
+            --pending_;
+            if (result != 0)
+            {
+                ++errors_;
+            }
+        }
+        not_full_.notify_all();
+        idle_.notify_all();
+    }
+    // Finish the streams the caller never closed.
+    while (!writer->streams.empty())
+    {
+        Task task;
+        task.kind     = CLOSE;
+        task.filename = writer->streams.begin()->first;
+        if (Execute(writer, task) != 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++errors_;
+        }
+    }
+}
+
+#define INSTANTIATE_NPY_SINK(Dtype)                                                  \
+    template int NpySink::Save<Dtype>(const Blob<Dtype>&, const std::string&); \
+    template int NpySink::Append<Dtype>(const Blob<Dtype>&, const std::string&)
+
+INSTANTIATE_NPY_SINK(float);
+INSTANTIATE_NPY_SINK(double);
+INSTANTIATE_NPY_SINK(int);
+INSTANTIATE_NPY_SINK(unsigned int);
+INSTANTIATE_NPY_SINK(float16);
+
+}  // namespace ferrari
@@ -0,0 +1,38 @@
+#include "parallel.hpp"
+
+#include "common.hpp"
+#include "thread_pool.hpp"
+
+namespace ferrari
+{
+
+void parallel_for(int64_t                                     begin,
+                  int64_t                                     end,
+                  int64_t                                     grain,
+                  const std::function<void(int64_t, int64_t)>& fn)
+{
+    // Single-chunk ranges skip the pool lookup (and its lock) entirely.
+    if (end - begin <= grain)
+    {
+        if (end > begin)
+        {
+            fn(begin, end);
+        }
+        return;
+    }
+    Caffe::thread_pool().parallel_for(begin, end, grain, fn);
+}
+
+void parallel_for_2d(int64_t                                                       row_begin,
+                     int64_t                                                       row_end,
+                     int64_t                                                       col_begin,
+                     int64_t                                                       col_end,
+                     int64_t                                                       row_grain,
+                     int64_t                                                       col_grain,
+                     const std::function<void(int64_t, int64_t, int64_t, int64_t)>& fn)
+{
+    Caffe::thread_pool().parallel_for_2d(
+        row_begin, row_end, col_begin, col_end, row_grain, col_grain, fn);
+}
+
+}  // namespace ferrari
@@ -2,25 +2,166 @@
 
 #include <memory>
 
+#include "blob_view.hpp"
 #include "common.hpp"
+#include "cpu_functional.hpp"
+#include "cpu_gemm.hpp"
+#include "cpu_quant.hpp"
 #include "cuda_functional.hpp"
 #include "device_alternate.hpp"
 #include "glog/logging.h"
 
 namespace ferrari
 {
-CorrBlock::CorrBlock(int batch, int dim, int ht, int wd, int num_levels, int radius)
-    : batch_(batch), dim_(dim), ht_(ht), wd_(wd), num_levels_(num_levels), radius_(radius)
+namespace
 {
-    for (int i = 0; i < num_levels_; ++i)
+
+// 相关体金字塔第 i 层: [batch * ht * wd, 1, ht / 2^i, wd / 2^i]
+template <typename Dtype>
+void alloc_corr_pyramid(int                                        batch,
+                        int                                        ht,
+                        int                                        wd,
+                        int                                        num_levels,
+                        std::vector<std::shared_ptr<Blob<Dtype>>>* pyramid)
+{
+    for (int i = 0; i < num_levels; ++i)
+    {
+        int n = batch * ht * wd;
+        int c = 1;
+        int h = (int)(ht / std::pow(2, i));
+        int w = (int)(wd / std::pow(2, i));
+        pyramid->push_back(std::make_shared<Blob<Dtype>>(std::vector<int>({n, c, h, w})));
+    }
+}
+
+// corr[b] (hw x hw) = fmap1[b]^T * fmap2[b] / sqrt(dim)，GEMM 以 fp32 (或 int8) 累加，
+// 写回时转换为金字塔第 0 层的存储类型。
+// fmap 可为 NCHW ([dim, hw]) 或 NHWC ([hw, dim])，fp32 GEMM 通过转置标志直接读取任一布局；
+// NHWC 的 fmap1 每行沿 dim 连续，打包 A 时无需跨步
+template <typename Dtype>
+int corr_gemm_cpu(const std::shared_ptr<Blob<float>>&              fmap1,
+                  const std::shared_ptr<Blob<float>>&              fmap2,
+                  bool                                             int8,
+                  const std::vector<std::shared_ptr<Blob<Dtype>>>& pyramid)
+{
+    const bool nhwc1 = fmap1->layout() == LAYOUT_NHWC;
+    const bool nhwc2 = fmap2->layout() == LAYOUT_NHWC;
+    if (int8 && (nhwc1 || nhwc2))
+    {
+        LOG(ERROR) << "CorrBlock GEMM_INT8 needs NCHW feature maps";
+        return -1;
+    }
+
+    const BlobView<float> f1(*fmap1);
+    const BlobView<float> f2(*fmap2);
+    const BlobView<Dtype> corr(*pyramid[0]);
+
+    int batch = f1.shape(0);
+    int dim   = f1.shape(nhwc1 ? 3 : 1);
+    int hw    = static_cast<int>(f1.count() / batch / dim);
+
+    // 缩放因子在 GEMM 写回时一并完成
+    float alpha = 1.0f / sqrtf(static_cast<float>(dim));
+
+    for (int b = 0; b < batch; ++b)
+    {
+        // 第 b 对的特征及其相关体 [hw, 1, ht, wd]，均为连续视图
+        const BlobView<float> a = f1.Select(0, b);
+        const BlobView<float> c = f2.Select(0, b);
+        const BlobView<Dtype> v = corr.Slice(0, b * hw, (b + 1) * hw);
+        if (int8)
+        {
+            corr_volume_int8_cpu(a.cpu_data(), c.cpu_data(), dim, hw, alpha, v.mutable_cpu_data());
+            continue;
+        }
+        caffe_cpu_sgemm(!nhwc1,
+                        nhwc2,
+                        hw,
+                        hw,
+                        dim,
+                        alpha,
+                        a.cpu_data(),
+                        c.cpu_data(),
+                        0.0f,
+                        v.mutable_cpu_data());
+    }
+    return 0;
+}
+
+// 金字塔各层注册为工作区张量，元素类型决定字节数
+template <typename Dtype>
+std::vector<int> add_pyramid_tensors(const std::string&                               prefix,
+                                     const std::vector<std::shared_ptr<Blob<Dtype>>>& pyramid,
+                                     WorkspacePlanner*                                planner)
+{
+    std::vector<int> ids;
+    for (size_t i = 0; i < pyramid.size(); ++i)
     {
-        int                          n = batch * ht * wd;
-        int                          c = 1;
-        int                          h = (int)(ht / std::pow(2, i));
-        int                          w = (int)(wd / std::pow(2, i));
-        std::shared_ptr<Blob<float>> b =
-            std::make_shared<Blob<float>>(std::vector<int>({n, c, h, w}));
-        corr_pyramid_.push_back(b);
+        ids.push_back(planner->AddTensor(prefix + std::to_string(i),
+                                         sizeof(Dtype) * static_cast<size_t>(pyramid[i]->count())));
+    }
+    return ids;
+}
+
+template <typename Dtype>
+void bind_pyramid(const std::vector<int>&                          ids,
+                  const std::vector<std::shared_ptr<Blob<Dtype>>>& pyramid,
+                  Workspace*                                       workspace)
+{
+    for (size_t i = 0; i < pyramid.size(); ++i)
+    {
+        workspace->Bind(ids[i], pyramid[i]->shape(), pyramid[i].get());
+    }
+}
+
+}  // namespace
+
+CorrBlock::CorrBlock(int           batch,
+                     int           dim,
+                     int           ht,
+                     int           wd,
+                     int           num_levels,
+                     int           radius,
+                     CorrMode      mode,
+                     CorrPrecision precision,
+                     CorrGemm      gemm)
+    : batch_(batch),
+      dim_(dim),
+      ht_(ht),
+      wd_(wd),
+      num_levels_(num_levels),
+      radius_(radius),
+      mode_(mode),
+      precision_(precision),
+      gemm_(gemm)
+{
+    CHECK(mode_ == ALL_PAIRS || precision_ == FP32)
+        << "CorrBlock ON_DEMAND mode keeps fp32 features, precision must be FP32";
+    CHECK(mode_ == ALL_PAIRS || gemm_ == GEMM_FP32)
+        << "CorrBlock ON_DEMAND mode has no correlation GEMM, gemm must be GEMM_FP32";
+
+    if (mode_ == ON_DEMAND)
+    {
+        fmap1_ = std::make_shared<Blob<float>>(std::vector<int>({batch, ht, wd, dim}));
+        for (int i = 0; i < num_levels_; ++i)
+        {
+            int h = (int)(ht / std::pow(2, i));
+            int w = (int)(wd / std::pow(2, i));
+            fmap2_pyramid_.push_back(
+                std::make_shared<Blob<float>>(std::vector<int>({batch, h, w, dim})));
+        }
+    }
+    else if (precision_ == FP16)
+    {
+        alloc_corr_pyramid(batch, ht, wd, num_levels_, &corr_pyramid_fp16_);
+    }
+    else if (precision_ == BF16)
+    {
+        alloc_corr_pyramid(batch, ht, wd, num_levels_, &corr_pyramid_bf16_);
+    }
+    else
+    {
+        alloc_corr_pyramid(batch, ht, wd, num_levels_, &corr_pyramid_);
     }
 
     delta_lvl_ =
@@ -113,9 +254,44 @@ int CorrBlock::computeCorr(const std::shared_ptr<Blob<float>>& fmap1,
 int CorrBlock::computeCorr(const std::shared_ptr<Blob<float>>& fmap1,
                            const std::shared_ptr<Blob<float>>& fmap2)
 {
-    const float* d_fmap1 = fmap1->gpu_data();                     // Pointer to fmap1 data on
-    const float* d_fmap2 = fmap2->gpu_data();                     // Pointer to fmap2 data on
-    float*       d_corr  = corr_pyramid_[0]->mutable_gpu_data();  // Output pointer
+    if (mode_ == ON_DEMAND)
+    {
+        if (Caffe::mode() != Caffe::CPU)
+        {
+            LOG(ERROR) << "CorrBlock ON_DEMAND mode is only implemented for Caffe::CPU";
+            return -1;
+        }
+        return prepareOnDemandCpu(fmap1, fmap2);
+    }
+
+    if (Caffe::mode() == Caffe::CPU)
+    {
+        return computeCorrCpu(fmap1, fmap2);
+    }
+
+    if (precision_ != FP32)
+    {
+        LOG(ERROR) << "CorrBlock FP16/BF16 pyramids are only implemented for Caffe::CPU";
+        return -1;
+    }
+    if (gemm_ == GEMM_INT8)
+    {
+        LOG(ERROR) << "CorrBlock GEMM_INT8 is only implemented for Caffe::CPU";
+        return -1;
+    }
+    if (fmap1->layout() != LAYOUT_NCHW || fmap2->layout() != LAYOUT_NCHW)
+    {
+        LOG(ERROR) << "CorrBlock NHWC feature maps are only implemented for Caffe::CPU";
+        return -1;
+    }
+
+#ifdef CPU_ONLY
+    NO_GPU;
+    return -1;
+#else
+    const BlobView<float> d_fmap1(*fmap1);             // fmap1 on device
+    const BlobView<float> d_fmap2(*fmap2);             // fmap2 on device
+    const BlobView<float> d_corr(*corr_pyramid_[0]);  // Output
 
     int batch = fmap1->shape(0);  // Batch size
     int dim   = fmap1->shape(1);  // DIM
@@ -136,20 +312,16 @@ int CorrBlock::computeCorr(const std::shared_ptr<Blob<float>>& fmap1,
     int ldb = m;  // Leading dimension of B
     int ldc = m;  // Leading dimension of C
 
-    // Strides between batches (not needed for loop over cublasSgemm)
-    long long int strideA = static_cast<long long>(m) * k;
-    long long int strideB = static_cast<long long>(n) * k;
-    long long int strideC = static_cast<long long>(m) * n;
-
     cublasOperation_t transa = CUBLAS_OP_N;  // No transpose on A
     cublasOperation_t transb = CUBLAS_OP_T;  // Transpose on B
 
     // Loop over batches and call cublasSgemm for each batch
     for (int b = 0; b < batch; ++b)
     {
-        const float* batch_A = d_fmap1 + b * strideA;
-        const float* batch_B = d_fmap2 + b * strideB;
-        float*       batch_C = d_corr + b * strideC;
+        // Per-pair views: fmap [k, ht, wd] and corr rows [m, 1, ht, wd]
+        const float* batch_A = d_fmap1.Select(0, b).gpu_data();
+        const float* batch_B = d_fmap2.Select(0, b).gpu_data();
+        float*       batch_C = d_corr.Slice(0, b * m, (b + 1) * m).mutable_gpu_data();
 
         cublasStatus_t status = cublasSgemm(Caffe::cublas_handle(),
                                             transa,  // Operation on A
@@ -177,9 +349,37 @@ int CorrBlock::computeCorr(const std::shared_ptr<Blob<float>>& fmap1,
     buildCorrPyramid();
     // corr_pyramid_[0]->SaveToNPY("corr0_row.npy");
     return 0;
+#endif  // CPU_ONLY
 }
 
 #endif
+
+// 与 GPU 版本相同: corr[b] (hw x hw, row-major) = fmap1[b]^T * fmap2[b] / sqrt(dim)，
+// 按金字塔精度分派到 corr_gemm_cpu，后者处理 NCHW / NHWC 两种 fmap 布局
+int CorrBlock::computeCorrCpu(const std::shared_ptr<Blob<float>>& fmap1,
+                              const std::shared_ptr<Blob<float>>& fmap2)
+{
+    int ret;
+    switch (precision_)
+    {
+        case FP16:
+            ret = corr_gemm_cpu(fmap1, fmap2, gemm_ == GEMM_INT8, corr_pyramid_fp16_);
+            break;
+        case BF16:
+            ret = corr_gemm_cpu(fmap1, fmap2, gemm_ == GEMM_INT8, corr_pyramid_bf16_);
+            break;
+        default:
+            ret = corr_gemm_cpu(fmap1, fmap2, gemm_ == GEMM_INT8, corr_pyramid_);
+            break;
+    }
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    return buildCorrPyramidCpu();
+}
+
 /*
 int CorrBlock::computeCorr(const std::shared_ptr<Blob<float>>& fmap1,
                            const std::shared_ptr<Blob<float>>& fmap2)
@@ -251,6 +451,10 @@ device float*       d_corr  = corr_pyramid_[0]->mutable_gpu_data();  // Output p
 
 int CorrBlock::buildCorrPyramid()
 {
+#ifdef CPU_ONLY
+    NO_GPU;
+    return -1;
+#else
     // 池化参数
     int windowHeight     = 2;
     int windowWidth      = 2;
@@ -325,6 +529,33 @@ int CorrBlock::buildCorrPyramid()
     CUDNN_CHECK(cudnnDestroyPoolingDescriptor(poolingDesc));
 
     return 0;
+#endif  // CPU_ONLY
+}
+
+// ON_DEMAND: 不计算相关体，只保存转置后的 fmap1 和池化后的 fmap2 金字塔
+int CorrBlock::prepareOnDemandCpu(const std::shared_ptr<Blob<float>>& fmap1,
+                                  const std::shared_ptr<Blob<float>>& fmap2)
+{
+    int ret = build_feature_pyramid_cpu(fmap1, {fmap1_});
+    if (ret != 0)
+    {
+        return ret;
+    }
+    return build_feature_pyramid_cpu(fmap2, fmap2_pyramid_);
+}
+
+// 逐个 query 平面一次性生成所有层级，上一层仍在缓存中
+int CorrBlock::buildCorrPyramidCpu()
+{
+    switch (precision_)
+    {
+        case FP16:
+            return build_corr_pyramid_cpu(corr_pyramid_fp16_);
+        case BF16:
+            return build_corr_pyramid_cpu(corr_pyramid_bf16_);
+        default:
+            return build_corr_pyramid_cpu(corr_pyramid_);
+    }
 }
 
 int CorrBlock::generateDelta()
@@ -334,12 +565,163 @@ int CorrBlock::generateDelta()
     return 0;
 }
 
+// coords: [batch, 2, ht, wd]，output: [batch, num_levels * (2r+1)^2, ht, wd]
+// 各层窗口直接从金字塔采样写入 output，不生成中间的归一化 grid
+int CorrBlock::call(const float* coords, float* output)
+{
+    if (Caffe::mode() != Caffe::CPU)
+    {
+        LOG(ERROR) << "CorrBlock::call is only implemented for Caffe::CPU";
+        return -1;
+    }
+
+    if (mode_ == ON_DEMAND)
+    {
+        return corr_lookup_on_demand_cpu(fmap1_, fmap2_pyramid_, coords, radius_, output);
+    }
+    // 16 位金字塔逐窗口转换为 fp32 后插值
+    switch (precision_)
+    {
+        case FP16:
+            return corr_lookup_cpu(corr_pyramid_fp16_, coords, batch_, ht_, wd_, radius_, output);
+        case BF16:
+            return corr_lookup_cpu(corr_pyramid_bf16_, coords, batch_, ht_, wd_, radius_, output);
+        default:
+            return corr_lookup_cpu(corr_pyramid_, coords, batch_, ht_, wd_, radius_, output);
+    }
+}
+
 int CorrBlock::call(const std::shared_ptr<Blob<float>>& coords,
                     std::shared_ptr<Blob<float>>&       output)
 {
-    int ret = 0;
+    CHECK_EQ(coords->num_axes(), 4);
+    CHECK_EQ(coords->shape(0), batch_);
+    CHECK_EQ(coords->shape(1), 2);
+    CHECK_EQ(coords->shape(2), ht_);
+    CHECK_EQ(coords->shape(3), wd_);
+
+    int k = 2 * radius_ + 1;
+    output->Reshape(batch_, num_levels_ * k * k, ht_, wd_);
+
+    return call(coords->cpu_data(), output->mutable_cpu_data());
+}
+
+int CorrBlock::planWorkspace()
+{
+    if (Caffe::mode() != Caffe::CPU)
+    {
+        LOG(ERROR) << "CorrBlock::planWorkspace is only implemented for Caffe::CPU";
+        return -1;
+    }
+
+    const std::vector<int> fmap_shape = {batch_, dim_, ht_, wd_};
+    const size_t           fmap_bytes =
+        sizeof(float) * static_cast<size_t>(batch_) * dim_ * ht_ * wd_;
+
+    WorkspacePlanner planner;
+    const int        fmap1 = planner.AddTensor("fmap1", fmap_bytes);
+    const int        fmap2 = planner.AddTensor("fmap2", fmap_bytes);
+    const int        delta = planner.AddTensor("delta_lvl", sizeof(float) * delta_lvl_->count());
+    planner.MarkPersistent(delta);
+
+    std::vector<int> levels;
+    int              fmap1_t = -1;
+    planner.AddStage("load", {}, {fmap1, fmap2});
+    if (mode_ == ON_DEMAND)
+    {
+        // fmap1 转置后即失效，fmap2 金字塔可复用其内存
+        fmap1_t = planner.AddTensor("fmap1_t", fmap_bytes);
+        levels  = add_pyramid_tensors("fmap2_level", fmap2_pyramid_, &planner);
+        planner.AddStage("transpose_fmap1", {fmap1}, {fmap1_t});
+        planner.AddStage("feature_pyramid", {fmap2}, levels);
+    }
+    else
+    {
+        // fmap 在 GEMM 之后失效，粗层金字塔可复用其内存
+        switch (precision_)
+        {
+            case FP16:
+                levels = add_pyramid_tensors("corr_level", corr_pyramid_fp16_, &planner);
+                break;
+            case BF16:
+                levels = add_pyramid_tensors("corr_level", corr_pyramid_bf16_, &planner);
+                break;
+            default:
+                levels = add_pyramid_tensors("corr_level", corr_pyramid_, &planner);
+                break;
+        }
+        planner.AddStage("corr_gemm", {fmap1, fmap2}, {levels[0]});
+        planner.AddStage(
+            "corr_pyramid", {levels[0]}, std::vector<int>(levels.begin() + 1, levels.end()));
+    }
+    std::vector<int> lookup = levels;
+    lookup.push_back(delta);
+    if (fmap1_t >= 0)
+    {
+        lookup.push_back(fmap1_t);
+    }
+    planner.AddStage("lookup", lookup, {});
+    if (planner.Plan() != 0)
+    {
+        return -1;
+    }
+
+    workspace_.reset(new Workspace(planner));
+    fmap1_input_ = workspace_->MakeBlob<float>(fmap1, fmap_shape);
+    fmap2_input_ = workspace_->MakeBlob<float>(fmap2, fmap_shape);
+    workspace_->Bind(delta, delta_lvl_->shape(), delta_lvl_.get());
+    if (mode_ == ON_DEMAND)
+    {
+        workspace_->Bind(fmap1_t, fmap1_->shape(), fmap1_.get());
+        bind_pyramid(levels, fmap2_pyramid_, workspace_.get());
+    }
+    else if (precision_ == FP16)
+    {
+        bind_pyramid(levels, corr_pyramid_fp16_, workspace_.get());
+    }
+    else if (precision_ == BF16)
+    {
+        bind_pyramid(levels, corr_pyramid_bf16_, workspace_.get());
+    }
+    else
+    {
+        bind_pyramid(levels, corr_pyramid_, workspace_.get());
+    }
+
+    LOG(INFO) << "CorrBlock workspace: " << planner.arena_bytes() / (1 << 20) << " MB for "
+              << planner.total_bytes() / (1 << 20) << " MB of fmaps and pyramid";
+    return 0;
+}
+
+// 每个 batch 抽样 num_samples 个 query 行，分别以 fp32 与 int8 量化重新计算
+int CorrBlock::quantErrorReport(const std::shared_ptr<Blob<float>>& fmap1,
+                                const std::shared_ptr<Blob<float>>& fmap2,
+                                CorrQuantReport*                    report,
+                                int                                 num_samples)
+{
+    if (fmap1->layout() == LAYOUT_NHWC || fmap2->layout() == LAYOUT_NHWC)
+    {
+        LOG(ERROR) << "CorrBlock int8 error report needs NCHW feature maps";
+        return -1;
+    }
+
+    int   batch = fmap1->shape(0);
+    int   dim   = fmap1->shape(1);
+    int   hw    = fmap1->shape(2) * fmap1->shape(3);
+    float alpha = 1.0f / sqrtf(static_cast<float>(dim));
 
-    return ret;
+    int ret = corr_int8_error_report(
+        fmap1->cpu_data(), fmap2->cpu_data(), batch, dim, hw, alpha, num_samples, report);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    LOG(INFO) << "CorrBlock int8 vs fp32 over " << report->samples
+              << " values: max_abs_err=" << report->max_abs_err
+              << " mean_abs_err=" << report->mean_abs_err << " rms_err=" << report->rms_err
+              << " ref_rms=" << report->ref_rms;
+    return 0;
 }
 
-}  // namespace ferrari
\ No newline at end of file
+}  // namespace ferrari
@@ -1,5 +1,13 @@
 #include "syncedmem.hpp"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
 #include "common.hpp"
 #include "math_functions.hpp"
 
@@ -12,7 +20,10 @@ SyncedMemory::SyncedMemory()
       head_(UNINITIALIZED),
       own_cpu_data_(false),
       cpu_malloc_use_cuda_(false),
-      own_gpu_data_(false)
+      own_gpu_data_(false),
+      map_base_(NULL),
+      map_length_(0),
+      map_read_only_(false)
 {
 #ifndef CPU_ONLY
 #ifdef DEBUG
@@ -28,7 +39,10 @@ SyncedMemory::SyncedMemory(size_t size)
       head_(UNINITIALIZED),
       own_cpu_data_(false),
       cpu_malloc_use_cuda_(false),
-      own_gpu_data_(false)
+      own_gpu_data_(false),
+      map_base_(NULL),
+      map_length_(0),
+      map_read_only_(false)
 {
 #ifndef CPU_ONLY
 #ifdef DEBUG
@@ -42,8 +56,9 @@ SyncedMemory::~SyncedMemory()
     check_device();
     if (cpu_ptr_ && own_cpu_data_)
     {
-        CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+        CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_);
     }
+    unmap();
 
 #ifndef CPU_ONLY
     if (gpu_ptr_ && own_gpu_data_)
@@ -71,6 +86,11 @@ inline void SyncedMemory::to_cpu()
                 CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
                 own_cpu_data_ = true;
             }
+            else if (map_read_only_)
+            {
+                // The GPU copy is newer; the file is never written.
+                detach_mapping(false);
+            }
             caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
             head_ = SYNCED;
 #else
@@ -126,8 +146,9 @@ void SyncedMemory::set_cpu_data(void* data)
     CHECK(data);
     if (own_cpu_data_)
     {
-        CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+        CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_);
     }
+    unmap();
     cpu_ptr_      = data;
     head_         = HEAD_AT_CPU;
     own_cpu_data_ = false;
@@ -166,6 +187,10 @@ void* SyncedMemory::mutable_cpu_data()
 {
     check_device();
     to_cpu();
+    if (map_read_only_)
+    {
+        detach_mapping(true);
+    }
     head_ = HEAD_AT_CPU;
     return cpu_ptr_;
 }
@@ -200,6 +225,81 @@ void SyncedMemory::async_gpu_push(const cudaStream_t& stream)
 }
 #endif
 
+int SyncedMemory::MapFile(const std::string& filename, size_t offset, size_t size, MapMode mode)
+{
+    check_device();
+    CHECK_EQ(head_, UNINITIALIZED) << "MapFile needs a SyncedMemory without data";
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        LOG(ERROR) << "cannot open " << filename << ": " << strerror(errno);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || offset + size > static_cast<size_t>(st.st_size))
+    {
+        LOG(ERROR) << filename << " has no " << size << " bytes at offset " << offset;
+        close(fd);
+        return -1;
+    }
+    size_ = size;
+    if (size == 0)
+    {
+        // Nothing to map; the memory stays UNINITIALIZED.
+        close(fd);
+        return 0;
+    }
+
+    // mmap offsets must be page aligned; map from the page holding offset.
+    const size_t page    = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t aligned = offset / page * page;
+    const size_t length  = size + (offset - aligned);
+    void*        base    = mmap(NULL,
+                        length,
+                        mode == READ_ONLY ? PROT_READ : PROT_READ | PROT_WRITE,
+                        mode == READ_ONLY ? MAP_SHARED : MAP_PRIVATE,
+                        fd,
+                        aligned);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        LOG(ERROR) << "cannot map " << filename << ": " << strerror(errno);
+        return -1;
+    }
+    map_base_      = base;
+    map_length_    = length;
+    map_read_only_ = (mode == READ_ONLY);
+    cpu_ptr_       = static_cast<char*>(base) + (offset - aligned);
+    own_cpu_data_  = false;
+    head_          = HEAD_AT_CPU;
+    return 0;
+}
+
+void SyncedMemory::detach_mapping(bool copy)
+{
+    void* ptr = NULL;
+    CaffeMallocHost(&ptr, size_, &cpu_malloc_use_cuda_);
+    if (copy)
+    {
+        memcpy(ptr, cpu_ptr_, size_);
+    }
+    unmap();
+    cpu_ptr_      = ptr;
+    own_cpu_data_ = true;
+}
+
+void SyncedMemory::unmap()
+{
+    if (map_base_ == NULL)
+    {
+        return;
+    }
+    CHECK_EQ(munmap(map_base_, map_length_), 0) << strerror(errno);
+    map_base_      = NULL;
+    map_length_    = 0;
+    map_read_only_ = false;
+}
+
 void SyncedMemory::check_device()
 {
 #ifndef CPU_ONLY
@@ -0,0 +1,319 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ferrari
+{
+
+namespace
+{
+
+// Participant index of the current thread and the pool it belongs to; a
+// thread outside any pool uses slot 0 of whichever pool it calls into.
+thread_local const void* tls_pool = nullptr;
+thread_local int         tls_slot = 0;
+
+// Chunks per participant when the range allows it, so threads that finish
+// early have something to steal.
+const int64_t kChunksPerThread = 4;
+
+std::vector<int> allowed_cpus()
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+}  // namespace
+
+struct ThreadPool::Job
+{
+    const std::function<void(int64_t)>* fn;
+    std::atomic<int64_t>                pending;
+    std::mutex                          mutex;
+    std::condition_variable             cv;
+    bool                                done;
+    std::exception_ptr                  error;
+};
+
+ThreadPool::ThreadPool(int num_threads, bool pin_threads)
+    : pin_threads_(pin_threads), queued_(0), stop_(false)
+{
+    if (num_threads <= 0)
+    {
+        num_threads = DefaultNumThreads();
+    }
+    for (int i = 0; i < num_threads; ++i)
+    {
+        queues_.emplace_back(new Queue());
+    }
+
+    const std::vector<int> cpus = allowed_cpus();
+    workers_.reserve(num_threads - 1);
+    for (int i = 1; i < num_threads; ++i)
+    {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+#ifdef __linux__
+        // Slot 0 belongs to the caller, which is left where it is.
+        if (pin_threads_ && !cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i % cpus.size()], &set);
+            if (pthread_setaffinity_np(workers_.back().native_handle(), sizeof(set), &set) != 0)
+            {
+                LOG(WARNING) << "Cannot pin thread pool worker " << i << " to cpu "
+                             << cpus[i % cpus.size()];
+            }
+        }
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+int ThreadPool::DefaultNumThreads()
+{
+    const std::vector<int> cpus = allowed_cpus();
+    if (!cpus.empty())
+    {
+        return static_cast<int>(cpus.size());
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool ThreadPool::pop(int self, Task* task)
+{
+    Queue&                      q = *queues_[self];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty())
+    {
+        return false;
+    }
+    *task = q.tasks.front();
+    q.tasks.pop_front();
+    --queued_;
+    return true;
+}
+
+bool ThreadPool::steal(int self, Task* task)
+{
+    const int n = num_threads();
+    for (int k = 1; k < n; ++k)
+    {
+        Queue&                      q = *queues_[(self + k) % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty())
+        {
+            *task = q.tasks.back();
+            q.tasks.pop_back();
+            --queued_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Task& task)
+{
+    Job* job = task.job;
+    try
+    {
+        (*job->fn)(task.index);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (!job->error)
+        {
+            job->error = std::current_exception();
+        }
+    }
+    if (job->pending.fetch_sub(1) == 1)
+    {
+        // The caller may return (and destroy the job) as soon as it sees
+        // done, so done is only published under the job mutex.
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        job->cv.notify_all();
+    }
+}
+
+void ThreadPool::worker_loop(int self)
+{
+    tls_pool = this;
+    tls_slot = self;
+    while (true)
+    {
+        Task task;
+        if (pop(self, &task) || steal(self, &task))
+        {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return stop_ || queued_.load() > 0; });
+        if (stop_ && queued_.load() <= 0)
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::run(int64_t num_tasks, const std::function<void(int64_t)>& fn)
+{
+    if (num_tasks <= 0)
+    {
+        return;
+    }
+    const int n = num_threads();
+    if (n == 1 || num_tasks == 1)
+    {
+        for (int64_t i = 0; i < num_tasks; ++i)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    Job job;
+    job.fn      = &fn;
+    job.pending = num_tasks;
+    job.done    = false;
+
+    // Contiguous blocks of tasks, one per queue starting with our own, so
+    // each thread walks neighbouring chunks unless it has to steal.
+    const int self   = (tls_pool == this) ? tls_slot : 0;
+    const int blocks = static_cast<int>(std::min<int64_t>(n, num_tasks));
+    for (int b = 0; b < blocks; ++b)
+    {
+        const int64_t               lo = num_tasks * b / blocks;
+        const int64_t               hi = num_tasks * (b + 1) / blocks;
+        Queue&                      q  = *queues_[(self + b) % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        for (int64_t i = lo; i < hi; ++i)
+        {
+            q.tasks.push_back(Task{&job, i});
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_ += num_tasks;
+    }
+    cv_.notify_all();
+
+    // Help until there is nothing left to take, then wait for the chunks
+    // still running on other threads.
+    Task task;
+    while (job.pending.load() > 0 && (pop(self, &task) || steal(self, &task)))
+    {
+        execute(task);
+    }
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.cv.wait(lock, [&job]() { return job.done; });
+    if (job.error)
+    {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void ThreadPool::parallel_for(int64_t                                     begin,
+                              int64_t                                     end,
+                              int64_t                                     grain,
+                              const std::function<void(int64_t, int64_t)>& fn)
+{
+    if (end <= begin)
+    {
+        return;
+    }
+    grain                    = std::max<int64_t>(grain, 1);
+    const int64_t range      = end - begin;
+    const int64_t num_chunks =
+        std::min(kChunksPerThread * num_threads(), (range + grain - 1) / grain);
+    if (num_chunks <= 1 || num_threads() == 1)
+    {
+        fn(begin, end);
+        return;
+    }
+
+    const int64_t chunk = (range + num_chunks - 1) / num_chunks;
+    run((range + chunk - 1) / chunk,
+        [&](int64_t i)
+        {
+            const int64_t lo = begin + i * chunk;
+            fn(lo, std::min(lo + chunk, end));
+        });
+}
+
+void ThreadPool::parallel_for_2d(
+    int64_t                                                       row_begin,
+    int64_t                                                       row_end,
+    int64_t                                                       col_begin,
+    int64_t                                                       col_end,
+    int64_t                                                       row_grain,
+    int64_t                                                       col_grain,
+    const std::function<void(int64_t, int64_t, int64_t, int64_t)>& fn)
+{
+    if (row_end <= row_begin || col_end <= col_begin)
+    {
+        return;
+    }
+    row_grain             = std::max<int64_t>(row_grain, 1);
+    col_grain             = std::max<int64_t>(col_grain, 1);
+    const int64_t rows    = row_end - row_begin;
+    const int64_t cols    = col_end - col_begin;
+    const int64_t target  = kChunksPerThread * num_threads();
+    // Split rows first, then columns while the blocks are still too few.
+    const int64_t row_blk = std::min((rows + row_grain - 1) / row_grain, target);
+    const int64_t col_blk = std::min((cols + col_grain - 1) / col_grain,
+                                     std::max<int64_t>(1, target / row_blk));
+    if (row_blk * col_blk <= 1 || num_threads() == 1)
+    {
+        fn(row_begin, row_end, col_begin, col_end);
+        return;
+    }
+
+    const int64_t row_chunk = (rows + row_blk - 1) / row_blk;
+    const int64_t col_chunk = (cols + col_blk - 1) / col_blk;
+    const int64_t row_cnt   = (rows + row_chunk - 1) / row_chunk;
+    const int64_t col_cnt   = (cols + col_chunk - 1) / col_chunk;
+    run(row_cnt * col_cnt,
+        [&](int64_t i)
+        {
+            const int64_t r0 = row_begin + (i / col_cnt) * row_chunk;
+            const int64_t c0 = col_begin + (i % col_cnt) * col_chunk;
+            fn(r0, std::min(r0 + row_chunk, row_end), c0, std::min(c0 + col_chunk, col_end));
+        });
+}
+
+}  // namespace ferrari
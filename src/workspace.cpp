@@ -0,0 +1,161 @@
+#include "workspace.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace ferrari
+{
+
+int WorkspacePlanner::AddTensor(const std::string& name, size_t bytes)
+{
+    Tensor t;
+    t.name       = name;
+    t.bytes      = bytes;
+    t.persistent = false;
+    t.first      = -1;
+    t.last       = -1;
+    t.offset     = 0;
+    tensors_.push_back(t);
+    planned_ = false;
+    return static_cast<int>(tensors_.size()) - 1;
+}
+
+void WorkspacePlanner::MarkPersistent(int tensor)
+{
+    CHECK_GE(tensor, 0);
+    CHECK_LT(tensor, num_tensors());
+    tensors_[tensor].persistent = true;
+    planned_                    = false;
+}
+
+void WorkspacePlanner::AddStage(const std::string&      name,
+                                const std::vector<int>& reads,
+                                const std::vector<int>& writes)
+{
+    const int stage = static_cast<int>(stages_.size());
+    stages_.push_back(name);
+    for (const std::vector<int>* ids : {&reads, &writes})
+    {
+        for (int id : *ids)
+        {
+            CHECK_GE(id, 0);
+            CHECK_LT(id, num_tensors()) << "stage " << name << " uses an unknown tensor";
+            Tensor& t = tensors_[id];
+            t.first   = (t.first < 0) ? stage : std::min(t.first, stage);
+            t.last    = std::max(t.last, stage);
+        }
+    }
+    planned_ = false;
+}
+
+int WorkspacePlanner::Plan()
+{
+    const int last_stage = static_cast<int>(stages_.size()) - 1;
+    for (Tensor& t : tensors_)
+    {
+        if (t.first < 0)
+        {
+            LOG(ERROR) << "workspace tensor " << t.name << " is not used by any stage";
+            return -1;
+        }
+        if (t.persistent)
+        {
+            t.first = 0;
+            t.last  = last_stage;
+        }
+    }
+
+    // Largest first; ties keep declaration order so the layout is stable.
+    std::vector<int> order(tensors_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [this](int a, int b) { return tensors_[a].bytes > tensors_[b].bytes; });
+
+    arena_bytes_ = 0;
+    std::vector<int> placed;
+    for (int id : order)
+    {
+        Tensor& t = tensors_[id];
+
+        // Ranges already taken during t's lifetime, by offset.
+        std::vector<std::pair<size_t, size_t>> busy;
+        for (int other : placed)
+        {
+            const Tensor& o = tensors_[other];
+            if (o.first <= t.last && t.first <= o.last)
+            {
+                busy.push_back(std::make_pair(o.offset, o.offset + o.bytes));
+            }
+        }
+        std::sort(busy.begin(), busy.end());
+
+        // Lowest aligned gap that holds t.
+        size_t offset = 0;
+        for (const auto& range : busy)
+        {
+            if (offset + t.bytes <= range.first)
+            {
+                break;
+            }
+            offset = std::max(offset, (range.second + kAlignment - 1) / kAlignment * kAlignment);
+        }
+        t.offset     = offset;
+        arena_bytes_ = std::max(arena_bytes_, offset + t.bytes);
+        placed.push_back(id);
+    }
+    arena_bytes_ = (arena_bytes_ + kAlignment - 1) / kAlignment * kAlignment;
+    planned_     = true;
+    return 0;
+}
+
+size_t WorkspacePlanner::total_bytes() const
+{
+    size_t total = 0;
+    for (const Tensor& t : tensors_)
+    {
+        total += t.bytes;
+    }
+    return total;
+}
+
+size_t WorkspacePlanner::offset(int tensor) const
+{
+    CHECK(planned_) << "WorkspacePlanner::Plan has not been called";
+    return tensors_.at(tensor).offset;
+}
+
+size_t WorkspacePlanner::bytes(int tensor) const
+{
+    return tensors_.at(tensor).bytes;
+}
+
+const std::string& WorkspacePlanner::name(int tensor) const
+{
+    return tensors_.at(tensor).name;
+}
+
+int WorkspacePlanner::first_stage(int tensor) const
+{
+    CHECK(planned_) << "WorkspacePlanner::Plan has not been called";
+    return tensors_.at(tensor).first;
+}
+
+int WorkspacePlanner::last_stage(int tensor) const
+{
+    CHECK(planned_) << "WorkspacePlanner::Plan has not been called";
+    return tensors_.at(tensor).last;
+}
+
+Workspace::Workspace(const WorkspacePlanner& planner) : planner_(planner)
+{
+    CHECK(planner_.planned()) << "Workspace needs a planned WorkspacePlanner";
+    arena_.reset(new SyncedMemory(std::max<size_t>(planner_.arena_bytes(), 1)));
+}
+
+void* Workspace::data(int tensor)
+{
+    return static_cast<char*>(arena_->mutable_cpu_data()) + planner_.offset(tensor);
+}
+
+}  // namespace ferrari
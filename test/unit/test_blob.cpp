@@ -0,0 +1,128 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "blob.hpp"
+#include "blob_view.hpp"
+#include "syncedmem.hpp"
+#include "tensor_view.hpp"
+
+using namespace ::ferrari;
+
+TEST_CASE("Blob counts and offsets beyond INT_MAX", "[blob]")
+{
+    // 11 对帧在 1080p 的 1/8 分辨率下的全对相关体：[B*H*W, 1, H, W]
+    const int     batch = 11, ht = 135, wd = 240;
+    const int64_t hw    = static_cast<int64_t>(ht) * wd;
+    Blob<float>   corr(batch * ht * wd, 1, ht, wd);
+    CHECK(corr.count() == batch * hw * hw);
+    CHECK(corr.count() > std::numeric_limits<int>::max());
+    CHECK(corr.count(1) == hw);
+    CHECK(corr.offset(batch * ht * wd - 1, 0, ht - 1, wd - 1) == corr.count() - 1);
+    CHECK(corr.offset(std::vector<int>({batch * ht * wd - 1, 0, 1, 0})) ==
+          corr.count() - hw + wd);
+    // 元数据只在访问数据时才分配内存
+    CHECK(corr.data()->size() == sizeof(float) * static_cast<size_t>(corr.count()));
+    CHECK(corr.data()->head() == SyncedMemory::UNINITIALIZED);
+
+    // 缩小后容量保留，不会重新申请
+    const SyncedMemory* storage = corr.data().get();
+    corr.Reshape(std::vector<int>({2, 3}));
+    CHECK(corr.count() == 6);
+    CHECK(corr.data().get() == storage);
+}
+
+TEST_CASE("BlobView slices share the parent's memory", "[blob view]")
+{
+    Caffe::set_mode(Caffe::CPU);
+    Blob<float> blob(std::vector<int>({3, 4, 5, 6}));
+    float*      data = blob.mutable_cpu_data();
+    for (int i = 0; i < blob.count(); ++i)
+    {
+        data[i] = static_cast<float>(i);
+    }
+    const BlobView<float> all(blob);
+    CHECK(all.is_contiguous());
+    CHECK(all.stride(0) == 120);
+    CHECK(all.stride(-1) == 1);
+
+    // 沿 batch 切片仍是连续的，直接写回父 blob
+    BlobView<float> pair = all.Select(0, 1);
+    CHECK(pair.num_axes() == 3);
+    CHECK(pair.is_contiguous());
+    CHECK(pair.cpu_data() == blob.cpu_data() + 120);
+    pair.mutable_cpu_data()[7] = -1.0f;
+    CHECK(blob.data_at(1, 0, 1, 1) == -1.0f);
+    CHECK(all.Slice(0, 1, 3).count() == 240);
+    CHECK(all.Slice(0, 1, 3).is_contiguous());
+
+    // 通道与空间切片带步长
+    const BlobView<float> channels = all.Slice(1, 1, 3);
+    CHECK(!channels.is_contiguous());
+    CHECK(channels.data_at({2, 1, 4, 5}) == blob.data_at(2, 2, 4, 5));
+    const BlobView<float> tile = all.Select(0, 2).Slice(1, 1, 4).Slice(2, 2, 5);
+    CHECK(tile.shape() == std::vector<int>({4, 3, 3}));
+    CHECK(tile.storage_offset() == blob.offset(2, 0, 1, 2));
+
+    Blob<float> dense;
+    tile.CopyTo(&dense);
+    CHECK(dense.shape() == tile.shape());
+    for (int c = 0; c < 4; ++c)
+    {
+        for (int h = 0; h < 3; ++h)
+        {
+            for (int w = 0; w < 3; ++w)
+            {
+                CHECK(dense.data_at(std::vector<int>({c, h, w})) ==
+                      blob.data_at(2, c, h + 1, w + 2));
+            }
+        }
+    }
+
+    // 写入带步长的视图只改动其覆盖的元素
+    std::fill(dense.mutable_cpu_data(), dense.mutable_cpu_data() + dense.count(), 0.0f);
+    tile.CopyFrom(dense);
+    CHECK(blob.data_at(2, 3, 3, 4) == 0.0f);
+    CHECK(blob.data_at(2, 3, 3, 5) == static_cast<float>(blob.offset(2, 3, 3, 5)));
+    CHECK(blob.data_at(2, 0, 0, 2) == static_cast<float>(blob.offset(2, 0, 0, 2)));
+}
+
+TEST_CASE("TensorView indexes like Blob::data_at", "[tensor view]")
+{
+    Caffe::set_mode(Caffe::CPU);
+    Blob<float> blob(std::vector<int>({2, 3, 4, 5}));
+    auto        out = mutable_tensor_view<4>(&blob);
+    CHECK(out.count() == blob.count());
+    for (int n = 0; n < 2; ++n)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            for (int h = 0; h < 4; ++h)
+            {
+                for (int w = 0; w < 5; ++w)
+                {
+                    out(n, c, h, w) = static_cast<float>(((n * 3 + c) * 4 + h) * 5 + w);
+                }
+            }
+        }
+    }
+    const TensorView<const float, 4> in = tensor_view<4>(blob);
+    CHECK(in.data() == blob.cpu_data());
+    CHECK(in.offset(1, 2, 3, 4) == blob.offset(1, 2, 3, 4));
+    for (int i = 0; i < blob.count(); ++i)
+    {
+        CHECK(blob.cpu_data()[i] == static_cast<float>(i));
+    }
+    const TensorView<const float, 4> ro = out;
+    CHECK(ro.ptr(1, 0, 2, 0) == blob.cpu_data() + blob.offset(1, 0, 2, 0));
+
+    // 带步长的 BlobView: 第 1 个 batch 的 2x3 空间子块
+    const BlobView<float> sub  = BlobView<float>(blob).Select(0, 1).Slice(2, 1, 4).Slice(1, 2, 4);
+    const auto            tile = tensor_view<3>(sub);
+    CHECK(tile.shape(1) == 2);
+    CHECK(tile.shape(2) == 3);
+    CHECK(tile.stride(0) == 20);
+    CHECK(tile(2, 1, 2) == blob.data_at(1, 2, 3, 3));
+}
@@ -0,0 +1,904 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "cpu_functional.hpp"
+#include "cuda_functional.hpp"
+#include "cpu_gemm.hpp"
+#include "cpu_quant.hpp"
+#include "half.hpp"
+#include "parallel.hpp"
+#include "raft.hpp"
+#include "tensor_view.hpp"
+#include "thread_pool.hpp"
+#include "workspace.hpp"
+
+using Catch::Approx;
+using namespace ::ferrari;
+
+namespace
+{
+
+// 逐像素的参考实现，与 grid_sample_kernel 的计算方式一致
+float reference_sample(const float* plane, int H, int W, float x, float y)
+{
+    float x_in = 0.5f * (x + 1.0f) * (W - 1);
+    float y_in = 0.5f * (y + 1.0f) * (H - 1);
+    int   x0   = std::floor(x_in);
+    int   y0   = std::floor(y_in);
+    float wx   = x_in - x0;
+    float wy   = y_in - y0;
+
+    auto at = [&](int yy, int xx)
+    { return (xx >= 0 && xx < W && yy >= 0 && yy < H) ? plane[yy * W + xx] : 0.0f; };
+
+    float top    = at(y0, x0) * (1 - wx) + at(y0, x0 + 1) * wx;
+    float bottom = at(y0 + 1, x0) * (1 - wx) + at(y0 + 1, x0 + 1) * wx;
+    return top * (1 - wy) + bottom * wy;
+}
+
+}  // namespace
+
+TEST_CASE("parallel_for covers every index exactly once", "[cpu]")
+{
+    for (int threads : {1, 3, 0})
+    {
+        Caffe::set_num_threads(threads);
+        if (threads > 0)
+        {
+            REQUIRE(Caffe::num_threads() == threads);
+        }
+
+        // 1-D：不同 grain 下每个下标只被访问一次
+        for (int64_t grain : {1, 7, 1000})
+        {
+            std::vector<std::atomic<int>> hits(997);
+            for (auto& h : hits)
+            {
+                h = 0;
+            }
+            parallel_for(0,
+                         hits.size(),
+                         grain,
+                         [&](int64_t begin, int64_t end)
+                         {
+                             for (int64_t i = begin; i < end; ++i)
+                             {
+                                 ++hits[i];
+                             }
+                         });
+            int64_t bad = 0;
+            for (auto& h : hits)
+            {
+                bad += (h != 1);
+            }
+            CHECK(bad == 0);
+        }
+
+        // 2-D：块之间不重叠且覆盖整个矩形，内部再嵌套一层 parallel_for
+        const int64_t                 R = 37, C = 53;
+        std::vector<std::atomic<int>> hits(R * C);
+        for (auto& h : hits)
+        {
+            h = 0;
+        }
+        parallel_for_2d(3,
+                        R,
+                        5,
+                        C,
+                        4,
+                        8,
+                        [&](int64_t r0, int64_t r1, int64_t c0, int64_t c1)
+                        {
+                            parallel_for(r0,
+                                         r1,
+                                         1,
+                                         [&](int64_t rb, int64_t re)
+                                         {
+                                             for (int64_t r = rb; r < re; ++r)
+                                             {
+                                                 for (int64_t c = c0; c < c1; ++c)
+                                                 {
+                                                     ++hits[r * C + c];
+                                                 }
+                                             }
+                                         });
+                        });
+        int64_t bad = 0;
+        for (int64_t r = 0; r < R; ++r)
+        {
+            for (int64_t c = 0; c < C; ++c)
+            {
+                bad += (hits[r * C + c] != ((r >= 3 && c >= 5) ? 1 : 0));
+            }
+        }
+        CHECK(bad == 0);
+    }
+
+    // 绑核只影响调度，不影响结果
+    Caffe::set_thread_affinity(true);
+    std::atomic<int64_t> sum(0);
+    parallel_for(0,
+                 10000,
+                 10,
+                 [&](int64_t begin, int64_t end)
+                 {
+                     for (int64_t i = begin; i < end; ++i)
+                     {
+                         sum += i;
+                     }
+                 });
+    CHECK(sum == 10000LL * 9999 / 2);
+    Caffe::set_thread_affinity(false);
+}
+
+TEST_CASE("grid_sample_cpu corners", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+
+    const int N = 1, C = 1, H_in = 4, W_in = 4, H_out = 2, W_out = 2;
+
+    std::shared_ptr<Blob<float>> in_blob   = std::make_shared<Blob<float>>(N, C, H_in, W_in);
+    std::shared_ptr<Blob<float>> grid_blob = std::make_shared<Blob<float>>(N, H_out, W_out, 2);
+    std::shared_ptr<Blob<float>> out_blob  = std::make_shared<Blob<float>>(N, C, H_out, W_out);
+
+    float* h_input = in_blob->mutable_cpu_data();
+    for (int i = 0; i < in_blob->count(); ++i)
+    {
+        h_input[i] = static_cast<float>(i);
+    }
+    const float h_grid[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+    std::copy(h_grid, h_grid + 8, grid_blob->mutable_cpu_data());
+
+    REQUIRE(grid_sample_cpu(in_blob, grid_blob, out_blob) == 0);
+
+    const float  h_expected_output[] = {0.0f, 3.0f, 12.0f, 15.0f};
+    const float* h_output            = out_blob->cpu_data();
+    for (int i = 0; i < out_blob->count(); ++i)
+    {
+        REQUIRE(h_output[i] == Approx(h_expected_output[i]));
+    }
+}
+
+TEST_CASE("grid_sample_cpu matches reference with padding and vector tails", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+
+    // W_out 不是 8 / 16 的倍数，覆盖 SIMD 主循环和标量尾部
+    const int N = 2, C = 3, H_in = 5, W_in = 7, H_out = 6, W_out = 37;
+
+    std::shared_ptr<Blob<float>> in_blob   = std::make_shared<Blob<float>>(N, C, H_in, W_in);
+    std::shared_ptr<Blob<float>> grid_blob = std::make_shared<Blob<float>>(N, H_out, W_out, 2);
+    std::shared_ptr<Blob<float>> out_blob  = std::make_shared<Blob<float>>(N, C, H_out, W_out);
+
+    float* h_input = in_blob->mutable_cpu_data();
+    for (int i = 0; i < in_blob->count(); ++i)
+    {
+        h_input[i] = std::sin(0.37f * i) * 10.0f;
+    }
+    // 网格坐标覆盖 [-1.4, 1.4]，部分采样点落在边界外
+    float* h_grid = grid_blob->mutable_cpu_data();
+    for (int i = 0; i < grid_blob->count(); ++i)
+    {
+        h_grid[i] = 1.4f * std::sin(1.3f * i + 0.5f);
+    }
+
+    REQUIRE(grid_sample_cpu(in_blob, grid_blob, out_blob) == 0);
+
+    const float* h_output = out_blob->cpu_data();
+    for (int n = 0; n < N; ++n)
+    {
+        for (int c = 0; c < C; ++c)
+        {
+            const float* plane = h_input + (n * C + c) * H_in * W_in;
+            for (int h = 0; h < H_out; ++h)
+            {
+                for (int w = 0; w < W_out; ++w)
+                {
+                    const float* g        = h_grid + ((n * H_out + h) * W_out + w) * 2;
+                    float        expected = reference_sample(plane, H_in, W_in, g[0], g[1]);
+                    float        actual = h_output[((n * C + c) * H_out + h) * W_out + w];
+                    REQUIRE(actual == Approx(expected).margin(1e-5f));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("build_corr_pyramid_cpu matches per-level pooling", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+
+    // 奇数尺寸，逐层向下取整
+    const int N = 5, H = 27, W = 43, num_levels = 4;
+
+    std::vector<std::shared_ptr<Blob<float>>> pyramid;
+    for (int i = 0; i < num_levels; ++i)
+    {
+        int h = (int)(H / std::pow(2, i));
+        int w = (int)(W / std::pow(2, i));
+        pyramid.push_back(std::make_shared<Blob<float>>(N, 1, h, w));
+    }
+    float* level0 = pyramid[0]->mutable_cpu_data();
+    for (int i = 0; i < pyramid[0]->count(); ++i)
+    {
+        level0[i] = std::sin(0.013f * i) * 3.0f;
+    }
+
+    REQUIRE(build_corr_pyramid_cpu(pyramid) == 0);
+
+    std::vector<float> expected(level0, level0 + pyramid[0]->count());
+    int                h = H, w = W;
+    for (int i = 1; i < num_levels; ++i)
+    {
+        int                out_h = h / 2, out_w = w / 2;
+        std::vector<float> next(N * out_h * out_w);
+        for (int n = 0; n < N; ++n)
+        {
+            for (int y = 0; y < out_h; ++y)
+            {
+                for (int x = 0; x < out_w; ++x)
+                {
+                    const float* p = &expected[(n * h + 2 * y) * w + 2 * x];
+                    next[(n * out_h + y) * out_w + x] = 0.25f * (p[0] + p[1] + p[w] + p[w + 1]);
+                }
+            }
+        }
+
+        REQUIRE(pyramid[i]->count() == (int)next.size());
+        const float* actual = pyramid[i]->cpu_data();
+        for (size_t j = 0; j < next.size(); ++j)
+        {
+            REQUIRE(actual[j] == Approx(next[j]).margin(1e-5f));
+        }
+        expected.swap(next);
+        h = out_h;
+        w = out_w;
+    }
+}
+
+TEST_CASE("corr_lookup_cpu matches grid + grid_sample per level", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+
+    const int batch = 2, ht = 9, wd = 10, num_levels = 3, r = 2;
+    const int K = 2 * r + 1, hw = ht * wd;
+
+    std::vector<std::shared_ptr<Blob<float>>> pyramid;
+    for (int i = 0; i < num_levels; ++i)
+    {
+        int h = (int)(ht / std::pow(2, i));
+        int w = (int)(wd / std::pow(2, i));
+        pyramid.push_back(std::make_shared<Blob<float>>(batch * hw, 1, h, w));
+    }
+    float* level0 = pyramid[0]->mutable_cpu_data();
+    for (int i = 0; i < pyramid[0]->count(); ++i)
+    {
+        level0[i] = std::sin(0.29f * i);
+    }
+    build_corr_pyramid_cpu(pyramid);
+
+    // coords: [batch, 2, ht, wd]，部分窗口落在边界外
+    std::shared_ptr<Blob<float>> coords = std::make_shared<Blob<float>>(batch, 2, ht, wd);
+    float*                       h_coords = coords->mutable_cpu_data();
+    for (int n = 0; n < batch; ++n)
+    {
+        for (int p = 0; p < hw; ++p)
+        {
+            h_coords[(n * 2 + 0) * hw + p] = p % wd + 2.5f * std::sin(0.7f * p + n);
+            h_coords[(n * 2 + 1) * hw + p] = p / wd + 2.5f * std::cos(0.9f * p + n);
+        }
+    }
+
+    std::vector<float> output(batch * num_levels * K * K * hw);
+    REQUIRE(corr_lookup_cpu(pyramid, h_coords, batch, ht, wd, r, output.data()) == 0);
+
+    // 参考路径：按 compute_grid 的方式生成归一化 grid，再逐层 grid_sample
+    for (int i = 0; i < num_levels; ++i)
+    {
+        const int H = pyramid[i]->shape(2), W = pyramid[i]->shape(3);
+        const float scale = 1.0f / std::pow(2, i);
+
+        std::shared_ptr<Blob<float>> grid    = std::make_shared<Blob<float>>(batch * hw, K, K, 2);
+        std::shared_ptr<Blob<float>> sampled = std::make_shared<Blob<float>>(batch * hw, 1, K, K);
+        float*                       h_grid  = grid->mutable_cpu_data();
+        for (int n = 0; n < batch; ++n)
+        {
+            for (int p = 0; p < hw; ++p)
+            {
+                float x = h_coords[(n * 2 + 0) * hw + p] * scale;
+                float y = h_coords[(n * 2 + 1) * hw + p] * scale;
+                for (int a = 0; a < K; ++a)
+                {
+                    for (int b = 0; b < K; ++b)
+                    {
+                        float* g = h_grid + (((n * hw + p) * K + a) * K + b) * 2;
+                        g[0]     = 2.0f / (W - 1) * (x + b - r) - 1.0f;
+                        g[1]     = 2.0f / (H - 1) * (y + a - r) - 1.0f;
+                    }
+                }
+            }
+        }
+        grid_sample_cpu(pyramid[i], grid, sampled);
+
+        const float* expected = sampled->cpu_data();
+        for (int n = 0; n < batch; ++n)
+        {
+            for (int p = 0; p < hw; ++p)
+            {
+                for (int k = 0; k < K * K; ++k)
+                {
+                    float e = expected[(n * hw + p) * K * K + k];
+                    float v = output[((n * num_levels + i) * K * K + k) * hw + p];
+                    REQUIRE(v == Approx(e).margin(1e-4f));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("corr_lookup_on_demand_cpu matches the all-pairs lookup", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+
+    const int batch = 2, dim = 37, ht = 9, wd = 12, num_levels = 3, r = 2;
+    const int K = 2 * r + 1, hw = ht * wd;
+
+    std::shared_ptr<Blob<float>> fmap1 = std::make_shared<Blob<float>>(batch, dim, ht, wd);
+    std::shared_ptr<Blob<float>> fmap2 = std::make_shared<Blob<float>>(batch, dim, ht, wd);
+    float*                       h_f1  = fmap1->mutable_cpu_data();
+    float*                       h_f2  = fmap2->mutable_cpu_data();
+    for (int i = 0; i < fmap1->count(); ++i)
+    {
+        h_f1[i] = std::sin(0.17f * i);
+        h_f2[i] = std::cos(0.23f * i);
+    }
+
+    std::shared_ptr<Blob<float>> coords   = std::make_shared<Blob<float>>(batch, 2, ht, wd);
+    float*                       h_coords = coords->mutable_cpu_data();
+    for (int n = 0; n < batch; ++n)
+    {
+        for (int p = 0; p < hw; ++p)
+        {
+            h_coords[(n * 2 + 0) * hw + p] = p % wd + 3.0f * std::sin(0.5f * p + n);
+            h_coords[(n * 2 + 1) * hw + p] = p / wd + 3.0f * std::cos(0.8f * p + n);
+        }
+    }
+
+    // 完整相关体路径
+    std::vector<std::shared_ptr<Blob<float>>> corr_pyramid;
+    std::vector<std::shared_ptr<Blob<float>>> fmap2_pyramid;
+    for (int i = 0; i < num_levels; ++i)
+    {
+        int h = (int)(ht / std::pow(2, i));
+        int w = (int)(wd / std::pow(2, i));
+        corr_pyramid.push_back(std::make_shared<Blob<float>>(batch * hw, 1, h, w));
+        fmap2_pyramid.push_back(
+            std::make_shared<Blob<float>>(std::vector<int>({batch, h, w, dim})));
+    }
+    for (int n = 0; n < batch; ++n)
+    {
+        caffe_cpu_sgemm(true,
+                        false,
+                        hw,
+                        hw,
+                        dim,
+                        1.0f / std::sqrt((float)dim),
+                        h_f1 + n * dim * hw,
+                        h_f2 + n * dim * hw,
+                        0.0f,
+                        corr_pyramid[0]->mutable_cpu_data() + n * hw * hw);
+    }
+    build_corr_pyramid_cpu(corr_pyramid);
+    std::vector<float> expected(batch * num_levels * K * K * hw);
+    corr_lookup_cpu(corr_pyramid, h_coords, batch, ht, wd, r, expected.data());
+
+    // 按需计算路径
+    std::shared_ptr<Blob<float>> fmap1_nhwc =
+        std::make_shared<Blob<float>>(std::vector<int>({batch, ht, wd, dim}));
+    REQUIRE(build_feature_pyramid_cpu(fmap1, {fmap1_nhwc}) == 0);
+    REQUIRE(build_feature_pyramid_cpu(fmap2, fmap2_pyramid) == 0);
+    std::vector<float> output(expected.size());
+    REQUIRE(corr_lookup_on_demand_cpu(fmap1_nhwc, fmap2_pyramid, h_coords, r, output.data()) == 0);
+
+    for (size_t i = 0; i < output.size(); ++i)
+    {
+        REQUIRE(output[i] == Approx(expected[i]).margin(1e-4f));
+    }
+}
+
+TEST_CASE("caffe_cpu_sgemm matches naive gemm", "[cpu]")
+{
+    // 尺寸不是分块大小的整数倍，K 跨越多个 KC 分块
+    const int   M = 101, N = 77, K = 300;
+    const float alpha = 0.5f, beta = 0.25f;
+
+    std::vector<float> A(M * K), B(K * N), C0(M * N);
+    for (size_t i = 0; i < A.size(); ++i)
+    {
+        A[i] = std::sin(0.11f * i);
+    }
+    for (size_t i = 0; i < B.size(); ++i)
+    {
+        B[i] = std::cos(0.07f * i);
+    }
+    for (size_t i = 0; i < C0.size(); ++i)
+    {
+        C0[i] = std::sin(0.03f * i);
+    }
+
+    for (int trans_a = 0; trans_a < 2; ++trans_a)
+    {
+        for (int trans_b = 0; trans_b < 2; ++trans_b)
+        {
+            std::vector<float> C = C0;
+            caffe_cpu_sgemm(trans_a, trans_b, M, N, K, alpha, A.data(), B.data(), beta, C.data());
+
+            for (int i = 0; i < M; ++i)
+            {
+                for (int j = 0; j < N; ++j)
+                {
+                    double sum = 0.0;
+                    for (int k = 0; k < K; ++k)
+                    {
+                        float a = trans_a ? A[k * M + i] : A[i * K + k];
+                        float b = trans_b ? B[j * K + k] : B[k * N + j];
+                        sum += a * b;
+                    }
+                    float expected = alpha * sum + beta * C0[i * N + j];
+                    REQUIRE(C[i * N + j] == Approx(expected).margin(1e-3f));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("float16 / bfloat16 conversions round to nearest even", "[cpu]")
+{
+    // 可精确表示的值、舍入边界与特殊值
+    REQUIRE(float16(1.0f).bits == 0x3c00);
+    REQUIRE(float16(-2.0f).bits == 0xc000);
+    REQUIRE(float16(65504.0f).bits == 0x7bff);
+    REQUIRE(float16(65520.0f).bits == 0x7c00);
+    REQUIRE(float16(1.0f + std::ldexp(1.0f, -11)).bits == 0x3c00);
+    REQUIRE(float16(1.0f + 3 * std::ldexp(1.0f, -11)).bits == 0x3c02);
+    REQUIRE(float16(std::ldexp(1.0f, -24)).bits == 0x0001);
+    REQUIRE(static_cast<float>(float16(std::ldexp(1.0f, -24))) == std::ldexp(1.0f, -24));
+    REQUIRE(std::isnan(static_cast<float>(float16(NAN))));
+
+    REQUIRE(bfloat16(1.0f).bits == 0x3f80);
+    REQUIRE(bfloat16(1.0f + std::ldexp(1.0f, -8)).bits == 0x3f80);
+    REQUIRE(bfloat16(1.0f + 3 * std::ldexp(1.0f, -8)).bits == 0x3f82);
+    REQUIRE(std::isnan(static_cast<float>(bfloat16(NAN))));
+
+    // 批量转换 (SIMD 主体 + 尾部) 与标量转换逐位一致
+    const int          n = 77;
+    std::vector<float> src(n), back16(n), back_bf(n);
+    for (int i = 0; i < n; ++i)
+    {
+        src[i] = 300.0f * std::sin(0.37f * i) * std::exp(-0.1f * i);
+    }
+    src[5] = NAN;
+    std::vector<float16>  h(n);
+    std::vector<bfloat16> bf(n);
+    caffe_cpu_convert(n, src.data(), h.data());
+    caffe_cpu_convert(n, src.data(), bf.data());
+    caffe_cpu_convert(n, h.data(), back16.data());
+    caffe_cpu_convert(n, bf.data(), back_bf.data());
+    for (int i = 0; i < n; ++i)
+    {
+        REQUIRE(h[i].bits == float16(src[i]).bits);
+        REQUIRE(bf[i].bits == bfloat16(src[i]).bits);
+        if (i == 5)
+        {
+            REQUIRE(std::isnan(back16[i]));
+            REQUIRE(std::isnan(back_bf[i]));
+            continue;
+        }
+        REQUIRE(back16[i] == static_cast<float>(h[i]));
+        REQUIRE(back_bf[i] == static_cast<float>(bf[i]));
+        REQUIRE(back16[i] == Approx(src[i]).epsilon(1e-3f).margin(1e-7f));
+        REQUIRE(back_bf[i] == Approx(src[i]).epsilon(8e-3f).margin(1e-30f));
+    }
+}
+
+TEST_CASE("16-bit correlation pyramids track the fp32 pyramid", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+
+    const int batch = 1, dim = 24, ht = 9, wd = 14, num_levels = 3, r = 2;
+    const int K = 2 * r + 1, hw = ht * wd;
+
+    std::vector<float> f1(batch * dim * hw), f2(batch * dim * hw);
+    for (size_t i = 0; i < f1.size(); ++i)
+    {
+        f1[i] = std::sin(0.13f * i);
+        f2[i] = std::cos(0.17f * i);
+    }
+
+    std::vector<std::shared_ptr<Blob<float>>>    p32;
+    std::vector<std::shared_ptr<Blob<float16>>>  p16;
+    std::vector<std::shared_ptr<Blob<bfloat16>>> pbf;
+    for (int i = 0; i < num_levels; ++i)
+    {
+        int h = (int)(ht / std::pow(2, i));
+        int w = (int)(wd / std::pow(2, i));
+        p32.push_back(std::make_shared<Blob<float>>(batch * hw, 1, h, w));
+        p16.push_back(std::make_shared<Blob<float16>>(batch * hw, 1, h, w));
+        pbf.push_back(std::make_shared<Blob<bfloat16>>(batch * hw, 1, h, w));
+    }
+
+    // 与 CorrBlock 相同的 GEMM，16 位版本在写回时转换
+    const float alpha = 1.0f / std::sqrt(static_cast<float>(dim));
+    caffe_cpu_sgemm(
+        true, false, hw, hw, dim, alpha, f1.data(), f2.data(), 0.0f, p32[0]->mutable_cpu_data());
+    caffe_cpu_sgemm(
+        true, false, hw, hw, dim, alpha, f1.data(), f2.data(), 0.0f, p16[0]->mutable_cpu_data());
+    caffe_cpu_sgemm(
+        true, false, hw, hw, dim, alpha, f1.data(), f2.data(), 0.0f, pbf[0]->mutable_cpu_data());
+
+    const float*    c32 = p32[0]->cpu_data();
+    const float16*  c16 = p16[0]->cpu_data();
+    const bfloat16* cbf = pbf[0]->cpu_data();
+    for (int i = 0; i < p32[0]->count(); ++i)
+    {
+        REQUIRE(c16[i].bits == float16(c32[i]).bits);
+        REQUIRE(cbf[i].bits == bfloat16(c32[i]).bits);
+    }
+
+    build_corr_pyramid_cpu(p32);
+    build_corr_pyramid_cpu(p16);
+    build_corr_pyramid_cpu(pbf);
+
+    std::vector<float> coords(batch * 2 * hw);
+    for (int p = 0; p < hw; ++p)
+    {
+        coords[p]      = p % wd + 1.7f * std::sin(0.5f * p);
+        coords[hw + p] = p / wd + 1.7f * std::cos(0.8f * p);
+    }
+
+    const int          out_count = batch * num_levels * K * K * hw;
+    std::vector<float> o32(out_count), o16(out_count), obf(out_count);
+    REQUIRE(corr_lookup_cpu(p32, coords.data(), batch, ht, wd, r, o32.data()) == 0);
+    REQUIRE(corr_lookup_cpu(p16, coords.data(), batch, ht, wd, r, o16.data()) == 0);
+    REQUIRE(corr_lookup_cpu(pbf, coords.data(), batch, ht, wd, r, obf.data()) == 0);
+
+    // 相关值量级约为 sqrt(dim)，按 fp16 / bf16 的相对精度给出误差界
+    for (int i = 0; i < out_count; ++i)
+    {
+        REQUIRE(o16[i] == Approx(o32[i]).margin(5e-3f));
+        REQUIRE(obf[i] == Approx(o32[i]).margin(4e-2f));
+    }
+}
+
+TEST_CASE("corr_volume_int8_cpu matches the quantized reference and tracks fp32", "[cpu]")
+{
+    // dim 不是 4 的倍数，hw 不是分块大小的整数倍
+    const int   dim = 67, ht = 9, wd = 14, hw = ht * wd;
+    const float alpha = 1.0f / std::sqrt(static_cast<float>(dim));
+
+    std::vector<float> f1(dim * hw), f2(dim * hw);
+    for (int i = 0; i < dim * hw; ++i)
+    {
+        f1[i] = std::sin(0.13f * i) + 0.3f * std::cos(0.029f * i);
+        f2[i] = std::cos(0.17f * i) - 0.2f * std::sin(0.041f * i);
+    }
+    // 全零像素的 scale 为 0
+    for (int k = 0; k < dim; ++k)
+    {
+        f2[k * hw + 7] = 0.0f;
+    }
+
+    std::vector<float>   c32(hw * hw), c8(hw * hw);
+    std::vector<float16> c8h(hw * hw);
+    caffe_cpu_sgemm(true, false, hw, hw, dim, alpha, f1.data(), f2.data(), 0.0f, c32.data());
+    REQUIRE(corr_volume_int8_cpu(f1.data(), f2.data(), dim, hw, alpha, c8.data()) == 0);
+    REQUIRE(corr_volume_int8_cpu(f1.data(), f2.data(), dim, hw, alpha, c8h.data()) == 0);
+
+    // 参考：逐像素对称量化后的整数点积
+    auto quantize = [&](const std::vector<float>& f, std::vector<int>& q, std::vector<float>& s)
+    {
+        q.resize(dim * hw);
+        s.resize(hw);
+        for (int j = 0; j < hw; ++j)
+        {
+            float amax = 0.0f;
+            for (int k = 0; k < dim; ++k)
+            {
+                amax = std::max(amax, std::fabs(f[k * hw + j]));
+            }
+            s[j]      = amax / 127.0f;
+            float inv = amax > 0.0f ? 127.0f / amax : 0.0f;
+            for (int k = 0; k < dim; ++k)
+            {
+                long v           = std::lrint(f[k * hw + j] * inv);
+                q[k * hw + j]    = static_cast<int>(std::min(127L, std::max(-127L, v)));
+            }
+        }
+    };
+    std::vector<int>   q1, q2;
+    std::vector<float> s1, s2;
+    quantize(f1, q1, s1);
+    quantize(f2, q2, s2);
+
+    double err_sq = 0.0, ref_sq = 0.0;
+    for (int i = 0; i < hw; ++i)
+    {
+        for (int j = 0; j < hw; ++j)
+        {
+            int dot = 0;
+            for (int k = 0; k < dim; ++k)
+            {
+                dot += q1[k * hw + i] * q2[k * hw + j];
+            }
+            float expected = alpha * s1[i] * s2[j] * static_cast<float>(dot);
+            REQUIRE(c8[i * hw + j] == Approx(expected).epsilon(1e-6f).margin(1e-7f));
+            REQUIRE(c8h[i * hw + j].bits == float16(c8[i * hw + j]).bits);
+
+            double e = c8[i * hw + j] - c32[i * hw + j];
+            err_sq += e * e;
+            ref_sq += static_cast<double>(c32[i * hw + j]) * c32[i * hw + j];
+        }
+    }
+    REQUIRE(std::sqrt(err_sq / ref_sq) < 0.02);
+
+    // 误差报告抽样的行与完整比较一致
+    CorrQuantReport report;
+    REQUIRE(corr_int8_error_report(f1.data(), f2.data(), 1, dim, hw, alpha, hw, &report) == 0);
+    REQUIRE(report.samples == static_cast<int64_t>(hw) * hw);
+    REQUIRE(report.rms_err == Approx(std::sqrt(err_sq / (hw * hw))).epsilon(1e-3));
+    REQUIRE(report.ref_rms == Approx(std::sqrt(ref_sq / (hw * hw))).epsilon(1e-3));
+    REQUIRE(report.max_abs_err >= report.mean_abs_err);
+}
+
+TEST_CASE("WorkspacePlanner reuses memory only across disjoint lifetimes", "[cpu]")
+{
+    WorkspacePlanner planner;
+    const int        a = planner.AddTensor("a", 1000);
+    const int        b = planner.AddTensor("b", 3000);
+    const int        c = planner.AddTensor("c", 2000);
+    const int        d = planner.AddTensor("d", 500);
+    const int        e = planner.AddTensor("e", 100);
+    planner.MarkPersistent(e);
+    planner.AddStage("s0", {}, {a, b});
+    planner.AddStage("s1", {a, b}, {c});
+    planner.AddStage("s2", {c}, {d});
+    planner.AddStage("s3", {d, e}, {});
+    REQUIRE(planner.Plan() == 0);
+
+    CHECK(planner.first_stage(b) == 0);
+    CHECK(planner.last_stage(b) == 1);
+    CHECK(planner.first_stage(e) == 0);
+    CHECK(planner.last_stage(e) == 3);
+
+    // 生命周期重叠的张量不能共享字节
+    for (int i = 0; i < planner.num_tensors(); ++i)
+    {
+        CHECK(planner.offset(i) % WorkspacePlanner::kAlignment == 0);
+        for (int j = i + 1; j < planner.num_tensors(); ++j)
+        {
+            const bool live = planner.first_stage(i) <= planner.last_stage(j) &&
+                              planner.first_stage(j) <= planner.last_stage(i);
+            const bool overlap = planner.offset(i) < planner.offset(j) + planner.bytes(j) &&
+                                 planner.offset(j) < planner.offset(i) + planner.bytes(i);
+            CHECK(!(live && overlap));
+        }
+    }
+    // d 复用 b 的内存；峰值为 s1 时 a、b、c、e 同时存活
+    CHECK(planner.offset(d) == planner.offset(b));
+    CHECK(planner.arena_bytes() < planner.total_bytes());
+    CHECK(planner.arena_bytes() <= 3000 + 2000 + 1000 + 100 + 4 * WorkspacePlanner::kAlignment);
+
+    WorkspacePlanner unused;
+    unused.AddTensor("x", 16);
+    CHECK(unused.Plan() == -1);
+}
+
+TEST_CASE("CorrBlock with a planned workspace matches the unplanned one", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+    const int batch = 2, dim = 24, ht = 12, wd = 18, levels = 3, radius = 2;
+    const int win = (2 * radius + 1) * (2 * radius + 1);
+
+    auto fmap1 = std::make_shared<Blob<float>>(batch, dim, ht, wd);
+    auto fmap2 = std::make_shared<Blob<float>>(batch, dim, ht, wd);
+    for (int i = 0; i < fmap1->count(); ++i)
+    {
+        fmap1->mutable_cpu_data()[i] = std::sin(0.031f * i);
+        fmap2->mutable_cpu_data()[i] = std::cos(0.027f * i);
+    }
+    auto coords = std::make_shared<Blob<float>>(batch, 2, ht, wd);
+    for (int i = 0; i < coords->count(); ++i)
+    {
+        coords->mutable_cpu_data()[i] = 6.0f + 5.0f * std::sin(0.7f * i);
+    }
+
+    for (CorrBlock::CorrMode mode : {CorrBlock::ALL_PAIRS, CorrBlock::ON_DEMAND})
+    {
+        CorrBlock plain(batch, dim, ht, wd, levels, radius, mode);
+        CorrBlock planned(batch, dim, ht, wd, levels, radius, mode);
+        REQUIRE(planned.workspace_bytes() == 0);
+        REQUIRE(planned.planWorkspace() == 0);
+        REQUIRE(planned.workspace_bytes() > 0);
+
+        // 输入直接写入 arena 中的 fmap blob
+        planned.fmap1_input()->CopyFrom(*fmap1);
+        planned.fmap2_input()->CopyFrom(*fmap2);
+
+        auto out_plain   = std::make_shared<Blob<float>>(batch, levels * win, ht, wd);
+        auto out_planned = std::make_shared<Blob<float>>(batch, levels * win, ht, wd);
+        REQUIRE(plain.computeCorr(fmap1, fmap2) == 0);
+        REQUIRE(planned.computeCorr(planned.fmap1_input(), planned.fmap2_input()) == 0);
+        REQUIRE(plain.call(coords, out_plain) == 0);
+        REQUIRE(planned.call(coords, out_planned) == 0);
+
+        int64_t mismatches = 0;
+        for (int i = 0; i < out_plain->count(); ++i)
+        {
+            mismatches += (out_plain->cpu_data()[i] != out_planned->cpu_data()[i]);
+        }
+        CHECK(mismatches == 0);
+    }
+
+    // 全对模式下粗层金字塔复用 fmap 的内存
+    CorrBlock block(batch, dim, ht, wd, levels, radius);
+    REQUIRE(block.planWorkspace() == 0);
+    const size_t hw      = ht * wd;
+    size_t       pyramid = 0;
+    for (int i = 0; i < levels; ++i)
+    {
+        pyramid += sizeof(float) * batch * hw * (ht >> i) * (wd >> i);
+    }
+    CHECK(block.workspace_bytes() < pyramid + 2 * sizeof(float) * batch * dim * hw);
+}
+
+TEST_CASE("transpose_cpu matches an element-wise transpose", "[cpu]")
+{
+    // 覆盖整块、寄存器 tile 与边缘的各种组合
+    const std::vector<std::array<int, 3>> cases = {
+        {1, 1, 1}, {1, 8, 8}, {2, 16, 16}, {3, 37, 70}, {2, 256, 135}, {1, 64, 1620}};
+    for (const auto& c : cases)
+    {
+        const int          batch = c[0], rows = c[1], cols = c[2];
+        const int64_t      n     = static_cast<int64_t>(batch) * rows * cols;
+        std::vector<float> src(n), dst(n, -1.0f);
+        for (int64_t i = 0; i < n; ++i)
+        {
+            src[i] = static_cast<float>(i);
+        }
+        transpose_cpu(batch, rows, cols, src.data(), dst.data());
+        int64_t mismatches = 0;
+        for (int b = 0; b < batch; ++b)
+        {
+            for (int i = 0; i < rows; ++i)
+            {
+                for (int j = 0; j < cols; ++j)
+                {
+                    const int64_t plane = static_cast<int64_t>(b) * rows * cols;
+                    mismatches += dst[plane + static_cast<int64_t>(j) * rows + i] !=
+                                  src[plane + static_cast<int64_t>(i) * cols + j];
+                }
+            }
+        }
+        CHECK(mismatches == 0);
+
+        std::vector<float16> half_src(n), half_dst(n);
+        for (int64_t i = 0; i < n; ++i)
+        {
+            half_src[i] = float16(static_cast<float>(i % 2048));
+        }
+        transpose_cpu(batch, rows, cols, half_src.data(), half_dst.data());
+        CHECK(static_cast<float>(half_dst[n - 1]) == static_cast<float>(half_src[n - 1]));
+        if (rows > 1 && cols > 1)
+        {
+            CHECK(half_dst[rows].bits == half_src[1].bits);
+        }
+    }
+}
+
+TEST_CASE("convert_layout round-trips between NCHW and NHWC", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+    auto nchw = std::make_shared<Blob<float>>(2, 24, 9, 13);
+    for (int i = 0; i < nchw->count(); ++i)
+    {
+        nchw->mutable_cpu_data()[i] = std::sin(0.1f * i);
+    }
+    auto nhwc = std::make_shared<Blob<float>>();
+    REQUIRE(convert_layout(nchw, LAYOUT_NHWC, nhwc) == 0);
+    CHECK(nhwc->layout() == LAYOUT_NHWC);
+    CHECK(nhwc->shape() == std::vector<int>({2, 9, 13, 24}));
+    const auto in         = tensor_view<4>(*nchw);
+    const auto out        = tensor_view<4>(*nhwc);
+    int64_t    mismatches = 0;
+    for (int n = 0; n < 2; ++n)
+    {
+        for (int c = 0; c < 24; ++c)
+        {
+            for (int h = 0; h < 9; ++h)
+            {
+                for (int w = 0; w < 13; ++w)
+                {
+                    mismatches += out(n, h, w, c) != in(n, c, h, w);
+                }
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+
+    auto back = std::make_shared<Blob<float>>();
+    REQUIRE(convert_layout(nhwc, LAYOUT_NCHW, back) == 0);
+    CHECK(back->layout() == LAYOUT_NCHW);
+    CHECK(back->shape() == nchw->shape());
+    CHECK(std::equal(back->cpu_data(), back->cpu_data() + back->count(), nchw->cpu_data()));
+
+    // 布局已一致时直接拷贝；预分配的同形状输出也要带上源布局
+    auto same = std::make_shared<Blob<float>>(std::vector<int>({2, 9, 13, 24}));
+    CHECK(same->layout() == LAYOUT_NCHW);
+    REQUIRE(convert_layout(nhwc, LAYOUT_NHWC, same) == 0);
+    CHECK(same->layout() == LAYOUT_NHWC);
+    CHECK(std::equal(same->cpu_data(), same->cpu_data() + same->count(), nhwc->cpu_data()));
+}
+
+TEST_CASE("CorrBlock reads NHWC feature maps directly", "[cpu]")
+{
+    Caffe::set_mode(Caffe::CPU);
+    const int batch = 2, dim = 32, ht = 10, wd = 14, levels = 3, radius = 2;
+    const int win = (2 * radius + 1) * (2 * radius + 1);
+
+    auto fmap1 = std::make_shared<Blob<float>>(batch, dim, ht, wd);
+    auto fmap2 = std::make_shared<Blob<float>>(batch, dim, ht, wd);
+    for (int i = 0; i < fmap1->count(); ++i)
+    {
+        fmap1->mutable_cpu_data()[i] = std::sin(0.013f * i);
+        fmap2->mutable_cpu_data()[i] = std::cos(0.029f * i);
+    }
+    auto fmap1_nhwc = std::make_shared<Blob<float>>();
+    auto fmap2_nhwc = std::make_shared<Blob<float>>();
+    REQUIRE(convert_layout(fmap1, LAYOUT_NHWC, fmap1_nhwc) == 0);
+    REQUIRE(convert_layout(fmap2, LAYOUT_NHWC, fmap2_nhwc) == 0);
+
+    auto coords = std::make_shared<Blob<float>>(batch, 2, ht, wd);
+    for (int i = 0; i < coords->count(); ++i)
+    {
+        coords->mutable_cpu_data()[i] = 5.0f + 4.0f * std::sin(0.37f * i);
+    }
+
+    for (CorrBlock::CorrMode mode : {CorrBlock::ALL_PAIRS, CorrBlock::ON_DEMAND})
+    {
+        CorrBlock from_nchw(batch, dim, ht, wd, levels, radius, mode);
+        CorrBlock from_nhwc(batch, dim, ht, wd, levels, radius, mode);
+        REQUIRE(from_nchw.computeCorr(fmap1, fmap2) == 0);
+        REQUIRE(from_nhwc.computeCorr(fmap1_nhwc, fmap2_nhwc) == 0);
+
+        auto expected = std::make_shared<Blob<float>>(batch, levels * win, ht, wd);
+        auto actual   = std::make_shared<Blob<float>>(batch, levels * win, ht, wd);
+        REQUIRE(from_nchw.call(coords, expected) == 0);
+        REQUIRE(from_nhwc.call(coords, actual) == 0);
+        float max_err = 0.0f;
+        for (int i = 0; i < expected->count(); ++i)
+        {
+            max_err = std::max(max_err, std::fabs(expected->cpu_data()[i] - actual->cpu_data()[i]));
+        }
+        CHECK(max_err < 1e-4f);
+    }
+
+    // int8 GEMM 只支持 NCHW
+    CorrBlock int8_block(batch,
+                         dim,
+                         ht,
+                         wd,
+                         levels,
+                         radius,
+                         CorrBlock::ALL_PAIRS,
+                         CorrBlock::FP32,
+                         CorrBlock::GEMM_INT8);
+    CHECK(int8_block.computeCorr(fmap1_nhwc, fmap2_nhwc) == -1);
+    CorrQuantReport report;
+    CHECK(int8_block.quantErrorReport(fmap1_nhwc, fmap2_nhwc, &report) == -1);
+}
@@ -3,13 +3,18 @@
 #include <catch2/catch_all.hpp>
 #include <catch2/catch_approx.hpp>
 #include <complex>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "blob.hpp"
 #include "npy.hpp"
+#include "npy_sequence.hpp"
+#include "npy_sink.hpp"
 
 const int Nx = 128;
 const int Ny = 64;
@@ -50,4 +55,464 @@ TEST_CASE("blob test", "[blob version]")
     {
         REQUIRE(d[i] == matrix[i]);
     }
+    std::remove("./temp.npy");
+}
+
+TEST_CASE("npy files load by mapping", "[blob version]")
+{
+    ferrari::Blob<float> b(std::vector<int>({4, 3, 17}));
+    float*               p = b.mutable_cpu_data();
+    for (int i = 0; i < b.count(); ++i)
+    {
+        p[i] = 0.5f * i;
+    }
+    b.SaveToNPY("./mapped.npy");
+
+    // 头部按 64 字节补齐，数据直接映射为 blob 的内存
+    size_t              word_size;
+    bool                fortran_order;
+    std::vector<size_t> shape;
+    REQUIRE(cnpy::npy_load_header("./mapped.npy", word_size, shape, fortran_order) % 64 == 0);
+    REQUIRE(shape == std::vector<size_t>({4, 3, 17}));
+
+    ferrari::Blob<float> m;
+    m.LoadFromNPY("./mapped.npy", true);
+    REQUIRE(m.shape() == b.shape());
+    REQUIRE(m.data()->is_mapped());
+    for (int i = 0; i < b.count(); ++i)
+    {
+        REQUIRE(m.cpu_data()[i] == 0.5f * i);
+    }
+    // 写入时拷贝出文件
+    m.mutable_cpu_data()[0] = -1.0f;
+    REQUIRE(!m.data()->is_mapped());
+
+    cnpy::NpyArray array = cnpy::npy_mmap("./mapped.npy");
+    REQUIRE(array.num_vals == static_cast<size_t>(b.count()));
+    REQUIRE(array.num_bytes() == sizeof(float) * b.count());
+    REQUIRE(array.data<float>()[0] == 0.0f);
+    array.data<float>()[1] = -2.0f;
+    REQUIRE(array.as_vec<float>()[1] == -2.0f);
+
+    ferrari::Blob<float> again;
+    again.LoadFromNPY("./mapped.npy");
+    REQUIRE(again.cpu_data()[0] == 0.0f);
+    REQUIRE(again.cpu_data()[1] == 0.5f);
+    std::remove("./mapped.npy");
+}
+
+// 按给定版本与头部字典拼出 npy 文件内容
+static std::string npy_bytes(int version, const std::string& dict, const std::string& payload)
+{
+    std::string bytes("\x93NUMPY", 6);
+    bytes += static_cast<char>(version);
+    bytes += '\0';
+    const size_t len = dict.size();
+    for (int i = 0; i < (version == 1 ? 2 : 4); ++i)
+    {
+        bytes += static_cast<char>((len >> (8 * i)) & 0xff);
+    }
+    return bytes + dict + payload;
+}
+
+static cnpy::NpyHeader parse(const std::string& bytes)
+{
+    return cnpy::parse_npy_header(reinterpret_cast<const unsigned char*>(bytes.data()),
+                                  bytes.size());
+}
+
+TEST_CASE("npy headers of every format version parse", "[npy header]")
+{
+    const std::string v1 = "{'descr': '<f4', 'fortran_order': False, 'shape': (3, 5), }\n";
+    cnpy::NpyHeader   h  = parse(npy_bytes(1, v1, ""));
+    REQUIRE(h.byte_order == '<');
+    REQUIRE(h.type == 'f');
+    REQUIRE(h.word_size == 4);
+    REQUIRE(!h.fortran_order);
+    REQUIRE(h.shape == std::vector<size_t>({3, 5}));
+    REQUIRE(h.data_offset == 10 + v1.size());
+
+    // 版本 2/3 使用 4 字节的头长度，键的顺序与引号不固定
+    const std::string v3 = "{\"shape\": (7,), \"fortran_order\": True, \"descr\": \">i8\"}";
+    h                    = parse(npy_bytes(3, v3, ""));
+    REQUIRE(h.byte_order == '>');
+    REQUIRE(h.type == 'i');
+    REQUIRE(h.word_size == 8);
+    REQUIRE(h.fortran_order);
+    REQUIRE(h.shape == std::vector<size_t>({7}));
+    REQUIRE(h.data_offset == 12 + v3.size());
+
+    h = parse(npy_bytes(2, "{'descr': '|b1', 'fortran_order': False, 'shape': ()}", ""));
+    REQUIRE(h.shape.empty());
+    REQUIRE(h.num_vals() == 1);
+    REQUIRE(h.word_size == 1);
+
+    REQUIRE(parse(npy_bytes(1, "{'descr': '<c16', 'fortran_order': False, 'shape': (2,)}", ""))
+                .word_size == 16);
+    REQUIRE(parse(npy_bytes(1, "{'descr': '<U10', 'fortran_order': False, 'shape': (2,)}", ""))
+                .word_size == 40);
+    REQUIRE(parse(npy_bytes(1, "{'descr': '<M8[ns]', 'fortran_order': False, 'shape': (2,)}", ""))
+                .word_size == 8);
+
+    // 结构体类型: 字段大小之和，含子数组与嵌套
+    h = parse(npy_bytes(1,
+                        "{'descr': [('a', '<f4'), ('b', '<i2', (3,)), ('c', [('x', '|u1')])], "
+                        "'fortran_order': False, 'shape': (4,)}",
+                        ""));
+    REQUIRE(h.type == 'V');
+    REQUIRE(h.word_size == 4 + 2 * 3 + 1);
+
+    // 超过 256 字节的头部
+    std::string long_shape = "(";
+    for (int i = 0; i < 100; ++i)
+    {
+        long_shape += "1, ";
+    }
+    h = parse(npy_bytes(
+        1, "{'descr': '<f4', 'fortran_order': False, 'shape': " + long_shape + ")}", ""));
+    REQUIRE(h.shape.size() == 100);
+
+    REQUIRE_THROWS(parse("not an npy file"));
+    REQUIRE_THROWS(parse(npy_bytes(4, "{}", "")));
+    REQUIRE_THROWS(parse(npy_bytes(1, "{'descr': '<f4', 'shape': (3,)}", "")));
+    const std::string bad_type = "{'descr': '<f4x', 'fortran_order': False, 'shape': ()}";
+    const std::string unclosed = "{'descr': '<f4', 'fortran_order': False, 'shape': (3,";
+    REQUIRE_THROWS(parse(npy_bytes(1, bad_type, "")));
+    REQUIRE_THROWS(parse(npy_bytes(1, unclosed, "")));
+    REQUIRE_THROWS(parse(npy_bytes(1, v1, "").substr(0, 30)));
+}
+
+TEST_CASE("Big-endian and Fortran-order npy files load in C order", "[npy header]")
+{
+    // 2x3 矩阵 [[0, 1, 2], [3, 4, 5]]，按列存储且为大端
+    std::string payload;
+    for (float v : {0.0f, 3.0f, 1.0f, 4.0f, 2.0f, 5.0f})
+    {
+        const char* b = reinterpret_cast<const char*>(&v);
+        payload += std::string({b[3], b[2], b[1], b[0]});
+    }
+    {
+        std::ofstream out("./swapped.npy", std::ios::binary);
+        out << npy_bytes(
+            2, "{'descr': '>f4', 'fortran_order': True, 'shape': (2, 3), }\n", payload);
+    }
+
+    cnpy::NpyArray array = cnpy::npy_load("./swapped.npy");
+    REQUIRE(array.type == 'f');
+    REQUIRE(array.fortran_order);
+    REQUIRE(array.as_vec<float>() == std::vector<float>({0, 3, 1, 4, 2, 5}));
+    REQUIRE(cnpy::npy_mmap("./swapped.npy").as_vec<float>() == array.as_vec<float>());
+
+    for (bool map_file : {false, true})
+    {
+        ferrari::Blob<float> b;
+        b.LoadFromNPY("./swapped.npy", map_file);
+        REQUIRE(b.shape() == std::vector<int>({2, 3}));
+        for (int i = 0; i < 6; ++i)
+        {
+            REQUIRE(b.cpu_data()[i] == static_cast<float>(i));
+        }
+    }
+    std::remove("./swapped.npy");
+}
+
+TEST_CASE("npz members load through the central directory", "[npz]")
+{
+    // 压缩包: a 为 4x5 float32, b 为 int32 (7, 8, 9), c 为大端 float64
+    cnpy::NpzReader reader("test_data/deflated.npz");
+    REQUIRE(reader.entries().size() == 3);
+    REQUIRE(reader.find("b") != NULL);
+    REQUIRE(reader.find("b")->compression == 8);
+    REQUIRE(reader.find("missing") == NULL);
+    REQUIRE_THROWS(reader.load("missing"));
+
+    REQUIRE(reader.load("b").as_vec<int>() == std::vector<int>({7, 8, 9}));
+    REQUIRE(reader.load("c").as_vec<double>() == std::vector<double>({1.5, -2.5}));
+
+    ferrari::Blob<float> a;
+    a.LoadFromNPZ(reader, "a");
+    REQUIRE(a.shape() == std::vector<int>({4, 5}));
+    for (int i = 0; i < a.count(); ++i)
+    {
+        REQUIRE(a.cpu_data()[i] == 0.25f * i);
+    }
+    // 其他类型的成员按 CopyFromNPY 转换
+    ferrari::Blob<float> b, c;
+    b.LoadFromNPZ(reader, "b");
+    REQUIRE(std::vector<float>(b.cpu_data(), b.cpu_data() + b.count()) ==
+            std::vector<float>({7, 8, 9}));
+    c.LoadFromNPZ(reader, "c");
+    REQUIRE(std::vector<float>(c.cpu_data(), c.cpu_data() + c.count()) ==
+            std::vector<float>({1.5f, -2.5f}));
+
+    cnpy::npz_t all = cnpy::npz_load("test_data/deflated.npz");
+    REQUIRE(all.size() == 3);
+    REQUIRE(all["a"].shape == std::vector<size_t>({4, 5}));
+    REQUIRE(all["a"].data<float>()[19] == 4.75f);
+    REQUIRE(all["b"].as_vec<int>() == reader.load("b").as_vec<int>());
+
+    // 未压缩的成员，由 npz_save 逐个追加
+    std::vector<float> x(1000), y(10);
+    for (int i = 0; i < 1000; ++i)
+    {
+        x[i] = i;
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+        y[i] = -i;
+    }
+    cnpy::npz_save("./stored.npz", "x", x);
+    cnpy::npz_save("./stored.npz", "y", y, "a");
+    REQUIRE(cnpy::npz_load("./stored.npz", "y").as_vec<float>() == y);
+    ferrari::Blob<float> bx;
+    bx.LoadFromNPZ("./stored.npz", "x");
+    REQUIRE(std::vector<float>(bx.cpu_data(), bx.cpu_data() + bx.count()) == x);
+    REQUIRE(cnpy::npz_load("./stored.npz").size() == 2);
+    std::remove("./stored.npz");
+}
+
+TEST_CASE("NpzWriter deflates members and finalizes the directory once", "[npz]")
+{
+    std::vector<float> smooth(100000);
+    for (size_t i = 0; i < smooth.size(); ++i)
+    {
+        smooth[i] = static_cast<float>(i % 100);
+    }
+    std::vector<int> small({1, 2, 3});
+
+    for (int level : {0, 1, Z_DEFAULT_COMPRESSION, 9})
+    {
+        {
+            cnpy::NpzWriter writer("./written.npz", "w", level);
+            writer.add("smooth", smooth.data(), {100, 1000});
+            writer.add("small", small.data(), {3});
+            writer.close();
+        }
+        cnpy::NpzReader reader("./written.npz");
+        REQUIRE(reader.entries().size() == 2);
+        REQUIRE(reader.find("smooth")->compression == (level == 0 ? 0 : 8));
+        REQUIRE(reader.load("smooth").as_vec<float>() == smooth);
+        REQUIRE(reader.load("small").shape == std::vector<size_t>({3}));
+        REQUIRE(reader.load("small").as_vec<int>() == small);
+        if (level != 0)
+        {
+            REQUIRE(reader.find("smooth")->compressed_size <
+                    reader.find("smooth")->uncompressed_size / 10);
+        }
+    }
+
+    // 追加到已有的压缩包，保留原有成员
+    cnpy::npz_save("./written.npz", "appended", small, "a", 6);
+    {
+        cnpy::NpzWriter writer("./written.npz", "a");
+        writer.add("more", small.data(), {1, 3});
+    }  // 析构时写入目录
+    cnpy::npz_t all = cnpy::npz_load("./written.npz");
+    REQUIRE(all.size() == 4);
+    REQUIRE(all["smooth"].as_vec<float>() == smooth);
+    REQUIRE(all["appended"].as_vec<int>() == small);
+    REQUIRE(all["more"].shape == std::vector<size_t>({1, 3}));
+    std::remove("./written.npz");
+}
+
+TEST_CASE("NpzWriter switches to ZIP64 records past 65535 members", "[npz]")
+{
+    const int  members = 70000;
+    const char value   = 42;
+    {
+        cnpy::NpzWriter writer("./many.npz");
+        for (int i = 0; i < members; ++i)
+        {
+            writer.add("m" + std::to_string(i), &value, {1});
+        }
+    }
+    cnpy::NpzReader reader("./many.npz");
+    REQUIRE(reader.entries().size() == members);
+    REQUIRE(reader.load("m69999").as_vec<char>() == std::vector<char>({42}));
+    std::remove("./many.npz");
+}
+
+TEST_CASE("NpySink appends frames and saves snapshots in the background", "[npy sink]")
+{
+    ferrari::Blob<float> frame(std::vector<int>{1, 2, 3, 4});
+    ferrari::Blob<float> still(std::vector<int>{5, 6});
+    {
+        ferrari::NpySink sink(2, 2);
+        for (int n = 0; n < 10; ++n)
+        {
+            float* data = frame.mutable_cpu_data();
+            for (int i = 0; i < frame.count(); ++i)
+            {
+                data[i] = n * 100 + i;
+            }
+            // 提交后立即覆盖 blob，写入的必须是提交时的快照
+            REQUIRE(sink.Append(frame, "./frames.npy") == 0);
+        }
+        for (int i = 0; i < still.count(); ++i)
+        {
+            still.mutable_cpu_data()[i] = -i;
+        }
+        REQUIRE(sink.Save(still, "./still.npy") == 0);
+        REQUIRE(sink.Close("./frames.npy") == 0);
+        REQUIRE(sink.Flush() == 0);
+
+        cnpy::NpyArray frames = cnpy::npy_load("./frames.npy");
+        REQUIRE(frames.shape == std::vector<size_t>({10, 2, 3, 4}));
+        const float* values = frames.data<float>();
+        for (int n = 0; n < 10; ++n)
+        {
+            REQUIRE(values[n * 24] == n * 100);
+            REQUIRE(values[n * 24 + 23] == n * 100 + 23);
+        }
+        cnpy::NpyArray saved = cnpy::npy_load("./still.npy");
+        REQUIRE(saved.shape == std::vector<size_t>({5, 6}));
+        REQUIRE(saved.data<float>()[29] == -29);
+
+        // 形状不一致的帧被拒绝，Flush 报告错误
+        ferrari::Blob<float> wrong(std::vector<int>{1, 3});
+        REQUIRE(sink.Append(frame, "./open.npy") == 0);
+        REQUIRE(sink.Append(wrong, "./open.npy") == 0);
+        REQUIRE(sink.Flush() == -1);
+        REQUIRE(sink.Save(still, "./no_such_dir/still.npy") == 0);
+        REQUIRE(sink.Flush() == -1);
+        REQUIRE(sink.Flush() == 0);
+    }
+    // 析构时关闭未显式关闭的流
+    cnpy::NpyArray open = cnpy::npy_load("./open.npy");
+    REQUIRE(open.shape == std::vector<size_t>({1, 2, 3, 4}));
+    std::remove("./frames.npy");
+    std::remove("./still.npy");
+    std::remove("./open.npy");
+}
+
+TEST_CASE("npy files of other element types convert on load", "[npy convert]")
+{
+    // 37 个元素：覆盖向量化主循环和尾部
+    const std::vector<size_t>     shape = {37};
+    std::vector<double>           f64(37);
+    std::vector<uint8_t>          u8(37);
+    std::vector<uint16_t>         u16(37);
+    std::vector<ferrari::float16> f16(37);
+    for (int i = 0; i < 37; ++i)
+    {
+        f64[i] = 0.25 * i - 3.0;
+        u8[i]  = static_cast<uint8_t>(i * 7);
+        u16[i] = static_cast<uint16_t>(i * 1000);
+        f16[i] = ferrari::float16(0.5f * i);
+    }
+    cnpy::npy_save("./f64.npy", f64.data(), shape);
+    cnpy::npy_save("./u8.npy", u8.data(), shape);
+    cnpy::npy_save("./u16.npy", u16.data(), shape);
+    cnpy::npy_save("./f16.npy", f16.data(), shape);
+
+    ferrari::Blob<float> blob;
+    blob.LoadFromNPY("./f64.npy");
+    REQUIRE(blob.shape() == std::vector<int>({37}));
+    for (int i = 0; i < 37; ++i)
+    {
+        REQUIRE(blob.cpu_data()[i] == static_cast<float>(f64[i]));
+    }
+    blob.LoadFromNPY("./u16.npy", true);
+    for (int i = 0; i < 37; ++i)
+    {
+        REQUIRE(blob.cpu_data()[i] == u16[i]);
+    }
+    blob.LoadFromNPY("./f16.npy");
+    for (int i = 0; i < 37; ++i)
+    {
+        REQUIRE(blob.cpu_data()[i] == 0.5f * i);
+    }
+    // RAFT 的输入归一化 2 * (x / 255) - 1 与读取合并为一遍
+    blob.LoadFromNPY("./u8.npy", 2.0f / 255.0f, -1.0f);
+    for (int i = 0; i < 37; ++i)
+    {
+        REQUIRE(blob.cpu_data()[i] == Catch::Approx(2.0 * (u8[i] / 255.0) - 1.0).margin(1e-6));
+    }
+    ferrari::Blob<double> wide;
+    wide.LoadFromNPY("./u8.npy", 0.5f, 1.0f);
+    REQUIRE(wide.cpu_data()[36] == 0.5 * u8[36] + 1.0);
+
+    // int64 是 numpy 的默认整数类型，走标量转换；非数值类型抛出异常而不是终止进程
+    const std::vector<int64_t>             i64 = {-3, 0, 1LL << 40};
+    const std::vector<uint32_t>            u32 = {0, 7, 4000000000u};
+    const std::vector<std::complex<float>> c8(3);
+    cnpy::npy_save("./i64.npy", i64.data(), {3});
+    cnpy::npy_save("./u32.npy", u32.data(), {3});
+    cnpy::npy_save("./c8.npy", c8.data(), {3});
+    blob.LoadFromNPY("./i64.npy");
+    REQUIRE(std::vector<float>(blob.cpu_data(), blob.cpu_data() + 3) ==
+            std::vector<float>({-3.0f, 0.0f, 1099511627776.0f}));
+    blob.LoadFromNPY("./u32.npy");
+    REQUIRE(std::vector<float>(blob.cpu_data(), blob.cpu_data() + 3) ==
+            std::vector<float>({0.0f, 7.0f, 4e9f}));
+    REQUIRE_THROWS_AS(blob.LoadFromNPY("./c8.npy"), std::runtime_error);
+
+    std::remove("./f64.npy");
+    std::remove("./u8.npy");
+    std::remove("./u16.npy");
+    std::remove("./f16.npy");
+    std::remove("./i64.npy");
+    std::remove("./u32.npy");
+    std::remove("./c8.npy");
+}
+
+TEST_CASE("NpySequenceReader hands out prefetched frames in order", "[npy sequence]")
+{
+    // 混合 float32 / uint8 的 npy 帧、一个 npz 帧和一个缺失的帧
+    std::vector<std::string> paths;
+    for (int n = 0; n < 12; ++n)
+    {
+        std::vector<float> frame(2 * 3 * 5);
+        for (size_t i = 0; i < frame.size(); ++i)
+        {
+            frame[i] = n * 1000 + i;
+        }
+        paths.push_back("./frame" + std::to_string(n) + ".npy");
+        cnpy::npy_save(paths.back(), frame.data(), {2, 3, 5});
+    }
+    const std::vector<uint8_t> pixels(30, 51);
+    cnpy::npy_save("./frame_u8.npy", pixels.data(), {2, 3, 5});
+    paths.push_back("./frame_u8.npy");
+    paths.push_back("./test_data/deflated.npz:a");
+    paths.push_back("./no_such_frame.npy");
+    const std::vector<std::complex<float>> spectrum(4);
+    cnpy::npy_save("./frame_c8.npy", spectrum.data(), {4});
+    paths.push_back("./frame_c8.npy");
+
+    for (int direct_io = 0; direct_io < 2; ++direct_io)
+    {
+        ferrari::NpySequenceReader<float> reader(paths, 3, direct_io != 0);
+        REQUIRE(reader.size() == paths.size());
+        ferrari::SharedBlob<float> frame;
+        for (int n = 0; n < 12; ++n)
+        {
+            REQUIRE(reader.position() == n);
+            REQUIRE(reader.Next(&frame) == 0);
+            REQUIRE(frame->shape() == std::vector<int>({2, 3, 5}));
+            REQUIRE(frame->cpu_data()[0] == n * 1000);
+            REQUIRE(frame->cpu_data()[29] == n * 1000 + 29);
+        }
+        REQUIRE(reader.Next(&frame) == 0);
+        REQUIRE(frame->cpu_data()[7] == 51);
+        REQUIRE(reader.Next(&frame) == 0);
+        REQUIRE(frame->shape() == std::vector<int>({4, 5}));
+        REQUIRE(reader.Next(&frame) == -1);
+        REQUIRE(!frame);
+        // 无法转换的帧在 I/O 线程上报错，Next 返回 -1
+        REQUIRE(reader.Next(&frame) == -1);
+        REQUIRE(!frame);
+    }
+    {
+        // 归一化在读取线程上完成；提前析构时放弃未取走的帧
+        ferrari::NpySequenceReader<float> reader(paths, 4, false, 2.0f / 255.0f, -1.0f);
+        ferrari::SharedBlob<float>        frame;
+        REQUIRE(reader.Next(&frame) == 0);
+        REQUIRE(frame->cpu_data()[1] == Catch::Approx(2.0 * (1.0 / 255.0) - 1.0));
+    }
+    for (int n = 0; n < 12; ++n)
+    {
+        std::remove(paths[n].c_str());
+    }
+    std::remove("./frame_u8.npy");
+    std::remove("./frame_c8.npy");
 }
@@ -0,0 +1,185 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blob.hpp"
+#include "host_allocator.hpp"
+#include "syncedmem.hpp"
+
+using namespace ::ferrari;
+
+TEST_CASE("HostAllocator rounds requests up to power-of-two classes", "[syncedmem]")
+{
+    CHECK(HostAllocator::ClassSize(0) == 64);
+    CHECK(HostAllocator::ClassSize(1) == 64);
+    CHECK(HostAllocator::ClassSize(64) == 64);
+    CHECK(HostAllocator::ClassSize(65) == 128);
+    CHECK(HostAllocator::ClassSize(3 << 20) == (4 << 20));
+    CHECK(HostAllocator::ClassSize(HostAllocator::kMaxCachedSize) == HostAllocator::kMaxCachedSize);
+    // 超过最大缓存类别的请求按原大小直接向系统申请
+    CHECK(HostAllocator::ClassSize(HostAllocator::kMaxCachedSize + 1) ==
+          HostAllocator::kMaxCachedSize + 1);
+}
+
+TEST_CASE("HostAllocator reuses freed blocks without system allocations", "[syncedmem]")
+{
+    Caffe::set_mode(Caffe::CPU);
+    HostAllocator& alloc = HostAllocator::Get();
+    alloc.Trim();
+
+    // 模拟逐帧循环：小块走线程缓存，多 MB 的块走共享空闲链表
+    const std::vector<std::vector<int>> shapes = {{1, 3, 4, 4}, {11, 256, 30, 54}, {2, 81, 30, 54}};
+    auto frame = [&]()
+    {
+        std::vector<std::shared_ptr<Blob<float>>> blobs;
+        for (const auto& shape : shapes)
+        {
+            blobs.push_back(std::make_shared<Blob<float>>(shape));
+            float* p = blobs.back()->mutable_cpu_data();
+            REQUIRE(p[0] == 0.0f);  // 复用的块同样被清零
+            p[0] = 1.0f;
+        }
+        // Reshape 变大会释放旧块并申请新块
+        blobs[0]->Reshape(std::vector<int>({4, 3, 16, 16}));
+        blobs[0]->mutable_cpu_data()[1] = 2.0f;
+    };
+
+    frame();
+    const HostAllocatorStats warm = alloc.stats();
+    for (int i = 0; i < 5; ++i)
+    {
+        frame();
+    }
+    const HostAllocatorStats steady = alloc.stats();
+    CHECK(steady.system_allocs == warm.system_allocs);
+    CHECK(steady.allocations - warm.allocations >= 5 * 4);
+    CHECK(steady.cache_hits - warm.cache_hits == steady.allocations - warm.allocations);
+    CHECK(steady.bytes_in_use == warm.bytes_in_use);
+    CHECK(steady.bytes_cached > 0);
+
+    alloc.Trim();
+    const HostAllocatorStats trimmed = alloc.stats();
+    CHECK(trimmed.bytes_cached == 0);
+    CHECK(trimmed.system_frees > steady.system_frees);
+}
+
+TEST_CASE("HostAllocator blocks move between threads", "[syncedmem]")
+{
+    HostAllocator& alloc = HostAllocator::Get();
+    alloc.Trim();
+
+    // 线程退出时其缓存归还到共享链表，可被其他线程复用
+    void* block = NULL;
+    std::thread producer(
+        [&]()
+        {
+            block = alloc.Allocate(1000, false);
+            std::memset(block, 0x5a, 1000);
+            alloc.Free(block, 1000, false);
+        });
+    producer.join();
+    CHECK(alloc.stats().bytes_cached == 1024);
+
+    void* reused = alloc.Allocate(1000, false);
+    CHECK(reused == block);
+    alloc.Free(reused, 1000, false);
+    alloc.Trim();
+    CHECK(alloc.stats().bytes_cached == 0);
+}
+
+TEST_CASE("HostAllocator aligns blocks and maps large ones on 2 MB pages", "[syncedmem]")
+{
+    HostAllocator& alloc = HostAllocator::Get();
+    alloc.Trim();
+
+    for (size_t size : {size_t(1), size_t(100), size_t(3000), size_t(5) << 20})
+    {
+        void* p = alloc.Allocate(size, false);
+        CHECK(reinterpret_cast<uintptr_t>(p) % HostAllocator::kAlignment == 0);
+        std::memset(p, 1, size);
+        alloc.Free(p, size, false);
+    }
+    Blob<float> blob(std::vector<int>({3, 5, 7}));
+    CHECK(reinterpret_cast<uintptr_t>(blob.cpu_data()) % 64 == 0);
+
+#ifdef __linux__
+    // 超过阈值的块整块映射并按 2 MB 对齐；系统没有大页时退回普通页，仍可正常使用
+    const size_t big = size_t(9) << 20;
+    void*        p   = alloc.Allocate(big, false);
+    CHECK(reinterpret_cast<uintptr_t>(p) % HostAllocator::kHugePageSize == 0);
+    std::memset(p, 2, big);
+    alloc.Free(p, big, false);
+#endif
+
+    // 阈值为 0 时关闭大页
+    alloc.Trim();
+    const size_t threshold = alloc.huge_page_threshold();
+    alloc.set_huge_page_threshold(0);
+    const uint64_t huge = alloc.stats().huge_page_allocs;
+    void*          q    = alloc.Allocate(size_t(9) << 20, false);
+    CHECK(reinterpret_cast<uintptr_t>(q) % HostAllocator::kAlignment == 0);
+    alloc.Free(q, size_t(9) << 20, false);
+    CHECK(alloc.stats().huge_page_allocs == huge);
+    alloc.set_huge_page_threshold(1);
+    CHECK(alloc.huge_page_threshold() == HostAllocator::kHugePageSize);
+    alloc.set_huge_page_threshold(threshold);
+    alloc.Trim();
+}
+
+TEST_CASE("SyncedMemory maps file regions read-only or copy-on-write", "[syncedmem]")
+{
+    // 16 字节的文件头后跟 1000 个 float, 数据起点不是页对齐的
+    const std::string  path = "mapped.bin";
+    std::vector<float> values(1000);
+    for (int i = 0; i < 1000; ++i)
+    {
+        values[i] = static_cast<float>(i);
+    }
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write("0123456789abcdef", 16);
+        out.write(reinterpret_cast<const char*>(values.data()), sizeof(float) * values.size());
+    }
+
+    // 只读映射: 读取零拷贝，写入前先拷贝到自有内存
+    Blob<float> ro;
+    CHECK(ro.MapFromFile(path, 16, std::vector<int>({10, 100})) == 0);
+    CHECK(ro.data()->is_mapped());
+    CHECK(ro.data()->head() == SyncedMemory::HEAD_AT_CPU);
+    CHECK(ro.data_at(std::vector<int>({9, 99})) == 999.0f);
+    const float* mapped = ro.cpu_data();
+    CHECK(ro.data()->is_mapped());
+    ro.mutable_cpu_data()[0] = -1.0f;
+    CHECK(!ro.data()->is_mapped());
+    CHECK(ro.cpu_data() != mapped);
+    CHECK(ro.cpu_data()[0] == -1.0f);
+    CHECK(ro.cpu_data()[999] == 999.0f);
+
+    // 写时复制: 原地写入，文件不变
+    Blob<float> cow;
+    const int   rc = cow.MapFromFile(
+        path, 16 + 4 * 500, std::vector<int>({500}), SyncedMemory::COPY_ON_WRITE);
+    CHECK(rc == 0);
+    cow.mutable_cpu_data()[0] = -2.0f;
+    CHECK(cow.data()->is_mapped());
+    CHECK(cow.cpu_data()[0] == -2.0f);
+    CHECK(cow.cpu_data()[1] == 501.0f);
+
+    Blob<float> again;
+    CHECK(again.MapFromFile(path, 16, std::vector<int>({1000})) == 0);
+    CHECK(again.cpu_data()[0] == 0.0f);
+    CHECK(again.cpu_data()[500] == 500.0f);
+
+    // 越界或不存在的文件返回错误
+    Blob<float> bad;
+    CHECK(bad.MapFromFile(path, 16, std::vector<int>({1001})) == -1);
+    CHECK(bad.MapFromFile("no_such_file.bin", 0, std::vector<int>({1})) == -1);
+    std::remove(path.c_str());
+}